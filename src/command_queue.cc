@@ -124,6 +124,17 @@ bool CommandQueue::QueueEmpty() const {
     return true;
 }
 
+bool CommandQueue::OtherBankQueued(int rank, int bankgroup, int bank) const {
+    for (const auto& q : queues_) {
+        for (const auto& cmd : q) {
+            if (cmd.Rank() != rank || cmd.Bankgroup() != bankgroup ||
+                cmd.Bank() != bank) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
 bool CommandQueue::AddCommand(Command cmd) {
     auto& queue = GetQueue(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
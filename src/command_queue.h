@@ -24,6 +24,8 @@ class CommandQueue {
     bool WillAcceptCommand(int rank, int bankgroup, int bank) const;
     bool AddCommand(Command cmd);
     bool QueueEmpty() const;
+    // commands of another bank than rank, bankgroup, bank are queued
+    bool OtherBankQueued(int rank, int bankgroup, int bank) const;
     int QueueUsage() const;
     std::vector<bool> rank_q_empty;
     int mode_;
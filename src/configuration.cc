@@ -2,6 +2,8 @@
 
 #include <vector>
 
+#include "stats_sink.h"
+
 #ifdef THERMAL
 #include <math.h>
 #endif  // THERMAL
@@ -23,6 +25,8 @@ Config::Config(std::string config_file, std::string out_dir)
     SetAddressMapping();
     InitTimingParams();
     InitPowerParams();
+    InitPimParams();
+    InitPimPowerParams();
     InitOtherParams();
 #ifdef THERMAL
     InitThermalParams();
@@ -174,9 +178,15 @@ void Config::InitOtherParams() {
     }
     output_prefix =
         output_dir + reader.Get("other", "output_prefix", "dramsim3");
-    json_stats_name = output_prefix + ".json";
-    json_epoch_name = output_prefix + "epoch.json";
+    // epoch/final stats format: json (default), jsonl or csv
+    stats_format = reader.Get("other", "stats_format", "json");
+    std::string stats_ext = StatsFormatExtension(GetStatsFormat(stats_format));
+    json_stats_name = output_prefix + stats_ext;
+    json_epoch_name = output_prefix + "epoch" + stats_ext;
     txt_stats_name = output_prefix + ".txt";
+    // trace format: text (same as before) or binary, decode with tracecat
+    trace_binary = reader.Get("other", "trace_format", "text") == "binary";
+    trace_compress = reader.GetBoolean("other", "trace_compress", false);
     return;
 }
 
@@ -214,6 +224,56 @@ void Config::InitPowerParams() {
     return;
 }
 
+void Config::InitPimParams() {
+    crf_depth = GetInteger("pim", "crf_depth", 32);
+    // the CRF row holds 32 words of CRF_ENTRIES_PER_WORD entries
+    if (crf_depth <= 0 || crf_depth > 32 * CRF_ENTRIES_PER_WORD ||
+        crf_depth % CRF_ENTRIES_PER_WORD != 0) {
+        std::cerr << "crf_depth must be a multiple of " << CRF_ENTRIES_PER_WORD
+                  << " up to " << 32 * CRF_ENTRIES_PER_WORD << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    host_issue_width = GetInteger("pim", "host_issue_width", 1);
+    if (host_issue_width <= 0 || host_issue_width > channels) {
+        std::cerr << "host_issue_width must be 1 ~ " << channels << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return;
+}
+
+void Config::InitPimPowerParams() {
+    const auto& reader = *reader_;
+    // energy of one instruction on one PimUnit (16 lanes), in pJ
+    // LD/ST/MOV/FILL only move data, which is billed as register file accesses
+    pim_op_energy.assign(NUM_PIM_OPERATIONS, 0.0);
+    pim_op_energy[(int)PIM_OPERATION::ADD] =
+        reader.GetReal("pim_power", "add_energy", 6.4);
+    pim_op_energy[(int)PIM_OPERATION::MUL] =
+        reader.GetReal("pim_power", "mul_energy", 17.6);
+    pim_op_energy[(int)PIM_OPERATION::BN] =
+        reader.GetReal("pim_power", "mac_energy", 24.0);
+    pim_op_energy[(int)PIM_OPERATION::MAC] = pim_op_energy[(int)PIM_OPERATION::BN];
+    pim_op_energy[(int)PIM_OPERATION::MAD] = pim_op_energy[(int)PIM_OPERATION::BN];
+    // RELU and CLAMP compare like an adder, LUT multiplies and adds
+    pim_op_energy[(int)PIM_OPERATION::RELU] = pim_op_energy[(int)PIM_OPERATION::ADD];
+    pim_op_energy[(int)PIM_OPERATION::CLAMP] = 2 * pim_op_energy[(int)PIM_OPERATION::ADD];
+    pim_op_energy[(int)PIM_OPERATION::LUT] = pim_op_energy[(int)PIM_OPERATION::BN];
+    // MAX and the reductions compare or add once per lane
+    for (PIM_OPERATION op : {PIM_OPERATION::MAX, PIM_OPERATION::ARGMAX, PIM_OPERATION::RSUM,
+                             PIM_OPERATION::RMAX, PIM_OPERATION::RARGMAX}) {
+        pim_op_energy[(int)op] = pim_op_energy[(int)PIM_OPERATION::ADD];
+    }
+    // the fixed point ops round and saturate next to the multiplier
+    pim_op_energy[(int)PIM_OPERATION::QMUL] = pim_op_energy[(int)PIM_OPERATION::MUL];
+    pim_op_energy[(int)PIM_OPERATION::QMAC] = pim_op_energy[(int)PIM_OPERATION::MAC];
+    pim_op_energy[(int)PIM_OPERATION::GEMV] =
+        reader.GetReal("pim_power", "gemv_energy", 48.0);
+    pim_rf_energy = reader.GetReal("pim_power", "rf_energy", 2.0);
+    pim_mode_switch_energy =
+        reader.GetReal("pim_power", "mode_switch_energy", 100.0);
+    return;
+}
+
 void Config::InitSystemParams() {
     const auto& reader = *reader_;
     channel_size = GetInteger("system", "channel_size", 1024);
@@ -288,6 +348,8 @@ void Config::InitThermalParams() {
         chip_dim_y = reader.GetReal("thermal", "chip_dim_y", 0.01);
         amb_temp = reader.GetReal("thermal", "amb_temp", 40);
     }
+    pim_throttle_temp = reader.GetReal("thermal", "pim_throttle_temp", 0.0);
+    pim_throttle_stall = GetInteger("thermal", "pim_throttle_stall", 4);
     return;
 }
 #endif  // THERMAL
@@ -3,7 +3,9 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 #include "common.h"
+#include "pim_config.h"
 
 #include "INIReader.h"
 
@@ -111,6 +113,17 @@ class Config {
     double pre_pd_energy_inc;
     double sref_energy_inc;
 
+    // PIM energy in pJ, per instruction of one PimUnit (indexed by
+    // PIM_OPERATION), per register file word access and per mode change
+    std::vector<double> pim_op_energy;
+    double pim_rf_energy;
+    double pim_mode_switch_energy;
+
+    // PIM sequencer
+    int crf_depth;  // CRF entries of every PimUnit
+    // transactions the host issues per cycle, at most one per channel
+    int host_issue_width;
+
     // HMC
     int num_links;
     int num_dies;
@@ -142,6 +155,9 @@ class Config {
     std::string json_stats_name;
     std::string json_epoch_name;
     std::string txt_stats_name;
+    std::string stats_format;   // json, jsonl or csv
+    bool trace_binary;      // CMD_TRACE/ADDR_TRACE record format
+    bool trace_compress;    // LZ compress binary trace blocks
 
     // Computed parameters
     int request_size_bytes;
@@ -180,6 +196,10 @@ class Config {
     int row_tile;
     int tile_row_num;
     double bank_asr;  // the aspect ratio of a bank: #row_bits / #col_bits
+    // stall BG mode commands for pim_throttle_stall cycles after each PIM
+    // command while the max temperature is above pim_throttle_temp [C]
+    double pim_throttle_temp;  // <= 0 disables the throttle
+    int pim_throttle_stall;
 #endif  // THERMAL
 
    private:
@@ -191,6 +211,8 @@ class Config {
     void InitDRAMParams();
     void InitOtherParams();
     void InitPowerParams();
+    void InitPimParams();
+    void InitPimPowerParams();
     void InitSystemParams();
 #ifdef THERMAL
     void InitThermalParams();
@@ -7,7 +7,7 @@ namespace dramsim3 {
 
 #ifdef THERMAL
 Controller::Controller(int channel, const Config &config, const Timing &timing,
-                       ThermalCalculator &thermal_calc)
+                       ThermalCalculator &thermal_calc, PimFuncSim* pim_func_sim)
 #else
 Controller::Controller(int channel, const Config &config, const Timing &timing, PimFuncSim* pim_func_sim)
 #endif  // THERMAL
@@ -21,14 +21,19 @@ Controller::Controller(int channel, const Config &config, const Timing &timing,
       refresh_(config, channel_state_),
 #ifdef THERMAL
       thermal_calc_(thermal_calc),
+      pim_stall_cycles_(0),
 #endif  // THERMAL
       is_unified_queue_(config.unified_queue),
       row_buf_policy_(config.row_buf_policy == "CLOSE_PAGE"
                           ? RowBufPolicy::CLOSE_PAGE
                           : RowBufPolicy::OPEN_PAGE),
       last_trans_clk_(0),
+      sb_mode_cycles_(0),
+      abg_mode_cycles_(0),
+      bg_mode_cycles_(0),
       mode_(0),
       BG_count(0),
+      pim_cmd_count_(0),
       write_buffer_threshold_(8),
       write_draining_(0) {
     if (is_unified_queue_) {
@@ -41,8 +46,11 @@ Controller::Controller(int channel, const Config &config, const Timing &timing,
 #ifdef CMD_TRACE
     std::string trace_file_name = config_.output_prefix + "ch_" +
                                   std::to_string(channel_id_) + "cmd.trace";
+    if (config_.trace_binary) trace_file_name += ".bin";
     std::cout << "Command Trace write to " << trace_file_name << std::endl;
-    cmd_trace_.open(trace_file_name, std::ofstream::out);
+    cmd_trace_.reset(new TraceWriter(trace_file_name, TraceKind::COMMAND,
+                                     channel_id_, config_.trace_binary,
+                                     config_.trace_compress));
 #endif  // CMD_TRACE
 }
 
@@ -75,8 +83,19 @@ void Controller::ClockTick() {
         cmd = cmd_queue_.FinishRefresh();
     }
 
+#ifdef THERMAL
+    // thermal throttle holds back BG mode commands, refresh still goes on
+    bool pim_throttled = mode_ == 1 && pim_stall_cycles_ > 0;
+    if (pim_throttled) {
+        pim_stall_cycles_--;
+        simple_stats_.Increment("pim_throttle_cycles");
+    }
+#else
+    bool pim_throttled = false;
+#endif  // THERMAL
+
     // cannot find a refresh related command or there's no refresh
-    if (!cmd.IsValid()) {
+    if (!cmd.IsValid() && !pim_throttled) {
         cmd = cmd_queue_.GetCommandToIssue();
     }
     if (cmd.IsValid()) {   
@@ -108,9 +127,12 @@ void Controller::ClockTick() {
 
         // SUMIN EDIT
         // pim only activates on R/W command
-        if (mode_ == 1 && cmd.IsReadWrite()) {
+        // SRF writes only fill the SRF, they do not step the kernel
+        if (mode_ == 1 && cmd.IsReadWrite() &&
+            !(cmd.IsWrite() && cmd.Row() == SRF_ROW)) {
             // pim calculation on operand cache
             pim_func_sim_->PIM_OP(channel_id_);
+            pim_cmd_count_++;
             // R/W cache R/W
             if (cmd.IsRead()) {
                 // read command
@@ -127,11 +149,21 @@ void Controller::ClockTick() {
             }
             else {
                 // write command => command that is called 2 times to finish row operation
-                Command delayed_cmd = delayed_queue_.front();
-                delayed_queue_.pop();
-                pim_func_sim_->PIM_Write(delayed_cmd);
-                BG_count = 0;
+                // after a single read, the first one only computes it
+                if (BG_count >= 2) {
+                    Command delayed_cmd = delayed_queue_.front();
+                    delayed_queue_.pop();
+                    pim_func_sim_->PIM_Write(delayed_cmd);
+                }
+                BG_count += 1;
+                if (delayed_queue_.empty()) { BG_count = 0; }
             }
+#ifdef THERMAL
+            if (config_.pim_throttle_temp > 0 &&
+                thermal_calc_.GetMaxTemperature() >= config_.pim_throttle_temp) {
+                pim_stall_cycles_ = config_.pim_throttle_stall;
+            }
+#endif  // THERMAL
         }
         // SUMIN EDIT FINISHED
 
@@ -198,6 +230,16 @@ void Controller::ClockTick() {
         }
     }
 
+    // bank mode residency, flushed into stats at every epoch
+    int bank_mode = pim_func_sim_->bankmode_id[channel_id_];
+    if (bank_mode == 0) {
+        sb_mode_cycles_++;
+    } else if (bank_mode == 2) {
+        abg_mode_cycles_++;
+    } else {
+        bg_mode_cycles_++;
+    }
+
     ScheduleTransaction();
     clk_++;
     cmd_queue_.ClockTick();
@@ -244,7 +286,9 @@ bool Controller::AddTransaction(Transaction trans) {
             return true;
         }
         pending_rd_q_.insert(std::make_pair(trans.addr, trans));
-        if (pending_rd_q_.count(trans.addr) == 1) {
+        // in BG mode every read is a PIM command that steps the kernel, so
+        // reads to the same address are not merged
+        if (pending_rd_q_.count(trans.addr) == 1 || mode_ == 1) {
             if (is_unified_queue_) {
                 unified_queue_.push_back(trans);
             }
@@ -271,6 +315,14 @@ void Controller::ScheduleTransaction() {
                           : write_draining_ > 0 ? write_buffer_ : read_queue_;
     for (auto it = queue.begin(); it != queue.end(); it++) {
         auto cmd = TransToCommand(*it);
+        // in BG mode every read steps the kernel, the bank queues would
+        // reorder reads to different banks, so a read goes to the command
+        // queue in order and only while no other bank has commands queued
+        if (mode_ == 1 && !it->is_write &&
+            (it != queue.begin() ||
+             cmd_queue_.OtherBankQueued(cmd.Rank(), cmd.Bankgroup(), cmd.Bank()))) {
+            break;
+        }
         //std::cout << (*it).executed_bankmode << std::endl;  ok
         if (cmd_queue_.WillAcceptCommand(cmd.Rank(), cmd.Bankgroup(),
                                          cmd.Bank())) {
@@ -294,7 +346,7 @@ void Controller::ScheduleTransaction() {
 void Controller::IssueCommand(const Command &cmd) {
 //std::cout << cmd.executed_bankmode;
 #ifdef CMD_TRACE
-    cmd_trace_ << std::left << std::setw(18) << clk_ << " " << cmd << std::endl;
+    cmd_trace_->AddCommand(clk_, cmd);
 #endif  // CMD_TRACE
 #ifdef THERMAL
     // add channel in, only needed by thermal module
@@ -307,7 +359,9 @@ void Controller::IssueCommand(const Command &cmd) {
             std::cerr << cmd.hex_addr << " not in read queue! " << std::endl;
             exit(1);
         }
-        // if there are multiple reads pending return them all
+        // if there are multiple reads pending return them all, in BG mode
+        // each of them has a command of its own
+        if (mode_ == 1) num_reads = 1;
         while (num_reads > 0) {
             auto it = pending_rd_q_.find(cmd.hex_addr);
 		    //std::cout << std::hex << clk_ << "\tread\t" << cmd.hex_addr << std::dec << std::endl;
@@ -348,9 +402,57 @@ Command Controller::TransToCommand(const Transaction &trans) {
 
 int Controller::QueueUsage() const { return cmd_queue_.QueueUsage(); }
 
-void Controller::PrintEpochStats() {
+void Controller::UpdatePimStats() {
+    simple_stats_.IncrementBy("sb_mode_cycles", sb_mode_cycles_);
+    simple_stats_.IncrementBy("abg_mode_cycles", abg_mode_cycles_);
+    simple_stats_.IncrementBy("bg_mode_cycles", bg_mode_cycles_);
+    sb_mode_cycles_ = abg_mode_cycles_ = bg_mode_cycles_ = 0;
+
+    simple_stats_.IncrementBy("pim_mode_changes",
+                              pim_func_sim_->mode_changes_[channel_id_]);
+    simple_stats_.IncrementBy("pim_srf_writes",
+                              pim_func_sim_->srf_writes_[channel_id_]);
+    simple_stats_.IncrementBy("pim_crf_insts",
+                              pim_func_sim_->crf_insts_[channel_id_]);
+    pim_func_sim_->mode_changes_[channel_id_] = 0;
+    pim_func_sim_->srf_writes_[channel_id_] = 0;
+    pim_func_sim_->crf_insts_[channel_id_] = 0;
+
+    // one PimUnit per bankgroup of this channel
+    for (int bg = 0; bg < config_.bankgroups; bg++) {
+        PimUnit *unit =
+            pim_func_sim_->pim_unit_[channel_id_ * config_.bankgroups + bg];
+        for (int op = (int)PIM_OPERATION::LD; op < NUM_PIM_OPERATIONS; op++) {
+            simple_stats_.IncrementVecBy(
+                std::string("pim_") + PimOperationName((PIM_OPERATION)op) +
+                    "_insts",
+                bg, unit->inst_count[op]);
+        }
+        simple_stats_.IncrementVecBy("pim_idle_slots", bg, unit->idle_slots);
+        simple_stats_.IncrementBy("pim_rf_accesses", unit->rf_accesses);
+#ifdef THERMAL
+        double unit_energy = unit->rf_accesses * config_.pim_rf_energy;
+        for (int op = 0; op < NUM_PIM_OPERATIONS; op++) {
+            unit_energy += unit->inst_count[op] * config_.pim_op_energy[op];
+        }
+        thermal_calc_.UpdatePimPower(channel_id_, bg, unit_energy);
+#endif  // THERMAL
+        simple_stats_.IncrementBy(
+            "pim_internal_bytes",
+            unit->bank_read_bytes + unit->bank_write_bytes);
+        unit->ResetStats();
+    }
+}
+
+double Controller::GetTotalEnergy() {
+    UpdatePimStats();
+    return simple_stats_.TotalEnergy();
+}
+
+void Controller::PrintEpochStats(StatsSink* sink) {
+    UpdatePimStats();
     simple_stats_.Increment("epoch_num");           // no touch
-    simple_stats_.PrintEpochStats();                // no touch
+    simple_stats_.PrintEpochStats(sink);            // no touch
 #ifdef THERMAL
     for (int r = 0; r < config_.ranks; r++) {
         double bg_energy = simple_stats_.RankBackgroundEnergy(r);     // sum of act, pre, sref energy
@@ -360,8 +462,9 @@ void Controller::PrintEpochStats() {
     return;
 }
 
-void Controller::PrintFinalStats() {                
-    simple_stats_.PrintFinalStats();                 // no touch
+void Controller::PrintFinalStats(StatsSink* sink, std::ostream* txt_out) {
+    UpdatePimStats();
+    simple_stats_.PrintFinalStats(sink, txt_out);    // no touch
 
 #ifdef THERMAL
     for (int r = 0; r < config_.ranks; r++) {
@@ -373,17 +476,16 @@ void Controller::PrintFinalStats() {
 }
 
 void Controller::UpdateCommandStats(const Command &cmd) {
+    // a command issued in ABG/BG mode is performed on every bank,
+    // commands without a bank mode (refresh, sref) are single commands
+    int cmd_banks = (cmd.executed_bankmode == "ABG" ||
+                     cmd.executed_bankmode == "BG")
+                        ? config_.banks
+                        : 1;
     switch (cmd.cmd_type) {
         case CommandType::READ:
         case CommandType::READ_PRECHARGE:
-            // >> mmm
-            if(cmd.executed_bankmode == "SB") {
-                simple_stats_.Increment("num_read_cmds");                   // number of read/readp commands
-            } else {
-                for(int i=0; i<config_.banks; i++)
-                    simple_stats_.Increment("num_read_cmds");                   // number of read/readp commands
-            }
-            // mmm <<
+            simple_stats_.IncrementBy("num_read_cmds", cmd_banks);      // number of read/readp commands
             if (channel_state_.RowHitCount(cmd.Rank(), cmd.Bankgroup(),
                                            cmd.Bank()) != 0) {
                 simple_stats_.Increment("num_read_row_hits");           // number of read row buffer hits     no touch I think
@@ -391,52 +493,23 @@ void Controller::UpdateCommandStats(const Command &cmd) {
             break;
         case CommandType::WRITE:
         case CommandType::WRITE_PRECHARGE:
-            // >> mmm
-            if(cmd.executed_bankmode == "SB") {
-                simple_stats_.Increment("num_write_cmds");                   // number of write/writep commands
-            } else {
-                for(int i=0; i<config_.banks; i++)
-                    simple_stats_.Increment("num_write_cmds");
-            }
-
-            // mmm <<
+            simple_stats_.IncrementBy("num_write_cmds", cmd_banks);     // number of write/writep commands
             if (channel_state_.RowHitCount(cmd.Rank(), cmd.Bankgroup(),
                                            cmd.Bank()) != 0) {
                 simple_stats_.Increment("num_write_row_hits");           // number of write row buffer hits     no touch I think
             }
             break;
         case CommandType::ACTIVATE:
-            // >> mmm
-            if(cmd.executed_bankmode == "SB") {
-                simple_stats_.Increment("num_act_cmds");                     // number of act commands      
-            } else {
-                for(int i=0; i<config_.banks; i++)
-                    simple_stats_.Increment("num_act_cmds");
-            }
-            // mmm <<
+            simple_stats_.IncrementBy("num_act_cmds", cmd_banks);       // number of act commands
             break;
         case CommandType::PRECHARGE:
-            // >> mmm
-            if(cmd.executed_bankmode == "SB") {
-                simple_stats_.Increment("num_pre_cmds");                     // number of pre commands        
-            } else {
-                for(int i=0; i<config_.banks; i++)
-                    simple_stats_.Increment("num_pre_cmds");
-            }
-            // mmm <<
+            simple_stats_.IncrementBy("num_pre_cmds", cmd_banks);       // number of pre commands
             break;
         case CommandType::REFRESH:                                        // >> hmm point    I remember this is about rank refresh
             simple_stats_.Increment("num_ref_cmds");                     // number of refresh commands        
             break;
         case CommandType::REFRESH_BANK:
-            // >> mmm
-            if(cmd.executed_bankmode == "SB") {
-                simple_stats_.Increment("num_refb_cmds");                     // number of pre commands        
-            } else {
-                for(int i=0; i<config_.banks; i++)
-                    simple_stats_.Increment("num_refb_cmds");
-            }
-            // mmm <<
+            simple_stats_.IncrementBy("num_refb_cmds", cmd_banks);      // number of refresh bank commands
             break;
         case CommandType::SREF_ENTER:  // no touch
             simple_stats_.Increment("num_srefe_cmds");                   // number of self ref ~      no touch       
@@ -456,7 +529,13 @@ bool Controller::IsPendingTransaction() {
         return true;
 }
 
+bool Controller::IsQueuedTransaction() const {
+    return !unified_queue_.empty() || !read_queue_.empty() ||
+           !write_buffer_.empty();
+}
+
 void Controller::SetMode(int mode) {
+    if (mode == 1 && mode_ != 1) pim_cmd_count_ = 0;
     mode_ = mode;
     cmd_queue_.mode_ = mode;
 }
@@ -18,6 +18,11 @@
 #include "thermal.h"
 #endif  // THERMAL
 
+#ifdef CMD_TRACE
+#include <memory>
+#include "trace_writer.h"
+#endif  // CMD_TRACE
+
 namespace dramsim3 {
 
 enum class RowBufPolicy { OPEN_PAGE, CLOSE_PAGE, SIZE };
@@ -26,7 +31,7 @@ class Controller {
    public:
 #ifdef THERMAL
     Controller(int channel, const Config &config, const Timing &timing,
-               ThermalCalculator &thermalcalc);
+               ThermalCalculator &thermalcalc, PimFuncSim* pim_func_sim);
 #else
     Controller(int channel, const Config &config, const Timing &timing, PimFuncSim* pim_func_sim);
 #endif  // THERMAL
@@ -35,18 +40,29 @@ class Controller {
     bool AddTransaction(Transaction trans);
     int QueueUsage() const;
     // Stats output
-    void PrintEpochStats();
-    void PrintFinalStats();
+    void PrintEpochStats(StatsSink* sink);
+    void PrintFinalStats(StatsSink* sink, std::ostream* txt_out);
     void ResetStats() { simple_stats_.Reset(); }
     std::pair<uint64_t, std::pair<int, uint8_t*>> ReturnDoneTrans(uint64_t clock);
+    void UpdatePimStats();
+    // energy (pJ) of this channel so far. Drains the PIM counters into the
+    // stats like an epoch end does, so with THERMAL the PIM energy drained
+    // here goes to the power map now instead of at the next epoch. It is
+    // still added once, to the power epoch that is current
+    double GetTotalEnergy();
     void SetMode(int mode);
 
     // For barrier
     bool IsPendingTransaction();
+    // transactions not yet turned into commands
+    bool IsQueuedTransaction() const;
+    // commands that stepped the kernel since the channel went to BG mode
+    uint64_t PimCommandCount() const { return pim_cmd_count_; }
     int write_buffer_threshold_;
     int channel_id_;
     int mode_;          // <Capstone> bg mode bool
     int BG_count;       // how many BG read transaction are waiting
+    uint64_t pim_cmd_count_;
 
     std::queue<Command> delayed_queue_; // record delayed command address
 
@@ -62,6 +78,7 @@ class Controller {
 
 #ifdef THERMAL
     ThermalCalculator &thermal_calc_;
+    int pim_stall_cycles_;  // remaining thermal throttle stall in BG mode
 #endif  // THERMAL
 
     // queue that takes transactions from CPU side
@@ -81,12 +98,17 @@ class Controller {
     RowBufPolicy row_buf_policy_;
 
 #ifdef CMD_TRACE
-    std::ofstream cmd_trace_;
+    std::unique_ptr<TraceWriter> cmd_trace_;
 #endif  // CMD_TRACE
 
     // used to calculate inter-arrival latency
     uint64_t last_trans_clk_;
 
+    // bank mode residency since last UpdatePimStats
+    uint64_t sb_mode_cycles_;
+    uint64_t abg_mode_cycles_;
+    uint64_t bg_mode_cycles_;
+
     // transaction queueing
     int write_draining_;
     void ScheduleTransaction();
@@ -26,7 +26,10 @@ BaseDRAMSystem::BaseDRAMSystem(Config &config, const std::string &output_dir,
 
 #ifdef ADDR_TRACE
     std::string addr_trace_name = config_.output_prefix + "addr.trace";
-    address_trace_.open(addr_trace_name);
+    if (config_.trace_binary) addr_trace_name += ".bin";
+    address_trace_.reset(new TraceWriter(addr_trace_name, TraceKind::ADDRESS,
+                                         -1, config_.trace_binary,
+                                         config_.trace_compress));
 #endif
 }
 
@@ -45,15 +48,14 @@ int BaseDRAMSystem::GetChannel(uint64_t hex_addr) const {
 }
 
 void BaseDRAMSystem::PrintEpochStats() {
-    // first epoch, print bracket
-    if (clk_ - config_.epoch_period == 0) {
-        std::ofstream epoch_out(config_.json_epoch_name, std::ofstream::out);
-        epoch_out << "[";
+    // first epoch, open the sink that stays open until PrintStats
+    if (!epoch_sink_ && config_.output_level >= 1) {
+        epoch_sink_.reset(new StatsSink(config_.json_epoch_name,
+                                        GetStatsFormat(config_.stats_format),
+                                        false));
     }
     for (size_t i = 0; i < ctrls_.size(); i++) {
-        ctrls_[i]->PrintEpochStats();
-        std::ofstream epoch_out(config_.json_epoch_name, std::ofstream::app);
-        epoch_out << "," << std::endl;
+        ctrls_[i]->PrintEpochStats(epoch_sink_.get());
     }
 #ifdef THERMAL
     thermal_calc_.PrintTransPT(clk_);
@@ -62,28 +64,25 @@ void BaseDRAMSystem::PrintEpochStats() {
 }
 
 void BaseDRAMSystem::PrintStats() {
-    // Finish epoch output, remove last comma and append ]
-    std::ofstream epoch_out(config_.json_epoch_name, std::ios_base::in |
-                                                         std::ios_base::out |
-                                                         std::ios_base::ate);
-    epoch_out.seekp(-2, std::ios_base::cur);
-    epoch_out.write("]", 1);
-    epoch_out.close();
-
-    std::ofstream json_out(config_.json_stats_name, std::ofstream::out);
-    json_out << "{";
-
-    // close it now so that each channel can handle it
-    json_out.close();
+    // Finish epoch output
+    if (epoch_sink_) {
+        epoch_sink_->Close();
+    }
+
+    std::unique_ptr<StatsSink> json_sink;
+    if (config_.output_level >= 0) {
+        json_sink.reset(new StatsSink(config_.json_stats_name,
+                                      GetStatsFormat(config_.stats_format),
+                                      true));
+    }
+    std::ofstream txt_out;
+    if (config_.output_level >= 1) {
+        txt_out.open(config_.txt_stats_name, std::ofstream::out);
+    }
     for (size_t i = 0; i < ctrls_.size(); i++) {
-        ctrls_[i]->PrintFinalStats();
-        if (i != ctrls_.size() - 1) {
-            std::ofstream chan_out(config_.json_stats_name, std::ofstream::app);
-            chan_out << "," << std::endl;
-        }
+        ctrls_[i]->PrintFinalStats(json_sink.get(),
+                                   txt_out.is_open() ? &txt_out : nullptr);
     }
-    json_out.open(config_.json_stats_name, std::ofstream::app);
-    json_out << "}";
 
 #ifdef THERMAL
     thermal_calc_.PrintFinalPT(clk_);
@@ -96,6 +95,14 @@ void BaseDRAMSystem::ResetStats() {
     }
 }
 
+double BaseDRAMSystem::GetTotalEnergy() {
+    double energy = 0.0;
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        energy += ctrls_[i]->GetTotalEnergy();
+    }
+    return energy;
+}
+
 //void BaseDRAMSystem::RegisterCallbacks(
 //    std::function<void(uint64_t)> read_callback,
 //    std::function<void(uint64_t)> write_callback) {
@@ -112,12 +119,32 @@ bool BaseDRAMSystem::IsPendingTransaction() {
     return false;
 }
 
+bool BaseDRAMSystem::IsPendingTransaction(int channel) {
+    return ctrls_[channel]->IsPendingTransaction();
+}
+
+bool BaseDRAMSystem::IsQueuedTransaction(int channel) const {
+    return ctrls_[channel]->IsQueuedTransaction();
+}
+
+uint64_t BaseDRAMSystem::PimCommandCount(int channel) const {
+    return ctrls_[channel]->PimCommandCount();
+}
+
+bool BaseDRAMSystem::IsSingleBankMode(int channel) const {
+    return ctrls_[channel]->mode_ == 0 && pim_func_sim_->bankmode_id[channel] == 0;
+}
+
 void BaseDRAMSystem::SetWriteBufferThreshold(int threshold) {
     for (size_t i = 0; i < ctrls_.size(); i++) {
         ctrls_[i]->write_buffer_threshold_ = (threshold < 0) ? 8 : threshold;
     }
 }
 
+void BaseDRAMSystem::SetWriteBufferThreshold(int channel, int threshold) {
+    ctrls_[channel]->write_buffer_threshold_ = (threshold < 0) ? 8 : threshold;
+}
+
 // change every controlleres BG mode
 void BaseDRAMSystem::SetMode(int mode) {
     for (size_t i = 0; i < ctrls_.size(); i++) {
@@ -126,6 +153,10 @@ void BaseDRAMSystem::SetMode(int mode) {
     mode_ = mode;
 }
 
+void BaseDRAMSystem::SetMode(int channel, int mode) {
+    ctrls_[channel]->SetMode(mode);
+}
+
 JedecDRAMSystem::JedecDRAMSystem(Config &config, const std::string &output_dir,
                                  std::function<void(uint64_t, uint8_t*)> read_callback,
                                  std::function<void(uint64_t)> write_callback)
@@ -138,7 +169,8 @@ JedecDRAMSystem::JedecDRAMSystem(Config &config, const std::string &output_dir,
     ctrls_.reserve(config_.channels);
     for (auto i = 0; i < config_.channels; i++) {
 #ifdef THERMAL
-        ctrls_.push_back(new Controller(i, config_, timing_, thermal_calc_));
+        ctrls_.push_back(new Controller(i, config_, timing_, thermal_calc_,
+                                        pim_func_sim_));
 #else
         ctrls_.push_back(new Controller(i, config_, timing_, pim_func_sim_)); // controller can also use pim_func_sim_
 #endif  // THERMAL
@@ -168,8 +200,7 @@ bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
 
     // Record trace - Record address trace for debugging or other purposes
 #ifdef ADDR_TRACE
-    address_trace_ << std::hex << hex_addr << std::dec << " "
-        << (is_write ? "WRITE " : "READ ") << clk_ << std::endl;
+    address_trace_->AddTransaction(clk_, hex_addr, is_write);
 #endif
 
 
@@ -179,6 +210,9 @@ bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
     assert(ok);
     if (ok) {
         Transaction trans = Transaction(hex_addr, is_write, DataPtr);
+        // bank mode the channel is in when the transaction arrives,
+        // used to count commands that are broadcast to every bank
+        trans.executed_bankmode = pim_func_sim_->bankmode[channel];
         Address addr = config_.AddressMapping(hex_addr);
         // Send transaction to PIM Functional Simulator
         //  Performs physical memory RD/WR, bank mode change, set PIM register,
@@ -189,7 +223,11 @@ bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
         
         // Because the Data_Ptr is in transaction, SB operation can't be operated in controller
         // therefore, SB is done in dram_system, and BG is done in controller
-        if (mode_ != 1) { pim_func_sim_->DRAM_IO(&trans); } // when single bank
+        // the mode of the channel, other channels may run another kernel
+        int mode = ctrls_[channel]->mode_;
+        if (mode != 1) { pim_func_sim_->DRAM_IO(&trans); } // when single bank
+        // SRF writes in BG mode fill the SRF buffer the kernel is not using
+        else if (is_write && addr.row == SRF_ROW) { pim_func_sim_->DRAM_IO(&trans); }
         
 
 #if 0
@@ -238,6 +276,10 @@ void BaseDRAMSystem::SetBaseRow(BaseRow baserow) {
     pim_func_sim_->SetBaseRow(baserow);
 } // NEED TO BE ADDED !!!!!!!!!!!! CAPSTONE
 
+void BaseDRAMSystem::SetBaseRow(int channel, BaseRow baserow) {
+    pim_func_sim_->SetBaseRow(channel, baserow);
+}
+
 void BaseDRAMSystem::PushCRF(PimInstruction* kernel) {
     pim_func_sim_->PushCRF(kernel);
 }
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,11 +13,17 @@
 #include "./timing.h"
 #include "./pim_func_sim.h"
 #include "./pim_config.h"
+#include "./stats_sink.h"
 
 #ifdef THERMAL
 #include "./thermal.h"
 #endif  // THERMAL
 
+#ifdef ADDR_TRACE
+#include <memory>
+#include "./trace_writer.h"
+#endif  // ADDR_TRACE
+
 namespace dramsim3 {
 
 class BaseDRAMSystem {
@@ -30,6 +37,8 @@ class BaseDRAMSystem {
     void PrintEpochStats();
     void PrintStats();
     void ResetStats();
+    // energy (pJ) of every channel so far
+    double GetTotalEnergy();
 
     virtual bool WillAcceptTransaction(uint64_t hex_addr,
                                        bool is_write) const = 0;
@@ -40,9 +49,16 @@ class BaseDRAMSystem {
 
     // For barrier
     bool IsPendingTransaction();
+    bool IsPendingTransaction(int channel);
+    bool IsQueuedTransaction(int channel) const;
+    uint64_t PimCommandCount(int channel) const;
+    bool IsSingleBankMode(int channel) const;
     void SetWriteBufferThreshold(int threshold);
+    void SetWriteBufferThreshold(int channel, int threshold);
 
     void SetMode(int mode); // CAPSTONE
+    // mode of one channel, kernels on disjoint channels switch separately
+    void SetMode(int channel, int mode);
     int mode_;
 
     std::function<void(uint64_t req_id, uint8_t* DataPtr)> read_callback_;
@@ -57,6 +73,7 @@ class BaseDRAMSystem {
               unsigned int burstSize);
     
     void SetBaseRow(BaseRow baserow);
+    void SetBaseRow(int channel, BaseRow baserow);
     void PushCRF(PimInstruction* kernel);
 
  protected:
@@ -74,8 +91,11 @@ class BaseDRAMSystem {
     uint64_t clk_;
     std::vector<Controller*> ctrls_;
 
+    // opened once and kept for the whole run
+    std::unique_ptr<StatsSink> epoch_sink_;
+
 #ifdef ADDR_TRACE
-    std::ofstream address_trace_;
+    std::unique_ptr<TraceWriter> address_trace_;
 #endif  // ADDR_TRACE
 };
 
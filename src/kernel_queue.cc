@@ -0,0 +1,69 @@
+#include "kernel_queue.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "transaction_generator.h"
+
+namespace dramsim3 {
+
+int KernelQueue::Push(TransactionGenerator* kernel, int first, int count,
+                      const std::vector<int>& deps) {
+    int id = (int)descs_.size();
+    for (int dep : deps) {
+        if (dep < 0 || dep >= id) {
+            std::cerr << "KernelQueue: kernel " << id
+                      << " depends on unknown kernel " << dep << std::endl;
+            exit(1);
+        }
+    }
+    if (first < 0 || count <= 0 || first + count > NUM_CHANNEL) {
+        std::cerr << "KernelQueue: kernel " << id << " on channels " << first
+                  << " ~ " << first + count - 1 << " out of range" << std::endl;
+        exit(1);
+    }
+    descs_.push_back({kernel, first, count, deps, false, false, 0, 0});
+    return id;
+}
+
+uint64_t KernelQueue::Run() {
+    uint64_t start_clk = GetClk();
+    LaunchReady();
+    PimScheduler::Run();
+    for (size_t id = 0; id < descs_.size(); id++) {
+        if (!descs_[id].done) {
+            std::cerr << "KernelQueue: kernel " << id << " never got ready"
+                      << std::endl;
+            exit(1);
+        }
+    }
+    return GetClk() - start_clk;
+}
+
+void KernelQueue::KernelDone(TransactionGenerator* kernel) {
+    for (auto& desc : descs_) {
+        if (desc.kernel == kernel && desc.launched && !desc.done) {
+            desc.done = true;
+            desc.end_clk = GetClk();
+        }
+    }
+    LaunchReady();
+}
+
+// Launch every kernel whose dependencies are done and whose channels are
+// free, a kernel that is not ready does not hold back later ones
+void KernelQueue::LaunchReady() {
+    for (auto& desc : descs_) {
+        if (desc.launched) continue;
+        bool ready = true;
+        for (int dep : desc.deps) ready &= descs_[dep].done;
+        for (int ch = desc.first; ch < desc.first + desc.count; ch++)
+            ready &= IsChannelFree(ch);
+        if (!ready) continue;
+        desc.launched = true;
+        desc.start_clk = GetClk();
+        Launch(desc.kernel, desc.first, desc.count);
+    }
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,58 @@
+#ifndef __KERNEL_QUEUE_H
+#define __KERNEL_QUEUE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./pim_scheduler.h"
+
+namespace dramsim3 {
+
+class TransactionGenerator;
+
+// Host side stream of PIM kernels for a graph of small ops. A kernel is
+// launched in the cycle the kernels it depends on are done and its channels
+// are free, with no barrier between kernels otherwise: an independent
+// kernel runs its mode changes, CRF writes and operand writes while earlier
+// kernels still compute on other channels, and a kernel on the channels of
+// a finished one starts without waiting for the rest of the memory.
+//  A dependency is a kernel whose output (a host array, or a buffer of
+//  GetAllocator() bound to both) this kernel reads, kernels are launched in
+//  queue order once they are ready.
+class KernelQueue : public PimScheduler {
+   public:
+    KernelQueue(const std::string& config_file, const std::string& output_dir)
+        : PimScheduler(config_file, output_dir) {}
+
+    // Queue kernel on channels first ~ first+count-1, it waits for the
+    // kernels with id in deps. Returns the id of the kernel
+    int Push(TransactionGenerator* kernel, int first, int count,
+             const std::vector<int>& deps = std::vector<int>());
+    // Run every queued kernel, returns the cycles it took
+    uint64_t Run();
+
+    // cycles the kernel started and ended at, on the clock of the memory
+    uint64_t GetStartClk(int id) const { return descs_[id].start_clk; }
+    uint64_t GetEndClk(int id) const { return descs_[id].end_clk; }
+
+   protected:
+    void KernelDone(TransactionGenerator* kernel) override;
+
+   private:
+    struct KernelDesc {
+        TransactionGenerator* kernel;
+        int first, count;
+        std::vector<int> deps;
+        bool launched, done;
+        uint64_t start_clk, end_clk;
+    };
+
+    void LaunchReady();
+
+    std::vector<KernelDesc> descs_;
+};
+
+}  // namespace dramsim3
+
+#endif  // __KERNEL_QUEUE_H
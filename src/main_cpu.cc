@@ -4,6 +4,56 @@
 
 using namespace dramsim3;
 
+// Run of a PIM generator against its host baseline (the operands are in
+// memory for both), prints the cycles, energy, speedup and energy ratio.
+// Counts from the end of the operand writes through the kernel launch,
+// Execute and the mode exit; with readback also the reading of the result,
+// which a reduction needs before the host can use it
+static void CompareToHost(const std::string& name, TransactionGenerator* pim,
+                          TransactionGenerator* host, bool readback = false) {
+    TransactionGenerator* generators[2] = {pim, host};
+    uint64_t clk[2];
+    double energy[2];
+    for (int k = 0; k < 2; k++) {
+        TransactionGenerator* g = generators[k];
+        g->Initialize();
+        g->launch_ = g->Mark();
+        g->SetData();
+        g->Execute();
+        g->readback_ = g->Mark();
+        g->GetResult();
+        TransactionGenerator::RunMark end = readback ? g->Mark() : g->readback_;
+        clk[k] = end.clk - g->launch_.clk;
+        energy[k] = end.energy - g->launch_.energy;
+    }
+    std::cout << C_GREEN << name << ": PIM " << clk[0] << " cycles " << energy[0] / 1e6
+              << " uJ, host " << clk[1] << " cycles " << energy[1] / 1e6 << " uJ, speedup "
+              << (double)clk[1] / clk[0] << "x, energy ratio " << energy[1] / energy[0]
+              << "x" << C_NORMAL << std::endl;
+    pim->CheckResult();
+    delete pim;
+    delete host;
+}
+
+static uint8_t* RandomVector(uint64_t n, int range) {
+    uint8_t* v = (uint8_t*)malloc(sizeof(uint16_t) * n);
+    for (uint64_t i = 0; i < n; i++) {
+        ((int16_t*)v)[i] = (int16_t)(rand() % range - range / 2);
+    }
+    return v;
+}
+
+// GEMV of b input vectors on PIM, a small batch GEMM for more than one
+static TransactionGenerator* PimGemv(const std::string& config_file,
+                                     const std::string& output_dir,
+                                     uint64_t b, uint64_t m, uint64_t n) {
+    if (b == 1)
+        return new GemvTransactionGenerator(config_file, output_dir,
+            m, n, RandomVector(m * n, 8), RandomVector(n, 64), RandomVector(m, 2));
+    return new GemmSmallBatchTransactionGenerator(config_file, output_dir,
+        m, n, b, RandomVector(m * n, 8), RandomVector(b * n, 64), RandomVector(b * m, 2));
+}
+
 // main code to simulate PIM simulator
 int main(int argc, const char **argv) {
     srand(time(NULL));
@@ -24,19 +74,19 @@ int main(int argc, const char **argv) {
     args::Positional<std::string> config_arg(
         parser, "config", "The config file name (mandatory)");
     args::ValueFlag<std::string> pim_api_arg(
-        parser, "pim_api", "PIM API - add, gemv",
+        parser, "pim_api", "PIM API - add, mul, fused, gelu, reduce, gemv, gemm, bn, norm, lstm",
         {"pim-api"}, "add");
     args::ValueFlag<uint64_t> batch_arg(
-        parser, "batch", "Batch size",
+        parser, "batch", "Batch size, [GEMM] number of input vectors",
         {"batch"}, 1);
     args::ValueFlag<uint64_t> add_n_arg(
-        parser, "add_n", "[ADD] Number of elements in vector x, y and z",
+        parser, "add_n", "[ADD/MUL/FUSED/GELU/REDUCE] Number of elements of a vector",
         {"add-n"}, 1024*1024);
     args::ValueFlag<uint64_t> gemv_m_arg(
-        parser, "gemv_m", "[GEMV] Number of rows of the matrix A",
+        parser, "gemv_m", "[GEMV/GEMM] Number of rows of the matrix A",
         {"gemv-m"}, 4096);
     args::ValueFlag<uint64_t> gemv_n_arg(
-        parser, "gemv_n", "[GEMV] Number of columns of the matrix A",
+        parser, "gemv_n", "[GEMV/GEMM] Number of columns of the matrix A",
         {"gemv-n"}, 4096);     
     args::ValueFlag<uint64_t> bn_l_arg(
         parser, "bn_l", "[BatchNorm] Sequence length of the matrix A",
@@ -44,6 +94,12 @@ int main(int argc, const char **argv) {
     args::ValueFlag<uint64_t> bn_f_arg(
         parser, "bn_f", "[BatchNorm] Number of features of the matrix A",
         {"bn-f"}, 512);
+    args::ValueFlag<uint64_t> norm_l_arg(
+        parser, "norm_l", "[Norm] Number of tokens",
+        {"norm-l"}, 64);
+    args::ValueFlag<uint64_t> norm_f_arg(
+        parser, "norm_f", "[Norm] Number of features of a token",
+        {"norm-f"}, 1024);
     args::ValueFlag<uint64_t> lstm_if_arg(
         parser, "lstm-if", "[LSTM] Number of input features",
         {"lstm-if"}, 1024);
@@ -53,6 +109,9 @@ int main(int argc, const char **argv) {
     args::ValueFlag<double> miss_ratio_arg(
         parser, "miss_ratio", "Miss ratio",
         {"miss-ratio"}, 1);
+    args::Flag compare_arg(
+        parser, "compare", "Run the op on PIM too and compare it to the host",
+        {"compare"});
 
     try {
         parser.ParseCLI(argc, argv);
@@ -75,6 +134,7 @@ int main(int argc, const char **argv) {
     std::string output_dir = args::get(output_dir_arg);
     std::string pim_api = args::get(pim_api_arg);
     uint64_t b = args::get(batch_arg);
+    double miss_ratio = args::get(miss_ratio_arg);
 
     // Initialize modules of PIM-Simulator
     //  Transaction Generator + DRAMsim3 + PIM Functional Simulator
@@ -82,36 +142,113 @@ int main(int argc, const char **argv) {
     TransactionGenerator * tx_generator;
 
     // Define operands and Transaction generator for simulating computation
-    if (pim_api == "add") {
+    // (elementwise ops and reductions reuse no operand, so no miss ratio)
+    if (pim_api == "add" || pim_api == "mul" || pim_api == "fused" || pim_api == "gelu") {
         uint64_t n = args::get(add_n_arg);
 
-        // Define Transaction generator for ADD computation
-        tx_generator = new CPUAddTransactionGenerator(config_file, output_dir,
-                                                      b, n);
-    } else if (pim_api == "gemv") {
+        // Define Transaction generator for elementwise computation
+        tx_generator = new CPUElementwiseTransactionGenerator(config_file, output_dir,
+                                                              b, n);
+    } else if (pim_api == "reduce") {
+        uint64_t n = args::get(add_n_arg);
+
+        // Define Transaction generator for sum of every vector
+        tx_generator = new CPUReduceTransactionGenerator(config_file, output_dir,
+                                                         b, n);
+    } else if (pim_api == "gemv" || pim_api == "gemm") {
         uint64_t m = args::get(gemv_m_arg);
         uint64_t n = args::get(gemv_n_arg);
-        double miss_ratio = args::get(miss_ratio_arg);
 
-        // Define Transaction generator for GEMV computation
-        tx_generator = new CPUGemvTransactionGenerator(config_file, output_dir,
-                                                       b, m, n, miss_ratio);
+        // Define Transaction generator for GEMV computation, gemm runs the
+        // batch on PIM (small batch GEMM) unless it is compared to the host
+        if (pim_api == "gemm" && !args::get(compare_arg))
+            tx_generator = PimGemv(config_file, output_dir, b, m, n);
+        else
+            tx_generator = new CPUGemvTransactionGenerator(config_file, output_dir,
+                                                           b, m, n, miss_ratio);
     } else if (pim_api == "bn") {
         uint64_t l = args::get(bn_l_arg);
         uint64_t f = args::get(bn_f_arg);
-        double miss_ratio = args::get(miss_ratio_arg);
 
-        // Define Transaction generator for GEMV computation
+        // Define Transaction generator for BatchNorm computation
         tx_generator = new CPUBatchNormTransactionGenerator(config_file, output_dir,
                                                             b, l, f, miss_ratio);
+    } else if (pim_api == "norm") {
+        uint64_t l = args::get(norm_l_arg);
+        uint64_t f = args::get(norm_f_arg);
+
+        // Define Transaction generator for LayerNorm computation
+        tx_generator = new CPUNormTransactionGenerator(config_file, output_dir,
+                                                       b, l, f, miss_ratio);
     } else if (pim_api == "lstm") {
         uint64_t i_f = args::get(lstm_if_arg);
         uint64_t o_f = args::get(lstm_of_arg);
-        double miss_ratio = args::get(miss_ratio_arg);
 
-        // Define Transaction generator for GEMV computation
+        // Define Transaction generator for LSTM computation
         tx_generator = new CPULstmTransactionGenerator(config_file, output_dir,
                                                        b, i_f, o_f, miss_ratio);
+    } else {
+        std::cerr << "unknown pim-api " << pim_api << std::endl;
+        return 1;
+    }
+
+    // the same op of the same batch on PIM, the PIM generators take the
+    // batch as one long operand
+    if (args::get(compare_arg)) {
+        TransactionGenerator* pim;
+        if (pim_api == "add" || pim_api == "mul" || pim_api == "fused" || pim_api == "gelu") {
+            uint64_t n = b * args::get(add_n_arg);
+            if (pim_api == "add")
+                pim = new AddTransactionGenerator(config_file, output_dir,
+                    n, RandomVector(n, 1024), RandomVector(n, 1024), RandomVector(n, 2));
+            else if (pim_api == "mul")
+                pim = new MulTransactionGenerator(config_file, output_dir,
+                    n, RandomVector(n, 1024), RandomVector(n, 1024), RandomVector(n, 2));
+            else if (pim_api == "fused")
+                pim = new FusedTransactionGenerator(config_file, output_dir,
+                    "z = a*x + y", n, {{"x", RandomVector(n, 1024)},
+                    {"y", RandomVector(n, 1024)}, {"z", RandomVector(n, 2)}}, {{"a", 3}});
+            else
+                pim = new FusedTransactionGenerator(config_file, output_dir,
+                    "h = gelu(x + b)", n, {{"x", RandomVector(n, 1024)},
+                    {"b", RandomVector(n, 256)}, {"h", RandomVector(n, 2)}});
+        } else if (pim_api == "reduce") {
+            uint64_t n = b * args::get(add_n_arg);
+            pim = new ReduceTransactionGenerator(config_file, output_dir,
+                PimReduce::SUM, n, RandomVector(n, 1024));
+        } else if (pim_api == "gemv" || pim_api == "gemm") {
+            pim = PimGemv(config_file, output_dir, b, args::get(gemv_m_arg), args::get(gemv_n_arg));
+        } else if (pim_api == "bn") {
+            uint64_t l = args::get(bn_l_arg);
+            uint64_t f = args::get(bn_f_arg);
+            uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * 4096 * 2);
+            uint8_t* z = (uint8_t*)malloc(sizeof(uint16_t) * 4096 * 2);
+            for (int i = 0; i < 4096 * 2; i++) {
+                ((uint16_t*)y)[i] = (uint16_t)(-(i % f));
+                ((uint16_t*)z)[i] = (uint16_t)1;
+            }
+            pim = new BatchNormTransactionGenerator(config_file, output_dir,
+                b * l, f, RandomVector(b * l * f, 1024), y, z, RandomVector(b * l * f, 2));
+        } else if (pim_api == "norm") {
+            uint64_t l = args::get(norm_l_arg);
+            uint64_t f = args::get(norm_f_arg);
+            pim = new NormTransactionGenerator(config_file, output_dir,
+                PimNorm::LAYER, b * l, f, RandomVector(b * l * f, 1024), RandomVector(b * l * f, 2),
+                RandomVector(f, 256), RandomVector(f, 64));
+        } else {
+            // the PIM side is one step of one input
+            if (b != 1) {
+                std::cerr << "lstm: --compare runs one step, --batch must be 1" << std::endl;
+                return 1;
+            }
+            uint64_t i_f = args::get(lstm_if_arg);
+            uint64_t o_f = args::get(lstm_of_arg);
+            pim = new LstmTransactionGenerator(config_file, output_dir,
+                i_f, o_f, RandomVector(i_f, 64), RandomVector(4 * o_f, 2), RandomVector(o_f, 64),
+                RandomVector(4 * o_f, 64), RandomVector(4 * o_f * i_f, 8), RandomVector(4 * o_f * o_f, 8));
+        }
+        CompareToHost(pim_api, pim, tx_generator, pim_api == "reduce");
+        return 0;
     }
     std::cout << C_GREEN << "Success Module Initialize" << C_NORMAL << "\n\n";
 
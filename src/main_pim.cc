@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <random>
 #include "./transaction_generator.h"
+#include "./pim_scheduler.h"
+#include "./kernel_queue.h"
 
 using namespace dramsim3;
 
@@ -13,15 +17,389 @@ int main(int argc, const char** argv) {
     // have to initiallize config file and output dir
     std::string config_file = "../configs/HBM2_4Gb_test.ini";
     std::string output_dir = "output.txt";
+    // [GEMV] number of GEMV steps on the resident matrix A, a new x each step
+    uint64_t gemv_steps = 1;
 
 
     // Initialize modules of PIM-Simulator
     //  Transaction Generator + DRAMsim3 + PIM Functional Simulator
     std::cout << C_GREEN << "Initializing modules..." << C_NORMAL << std::endl;
     TransactionGenerator* tx_generator;
+    GemvTransactionGenerator* gemv_generator = NULL;
 
     // Define operands and Transaction generator for simulating computation
 
+    // ADD on channels 0-7 and GEMV on channels 8-15 at the same time
+    if (pim_api == "add+gemv") {
+        uint64_t n_add = 4096*32;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n_add);
+        uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * n_add);
+        uint8_t* z = (uint8_t*)malloc(sizeof(uint16_t) * n_add);
+        for (int i = 0; i < n_add; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i);
+            ((uint16_t*)y)[i] = (uint16_t)1;
+        }
+
+        uint64_t m = 4096;
+        uint64_t n = 1024;
+        uint8_t *A = (uint8_t *) malloc(sizeof(uint16_t) * m * n);
+        uint8_t *gx = (uint8_t *) malloc(sizeof(uint16_t) * n);
+        uint8_t *gy = (uint8_t *) malloc(sizeof(uint16_t) * m);
+        for (int i=0; i<n; i++) {
+            ((uint16_t*)gx)[i] = (uint16_t)(i+1);
+            for (int j=0; j< m; j++) {
+                ((uint16_t*)A)[j*n+i] = (uint16_t)(1);
+            }
+        }
+
+        PimScheduler scheduler(config_file, output_dir);
+        TransactionGenerator* add = new AddTransactionGenerator(config_file, output_dir,
+            n_add, x, y, z, &scheduler);
+        TransactionGenerator* gemv = new GemvTransactionGenerator(config_file, output_dir,
+            m, n, A, gx, gy, &scheduler);
+        scheduler.Launch(add, 0, NUM_CHANNEL / 2);
+        scheduler.Launch(gemv, NUM_CHANNEL / 2, NUM_CHANNEL / 2);
+
+        std::cout << C_GREEN << "Running ADD and GEMV..." << C_NORMAL << "\n";
+        uint64_t clk = scheduler.Run();
+        std::cout << C_GREEN << "Success ADD (" << add->GetClk() << " cycles), GEMV ("
+                  << gemv->GetClk() << " cycles), both (" << clk << " cycles)"
+                  << C_NORMAL << "\n\n";
+        add->CheckResult();
+        gemv->CheckResult();
+        scheduler.PrintStats();
+
+        delete add;
+        delete gemv;
+        return 0;
+    }
+
+    // host STREAM traffic on channels 0-7, alone and next to GEMV on
+    // channels 8-15, to see what the PIM kernel costs the host. Then the
+    // same traffic over all channels, alone and sharing channels 8-15 with
+    // GEMV: the host waits there while the channels are in PIM mode
+    if (pim_api == "host+gemv") {
+        uint64_t n_host = 4096*32;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n_host);
+        uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * n_host);
+        uint8_t* z = (uint8_t*)malloc(sizeof(uint16_t) * n_host);
+        for (int i = 0; i < n_host; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i);
+            ((uint16_t*)y)[i] = (uint16_t)3;
+        }
+
+        uint64_t m = 4096;
+        uint64_t n = 1024;
+        uint8_t *A = (uint8_t *) malloc(sizeof(uint16_t) * m * n);
+        uint8_t *gx = (uint8_t *) malloc(sizeof(uint16_t) * n);
+        uint8_t *gy = (uint8_t *) malloc(sizeof(uint16_t) * m);
+        for (int i=0; i<n; i++) {
+            ((uint16_t*)gx)[i] = (uint16_t)(i+1);
+            for (int j=0; j< m; j++) {
+                ((uint16_t*)A)[j*n+i] = (uint16_t)(1);
+            }
+        }
+
+        PimScheduler scheduler(config_file, output_dir);
+        for (int shared = 0; shared < 2; shared++) {
+            int host_channels = shared ? NUM_CHANNEL : NUM_CHANNEL / 2;
+            HostTransactionGenerator* alone = new HostTransactionGenerator(config_file,
+                output_dir, HostPattern::STREAM, n_host, x, y, z, 0, 0.5, &scheduler);
+            HostTransactionGenerator* host = new HostTransactionGenerator(config_file,
+                output_dir, HostPattern::STREAM, n_host, x, y, z, 0, 0.5, &scheduler);
+            TransactionGenerator* gemv = new GemvTransactionGenerator(config_file, output_dir,
+                m, n, A, gx, gy, &scheduler);
+
+            std::cout << C_GREEN << "Running host traffic alone on " << host_channels
+                      << " channels..." << C_NORMAL << "\n";
+            scheduler.Launch(alone, 0, host_channels);
+            scheduler.Run();
+            alone->CheckResult();
+
+            std::cout << C_GREEN << "Running host traffic and GEMV"
+                      << (shared ? " on shared channels..." : "...") << C_NORMAL << "\n";
+            scheduler.Launch(host, 0, host_channels, shared);
+            scheduler.Launch(gemv, NUM_CHANNEL / 2, NUM_CHANNEL / 2);
+            uint64_t clk = scheduler.Run();
+            std::cout << C_GREEN << "Success host (" << host->GetClk() << " cycles), GEMV ("
+                      << gemv->GetClk() << " cycles), both (" << clk << " cycles)"
+                      << C_NORMAL << "\n\n";
+            host->CheckResult();
+            gemv->CheckResult();
+            std::cout << "host slowdown " << (shared ? "sharing channels with" : "next to")
+                      << " GEMV : "
+                      << (double)host->GetExecuteClk() / alone->GetExecuteClk()
+                      << "x execute cycles, "
+                      << host->GetAvgReadLatency() / alone->GetAvgReadLatency()
+                      << "x read latency" << std::endl;
+
+            delete alone;
+            delete host;
+            delete gemv;
+        }
+        scheduler.PrintStats();
+        return 0;
+    }
+
+    // small graph through a KernelQueue: w = (x + y) * y on channels 0-3,
+    // v = x * y on channels 4-7 and GEMV on channels 8-15. Once with the
+    // data dependency only, once with every kernel after the one before.
+    // x + y stays in PIM: ADD stores it to a buffer of the queue that MUL
+    // reads as its y operand (CONV1 for both)
+    if (pim_api == "queue") {
+        uint64_t n_vec = 4096*8;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n_vec);
+        uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * n_vec);
+        uint8_t* z = (uint8_t*)malloc(sizeof(uint16_t) * n_vec);
+        uint8_t* w = (uint8_t*)malloc(sizeof(uint16_t) * n_vec);
+        uint8_t* v = (uint8_t*)malloc(sizeof(uint16_t) * n_vec);
+        for (int i = 0; i < n_vec; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i);
+            ((uint16_t*)y)[i] = (uint16_t)3;
+            // expected x + y, only for the check of w
+            ((uint16_t*)z)[i] = (uint16_t)(i + 3);
+        }
+
+        uint64_t m = 4096;
+        uint64_t n = 256;
+        uint8_t *A = (uint8_t *) malloc(sizeof(uint16_t) * m * n);
+        uint8_t *gx = (uint8_t *) malloc(sizeof(uint16_t) * n);
+        uint8_t *gy = (uint8_t *) malloc(sizeof(uint16_t) * m);
+        for (int i=0; i<n; i++) {
+            ((uint16_t*)gx)[i] = (uint16_t)(i+1);
+            for (int j=0; j< m; j++) {
+                ((uint16_t*)A)[j*n+i] = (uint16_t)(1);
+            }
+        }
+
+        uint64_t clk[2];
+        for (int serial = 0; serial < 2; serial++) {
+            KernelQueue queue(config_file, output_dir);
+            PimBuffer sum = queue.GetAllocator().Alloc(n_vec * UNIT_SIZE,
+                                                       PimInterleave::CONV1, 0, 4);
+            TransactionGenerator* add = new AddTransactionGenerator(config_file, output_dir,
+                n_vec, x, y, NULL, &queue);
+            add->Bind("z", sum);
+            TransactionGenerator* mul_z = new MulTransactionGenerator(config_file, output_dir,
+                n_vec, y, z, w, &queue);
+            mul_z->Bind("y", sum);
+            TransactionGenerator* mul_x = new MulTransactionGenerator(config_file, output_dir,
+                n_vec, x, y, v, &queue);
+            TransactionGenerator* gemv = new GemvTransactionGenerator(config_file, output_dir,
+                m, n, A, gx, gy, &queue);
+            int id = queue.Push(add, 0, 4);
+            id = queue.Push(mul_z, 0, 4, {id});
+            id = queue.Push(mul_x, 4, 4, serial ? std::vector<int>{id} : std::vector<int>());
+            queue.Push(gemv, 8, 8, serial ? std::vector<int>{id} : std::vector<int>());
+
+            std::cout << C_GREEN << "Running the queue " << (serial ? "in order" : "by dependency")
+                      << "..." << C_NORMAL << "\n";
+            clk[serial] = queue.Run();
+            for (int i = 0; i < 4; i++) {
+                std::cout << "kernel " << i << " : " << queue.GetStartClk(i) << " ~ "
+                          << queue.GetEndClk(i) << " cycles" << std::endl;
+            }
+            std::cout << C_GREEN << "Success queue (" << clk[serial] << " cycles)"
+                      << C_NORMAL << "\n";
+            mul_z->CheckResult();
+            mul_x->CheckResult();
+            gemv->CheckResult();
+
+            delete add;
+            delete mul_z;
+            delete mul_x;
+            delete gemv;
+            queue.GetAllocator().Free(sum);
+        }
+        std::cout << "dependency only : " << clk[0] << " cycles, in order : " << clk[1]
+                  << " cycles" << std::endl;
+        return 0;
+    }
+
+    // AXPY z = a*x + y as one fused μkernel and as MUL then ADD, and
+    // w = x*gamma + beta
+    if (pim_api == "fused") {
+        uint64_t n = 4096*32;
+        unit_t a = 3;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* z = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* ax = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* av = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* gamma = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* beta = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* w = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        for (int i = 0; i < n; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i);
+            ((uint16_t*)y)[i] = (uint16_t)(i % 7);
+            ((uint16_t*)av)[i] = a;
+            ((uint16_t*)gamma)[i] = (uint16_t)(i % 5);
+            ((uint16_t*)beta)[i] = (uint16_t)1;
+        }
+
+        TransactionGenerator* axpy = new FusedTransactionGenerator(config_file, output_dir,
+            "z = a*x + y", n, {{"x", x}, {"y", y}, {"z", z}}, {{"a", a}});
+        TransactionGenerator* mul = new MulTransactionGenerator(config_file, output_dir,
+            n, x, av, ax);
+        TransactionGenerator* add = new AddTransactionGenerator(config_file, output_dir,
+            n, ax, y, z);
+        TransactionGenerator* affine = new FusedTransactionGenerator(config_file, output_dir,
+            "w = x*gamma + beta", n, {{"x", x}, {"gamma", gamma}, {"beta", beta}, {"w", w}});
+
+        TransactionGenerator* kernels[4] = {axpy, mul, add, affine};
+        const char* names[4] = {"fused a*x + y", "MUL a*x", "ADD + y", "fused x*gamma + beta"};
+        for (int k = 0; k < 4; k++) {
+            kernels[k]->Initialize();
+            kernels[k]->SetData();
+            uint64_t clk = kernels[k]->GetClk();
+            kernels[k]->Execute();
+            clk = kernels[k]->GetClk() - clk;
+            kernels[k]->GetResult();
+            std::cout << C_GREEN << names[k] << ": Execute (" << clk << " cycles), total ("
+                      << kernels[k]->GetClk() << " cycles)" << C_NORMAL << std::endl;
+            kernels[k]->CheckResult();
+        }
+        for (int k = 0; k < 4; k++) {
+            delete kernels[k];
+        }
+        return 0;
+    }
+
+    // bias and activation h = f(x + b) in one μkernel, x and b in Q8.8
+    if (pim_api == "act") {
+        uint64_t n = 4096*32;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* b = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        uint8_t* h = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        for (int i = 0; i < n; i++) {
+            ((int16_t*)x)[i] = (int16_t)(i % 4096 - 2048) * 5 / 4;   // -10 ~ 10
+            ((int16_t*)b)[i] = (int16_t)(i % 7 - 3) * 16;
+        }
+
+        const char* exprs[7] = {"h = relu(x + b)", "h = clamp(x + b, -256, 256)",
+            "h = gelu(x + b)", "h = silu(x + b)", "h = sigmoid(x + b)",
+            "h = tanh(x + b)", "h = exp(x + b)"};
+        int lut_errors = 0;
+        for (int k = 0; k < 7; k++) {
+            TransactionGenerator* tx_generator = new FusedTransactionGenerator(config_file,
+                output_dir, exprs[k], n, {{"x", x}, {"b", b}, {"h", h}});
+            tx_generator->Initialize();
+            tx_generator->SetData();
+            uint64_t clk = tx_generator->GetClk();
+            tx_generator->Execute();
+            clk = tx_generator->GetClk() - clk;
+            tx_generator->GetResult();
+            std::cout << C_GREEN << exprs[k] << ": Execute (" << clk << " cycles), total ("
+                      << tx_generator->GetClk() << " cycles)" << C_NORMAL << std::endl;
+            tx_generator->CheckResult();
+
+            // the LUT against the exact activation in the LUT range, within
+            // the bounds given at LUT_SEGMENTS
+            if (k >= 2) {
+                double max_err = 0;
+                double bound = k == 6 ? 0.15 : 0.01;
+                for (int i = 0; i < n; i++) {
+                    double v = (((int16_t*)x)[i] + ((int16_t*)b)[i]) / 256.0;
+                    if (v < -LUT_RANGE || v >= LUT_RANGE) continue;
+                    double y = std::min(PimActivationValue((PimActivation)(k - 2), v), 32767 / 256.0);
+                    max_err = std::max(max_err, std::abs(((int16_t*)h)[i] / 256.0 - y));
+                }
+                std::cout << "max error vs exact : " << max_err << " (bound " << bound << ")"
+                          << std::endl;
+                if (max_err >= bound) lut_errors++;
+            }
+            delete tx_generator;
+        }
+        std::cout << "LUT ERROR : " << lut_errors << std::endl;
+        return lut_errors ? 1 : 0;
+    }
+
+    // sum, max and argmax read back a word per channel instead of x
+    if (pim_api == "reduce") {
+        uint64_t n = 4096*32;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * n);
+        for (int i = 0; i < n; i++) {
+            ((int16_t*)x)[i] = (int16_t)(rand() % 60000 - 30000);
+        }
+
+        PimReduce ops[3] = {PimReduce::SUM, PimReduce::MAX, PimReduce::ARGMAX};
+        const char* names[3] = {"sum", "max", "argmax"};
+        for (int k = 0; k < 3; k++) {
+            ReduceTransactionGenerator* tx_generator = new ReduceTransactionGenerator(config_file,
+                output_dir, ops[k], n, x);
+            tx_generator->Initialize();
+            tx_generator->SetData();
+            uint64_t clk = tx_generator->GetClk();
+            tx_generator->Execute();
+            tx_generator->GetResult();
+            clk = tx_generator->GetClk() - clk;
+            std::cout << C_GREEN << names[k] << " = " << (int16_t)tx_generator->GetValue();
+            if (ops[k] == PimReduce::ARGMAX)
+                std::cout << " at " << tx_generator->GetIndex();
+            std::cout << ": Execute + GetResult (" << clk << " cycles), read back "
+                      << tx_generator->GetReadBytes() << " of " << n * sizeof(uint16_t)
+                      << " bytes" << C_NORMAL << std::endl;
+            tx_generator->CheckResult();
+            delete tx_generator;
+        }
+        return 0;
+    }
+
+    // LayerNorm and RMSNorm, the host reads lane partials instead of x for
+    // the statistics
+    if (pim_api == "norm") {
+        uint64_t l = 40, f = 1000;
+        uint8_t* x = (uint8_t*)malloc(sizeof(uint16_t) * l * f);
+        uint8_t* y = (uint8_t*)malloc(sizeof(uint16_t) * l * f);
+        uint8_t* gamma = (uint8_t*)malloc(sizeof(uint16_t) * f);
+        uint8_t* beta = (uint8_t*)malloc(sizeof(uint16_t) * f);
+        for (int i = 0; i < l * f; i++) {
+            ((int16_t*)x)[i] = (int16_t)(rand() % 1024 - 512 + (i / f) * 8);   // -2 ~ 3.2
+        }
+        for (int i = 0; i < f; i++) {
+            ((int16_t*)gamma)[i] = (int16_t)(256 + i % 64);
+            ((int16_t*)beta)[i] = (int16_t)(i % 32 - 16);
+        }
+
+        PimNorm norms[2] = {PimNorm::LAYER, PimNorm::RMS};
+        const char* names[2] = {"layernorm", "rmsnorm"};
+        for (int k = 0; k < 2; k++) {
+            NormTransactionGenerator* tx_generator = new NormTransactionGenerator(config_file,
+                output_dir, norms[k], l, f, x, y, gamma, beta);
+            tx_generator->Initialize();
+            tx_generator->SetData();
+            uint64_t clk = tx_generator->GetClk();
+            tx_generator->Execute();
+            clk = tx_generator->GetClk() - clk;
+            tx_generator->GetResult();
+            std::cout << C_GREEN << names[k] << ": Execute (" << clk << " cycles), statistics from "
+                      << tx_generator->GetStatBytes() << " of " << l * f * sizeof(uint16_t)
+                      << " bytes" << C_NORMAL << std::endl;
+            tx_generator->CheckResult();
+
+            // against the exact normalization in floating point
+            double max_err = 0;
+            for (int t = 0; t < l; t++) {
+                double mean = 0, msq = 0;
+                for (int i = 0; i < f; i++) {
+                    double v = ((int16_t*)x)[t * f + i] / 256.0;
+                    mean += v / f;
+                    msq += v * v / f;
+                }
+                double var = k == 0 ? msq - mean * mean : msq;
+                for (int i = 0; i < f; i++) {
+                    double v = ((int16_t*)x)[t * f + i] / 256.0 - (k == 0 ? mean : 0.0);
+                    double ref = v / std::sqrt(var + 1e-5) * (((int16_t*)gamma)[i] / 256.0) +
+                                 ((int16_t*)beta)[i] / 256.0;
+                    max_err = std::max(max_err, std::abs(((int16_t*)y)[t * f + i] / 256.0 - ref));
+                }
+            }
+            std::cout << "max error vs exact : " << max_err << std::endl;
+            delete tx_generator;
+        }
+        return 0;
+    }
+
     if (pim_api == "add") {
         //uint64_t n = args::get(add_n_arg);
         uint64_t n = 4096*32;   // have to make code to get n as an input
@@ -84,8 +462,49 @@ int main(int argc, const char** argv) {
         }
 
         // Define Transaction generator for GEMV computation
-        tx_generator = new GemvTransactionGenerator(config_file, output_dir,
-                                                    m, n, A, x, y);
+        gemv_generator = new GemvTransactionGenerator(config_file, output_dir,
+                                                      m, n, A, x, y);
+        tx_generator = gemv_generator;
+    }
+
+    else if (pim_api == "lstm" || pim_api == "lstmpre") {
+        uint64_t i_f = 1024;
+        uint64_t o_f = 1024;
+
+        // Define input x, state h, bias b, weights Wx, Wh
+        // (lstmpre: x is the projected input, 4 * o_f values)
+        uint64_t x_size = pim_api == "lstm" ? i_f : 4 * o_f;
+        uint8_t *x = (uint8_t *) malloc(sizeof(uint16_t) * x_size);
+        uint8_t *h = (uint8_t *) malloc(sizeof(uint16_t) * o_f);
+        uint8_t *b = (uint8_t *) malloc(sizeof(uint16_t) * 4 * o_f);
+        uint8_t *Wx = (uint8_t *) malloc(sizeof(uint16_t) * 4 * o_f * i_f);
+        uint8_t *Wh = (uint8_t *) malloc(sizeof(uint16_t) * 4 * o_f * o_f);
+        // Define output gates y
+        uint8_t *y = (uint8_t *) malloc(sizeof(uint16_t) * 4 * o_f);
+
+        for (int i=0; i<x_size; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i+1);
+        }
+        for (int i=0; i<o_f; i++) {
+            ((uint16_t*)h)[i] = (uint16_t)(i%7);
+        }
+        for (int o=0; o<4*o_f; o++) {
+            ((uint16_t*)b)[o] = (uint16_t)o;
+            for (int i=0; i<i_f; i++) {
+                ((uint16_t*)Wx)[o*i_f+i] = (uint16_t)((o+i)%3);
+            }
+            for (int i=0; i<o_f; i++) {
+                ((uint16_t*)Wh)[o*o_f+i] = (uint16_t)((o*i)%5);
+            }
+        }
+
+        // Define Transaction generator for the LSTM gates
+        if (pim_api == "lstm")
+            tx_generator = new LstmTransactionGenerator(config_file, output_dir,
+                                                        i_f, o_f, x, y, h, b, Wx, Wh);
+        else
+            tx_generator = new LstmPreTransactionGenerator(config_file, output_dir,
+                                                           o_f, x, y, h, b, Wh);
     }
 
     else if (pim_api == "bn") {
@@ -157,6 +576,20 @@ int main(int argc, const char** argv) {
     // Calculate error between the result of PIM computation and actual answer
     tx_generator->CheckResult();
 
+    // Following GEMV steps only stream the new x, A is already in PIM memory
+    for (uint64_t step = 1; gemv_generator != NULL && step < gemv_steps; step++) {
+        uint64_t n = 4096;
+        uint8_t *x = (uint8_t *) malloc(sizeof(uint16_t) * n);
+        for (int i=0; i<n; i++) {
+            ((uint16_t*)x)[i] = (uint16_t)(i+step+1);
+        }
+        clk = gemv_generator->Invoke(x);
+        std::cout << C_GREEN << "Success GEMV step " << step << " (" << clk
+                  << " cycles)" << C_NORMAL << "\n";
+        gemv_generator->CheckResult();
+        free(x);
+    }
+
     tx_generator->PrintStats();
 
     delete tx_generator;
@@ -45,6 +45,8 @@ void MemorySystem::PrintStats() const { dram_system_->PrintStats(); }
 
 void MemorySystem::ResetStats() { dram_system_->ResetStats(); }
 
+double MemorySystem::GetTotalEnergy() { return dram_system_->GetTotalEnergy(); }
+
 MemorySystem* GetMemorySystem(const std::string &config_file, const std::string &output_dir,
                  std::function<void(uint64_t, uint8_t*)> read_callback,
                  std::function<void(uint64_t)> write_callback) {
@@ -62,8 +64,28 @@ bool MemorySystem::IsPendingTransaction() {
     return dram_system_->IsPendingTransaction();
 }
 
+bool MemorySystem::IsPendingTransaction(int channel) {
+    return dram_system_->IsPendingTransaction(channel);
+}
+
+bool MemorySystem::IsQueuedTransaction(int channel) const {
+    return dram_system_->IsQueuedTransaction(channel);
+}
+
+uint64_t MemorySystem::PimCommandCount(int channel) const {
+    return dram_system_->PimCommandCount(channel);
+}
+
+bool MemorySystem::IsSingleBankMode(int channel) const {
+    return dram_system_->IsSingleBankMode(channel);
+}
+
 void MemorySystem::SetMode(int mode) { dram_system_->SetMode(mode); }
 
+void MemorySystem::SetMode(int channel, int mode) {
+    dram_system_->SetMode(channel, mode);
+}
+
 void MemorySystem::PushCRF(PimInstruction* kernel) { dram_system_->PushCRF(kernel); }
 
 
@@ -75,6 +97,14 @@ void MemorySystem::SetBaseRow(BaseRow baserow) {
     dram_system_->SetBaseRow(baserow);
 }
 
+void MemorySystem::SetBaseRow(int channel, BaseRow baserow) {
+    dram_system_->SetBaseRow(channel, baserow);
+}
+
+void MemorySystem::SetWriteBufferThreshold(int channel, int threshold) {
+    dram_system_->SetWriteBufferThreshold(channel, threshold);
+}
+
 }  // namespace dramsim3
 
 // This function can be used by autoconf AC_CHECK_LIB since
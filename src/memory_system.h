@@ -27,6 +27,8 @@ class MemorySystem {
     int GetQueueSize() const;
     void PrintStats() const;
     void ResetStats();
+    // energy (pJ) of every channel so far, DRAM and PIM
+    double GetTotalEnergy();
 
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const;
     bool AddTransaction(uint64_t hex_addr, bool is_write, uint8_t *DataPtr);
@@ -34,10 +36,20 @@ class MemorySystem {
 
     // For barrier
     bool IsPendingTransaction();
+    bool IsPendingTransaction(int channel);
+    bool IsQueuedTransaction(int channel) const;
+    // commands that stepped the kernel of channel in BG mode
+    uint64_t PimCommandCount(int channel) const;
+    // channel and its banks are in SB mode, host traffic goes to memory
+    bool IsSingleBankMode(int channel) const;
     void SetWriteBufferThreshold(int threshold);
+    void SetWriteBufferThreshold(int channel, int threshold);
 
     void SetBaseRow(BaseRow baserow);
     void SetMode(int mode);
+    // per channel, for kernels that run on a part of the channels
+    void SetBaseRow(int channel, BaseRow baserow);
+    void SetMode(int channel, int mode);
     void PushCRF(PimInstruction* kernel);
 
  private:
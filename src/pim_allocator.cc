@@ -0,0 +1,113 @@
+#include "pim_allocator.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+
+namespace dramsim3 {
+
+PimAllocator::PimAllocator(uint64_t slab_size, uint64_t reserved_row)
+    : slab_size_(slab_size),
+      capacity_(slab_size * reserved_row),
+      bytes_in_use_(0) {
+    free_[0] = capacity_;
+}
+
+void PimAllocator::CheckChannels(int first, int count) {
+    int shift = 0;
+    while ((1 << shift) < count) shift++;
+    if (count <= 0 || (1 << shift) != count || shift > ADDR_CH_BITS ||
+        first % count != 0 || first + count > (1 << ADDR_CH_BITS)) {
+        std::cerr << "PimAllocator: bad channel group " << first << " + "
+                  << count << std::endl;
+        exit(1);
+    }
+}
+
+// first fit, lowest address first so small kernels keep the layout they had
+// with hard coded operand bases
+PimBuffer PimAllocator::Alloc(uint64_t bytes, PimInterleave interleave,
+                              int first, int count) {
+    CheckChannels(first, count);
+    int shift = 0;
+    while ((1 << shift) < count) shift++;
+    // a slab holds fewer bytes of the buffer when it uses fewer channels
+    uint64_t slab_bytes = slab_size_ >> (ADDR_CH_BITS - shift);
+    uint64_t size = ((bytes + slab_bytes - 1) / slab_bytes) * slab_size_;
+    if (size == 0) size = slab_size_;
+    for (auto it = free_.begin(); it != free_.end(); it++) {
+        if (it->second < size) continue;
+        uint64_t addr = it->first;
+        uint64_t left = it->second - size;
+        free_.erase(it);
+        if (left > 0) free_[addr + size] = left;
+        used_[addr] = size;
+        bytes_in_use_ += size;
+        return PimBuffer(addr, size, interleave, first, shift);
+    }
+    std::cerr << "PimAllocator: out of PIM memory allocating " << bytes
+              << " bytes (" << bytes_in_use_ << " of " << capacity_
+              << " in use)" << std::endl;
+    exit(1);
+}
+
+void PimAllocator::Free(const PimBuffer& buffer) {
+    auto used = used_.find(buffer.addr);
+    if (used == used_.end()) {
+        std::cerr << "PimAllocator: freeing unallocated buffer 0x" << std::hex
+                  << buffer.addr << std::dec << std::endl;
+        exit(1);
+    }
+    uint64_t addr = used->first;
+    uint64_t size = used->second;
+    used_.erase(used);
+    bytes_in_use_ -= size;
+
+    // merge with the free neighbours
+    auto next = free_.lower_bound(addr);
+    if (next != free_.end() && addr + size == next->first) {
+        size += next->second;
+        next = free_.erase(next);
+    }
+    if (next != free_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == addr) {
+            prev->second += size;
+            return;
+        }
+    }
+    free_[addr] = size;
+}
+
+uint64_t PimAllocator::GetBytes(const PimBuffer& buffer) const {
+    return buffer.size >> (ADDR_CH_BITS - buffer.ch_shift);
+}
+
+uint64_t PimAllocator::GetBaseRow(const PimBuffer& buffer, uint64_t offset) const {
+    uint64_t slab_bytes = slab_size_ >> (ADDR_CH_BITS - buffer.ch_shift);
+    return buffer.addr + (offset / slab_bytes) * slab_size_;
+}
+
+uint64_t PimAllocator::Address(const PimBuffer& buffer, uint64_t offset) const {
+    // spread the words over the channels in use, the rest of the offset goes
+    // above the channel bits
+    uint64_t word = offset >> ADDR_CH_POS;
+    uint64_t ch = buffer.ch_first + (word & ((1 << buffer.ch_shift) - 1));
+    uint64_t addr = buffer.addr +
+                    (((word >> buffer.ch_shift) << (ADDR_CH_POS + ADDR_CH_BITS)) |
+                     (ch << ADDR_CH_POS) | (offset & ((1 << ADDR_CH_POS) - 1)));
+    switch (buffer.interleave) {
+        case PimInterleave::CONV1:
+            return ADDR_CONV1(addr);
+        case PimInterleave::CONV2:
+            return ADDR_CONV2(addr);
+        case PimInterleave::CONV3:
+            return ADDR_CONV3(addr);
+        case PimInterleave::CONVG:
+            return ADDR_CONVG(addr);
+        default:
+            return ADDR_CONV0(addr);
+    }
+}
+
+}  // namespace dramsim3
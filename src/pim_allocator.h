@@ -0,0 +1,83 @@
+#ifndef __PIM_ALLOCATOR_H
+#define __PIM_ALLOCATOR_H
+
+#include <cstdint>
+#include <map>
+
+// Bank interleave of a buffer inside PIM memory
+//  CONV0-3 : flip the bank bits so that the buffer sits in bank 0-3 of each
+//            bankgroup (bank pair for ADD/MUL/BN operands)
+//  CONVG   : rotate bank/bankgroup bits so consecutive words go to banks of
+//            the same parity (GEMV weights and outputs)
+#define ADDR_CONV0(X) (X)
+#define ADDR_CONV1(X) ((X)^0x00000200)
+#define ADDR_CONV2(X) ((X)^0x00000400)
+#define ADDR_CONV3(X) ((X)^0x00000600)
+
+#define ADDR_CONVG(X) (((X)&0xfffffffffffe3ff) | (((X)&0xc00)<<1) | (((X)&0x1000)>>2))
+
+// channel bits of an address, right above the 32 byte word
+#define ADDR_CH_POS   5
+#define ADDR_CH_BITS  4
+
+namespace dramsim3 {
+
+enum class PimInterleave { CONV0, CONV1, CONV2, CONV3, CONVG };
+
+struct PimBuffer {
+    PimBuffer()
+        : addr(0), size(0), interleave(PimInterleave::CONV0), ch_first(0),
+          ch_shift(ADDR_CH_BITS) {}
+    PimBuffer(uint64_t addr, uint64_t size, PimInterleave interleave,
+              int ch_first, int ch_shift)
+        : addr(addr), size(size), interleave(interleave), ch_first(ch_first),
+          ch_shift(ch_shift) {}
+    uint64_t addr;  // linear (unconverted) address, slab aligned
+    uint64_t size;  // allocated bytes, multiple of the slab size
+    PimInterleave interleave;
+    // on channels ch_first ~ ch_first + (1 << ch_shift) - 1
+    int ch_first;
+    int ch_shift;
+};
+
+// Hands out buffers of PIM memory. A slab is one row of every bank of every
+// channel, so a buffer address is also the base row offset that PimUnit adds
+// to a row_offset command (see BaseRow). Rows from reserved_row up (mode
+// change, SRF and idle rows) are never handed out.
+//  There is one allocator per memory, every kernel on it allocates from it,
+//  so a buffer stays valid (and its data in place) until it is freed, not
+//  only while the kernel that wrote it runs.
+class PimAllocator {
+   public:
+    PimAllocator(uint64_t slab_size, uint64_t reserved_row);
+    // exits unless count is a power of two and first a multiple of count
+    static void CheckChannels(int first, int count);
+    // Buffer on channels first ~ first+count-1 only. Consecutive words of
+    // a buffer go round these channels, a buffer takes whole slabs
+    PimBuffer Alloc(uint64_t bytes, PimInterleave interleave, int first = 0,
+                    int count = 1 << ADDR_CH_BITS);
+    void Free(const PimBuffer& buffer);
+    // bytes of data the buffer holds
+    uint64_t GetBytes(const PimBuffer& buffer) const;
+
+    // physical address of byte offset in buffer
+    uint64_t Address(const PimBuffer& buffer, uint64_t offset) const;
+    // value to put in BaseRow for a kernel that reads/writes this buffer
+    uint64_t GetBaseRow(const PimBuffer& buffer) const { return buffer.addr; }
+    // same for the part of the buffer from offset on, offset is slab aligned
+    uint64_t GetBaseRow(const PimBuffer& buffer, uint64_t offset) const;
+
+    uint64_t GetCapacity() const { return capacity_; }
+    uint64_t GetBytesInUse() const { return bytes_in_use_; }
+
+   private:
+    uint64_t slab_size_;
+    uint64_t capacity_;
+    uint64_t bytes_in_use_;
+    std::map<uint64_t, uint64_t> free_;  // addr -> size, coalesced
+    std::map<uint64_t, uint64_t> used_;  // addr -> size
+};
+
+}  // namespace dramsim3
+
+#endif  // __PIM_ALLOCATOR_H
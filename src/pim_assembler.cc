@@ -0,0 +1,333 @@
+#include "pim_assembler.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace dramsim3 {
+
+namespace {
+
+uint64_t HashSource(const std::string& source) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// decimal, 0x or 0b with an optional sign
+bool ParseNumber(const std::string& token, long* value) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < token.size() && (token[pos] == '-' || token[pos] == '+')) {
+        negative = token[pos] == '-';
+        pos++;
+    }
+    int base = 10;
+    if (token.compare(pos, 2, "0x") == 0 || token.compare(pos, 2, "0X") == 0) {
+        base = 16;
+        pos += 2;
+    } else if (token.compare(pos, 2, "0b") == 0 ||
+               token.compare(pos, 2, "0B") == 0) {
+        base = 2;
+        pos += 2;
+    }
+    if (pos == token.size()) return false;
+    char* end = NULL;
+    long v = strtol(token.c_str() + pos, &end, base);
+    if (*end != '\0') return false;
+    *value = negative ? -v : v;
+    return true;
+}
+
+// has_idx is false for GRF_A/GRF_B without index, which only AAM accepts
+bool ParseOperand(const std::string& token, PimOperand* op, bool* has_idx) {
+    static const struct {
+        const char* name;
+        PIM_OPERAND type;
+    } prefixes[] = {{"EVEN_BANK", PIM_OPERAND::BANK0},
+                    {"ODD_BANK", PIM_OPERAND::BANK1},
+                    {"BANK", PIM_OPERAND::NONE},
+                    {"GRF_A", PIM_OPERAND::GRF_A},
+                    {"GRF_B", PIM_OPERAND::GRF_B},
+                    {"SRF_A", PIM_OPERAND::SRF_A},
+                    {"SRF_M", PIM_OPERAND::SRF_M}};
+    for (const auto& prefix : prefixes) {
+        std::string name = prefix.name;
+        if (token.compare(0, name.size(), name) != 0) continue;
+        std::string idx = token.substr(name.size());
+        if (prefix.type == PIM_OPERAND::BANK0 ||
+            prefix.type == PIM_OPERAND::BANK1) {
+            *op = PimOperand(prefix.type);
+            *has_idx = true;
+            return idx.empty();
+        }
+        *has_idx = !idx.empty();
+        long value = 0;
+        if (*has_idx && (idx.size() != 1 || !ParseNumber(idx, &value)))
+            return false;
+        if (prefix.type == PIM_OPERAND::NONE) {
+            // BANKn
+            if (!*has_idx || value > 3) return false;
+            *op = PimOperand(
+                (PIM_OPERAND)((int)PIM_OPERAND::BANK0 + (int)value));
+            return true;
+        }
+        if (value >= (prefix.type == PIM_OPERAND::GRF_A ||
+                              prefix.type == PIM_OPERAND::GRF_B
+                          ? GRF_ENTRIES
+                          : SRF_ENTRIES))
+            return false;
+        *op = PimOperand(prefix.type, (int)value);
+        return true;
+    }
+    return false;
+}
+
+bool IsGrf(const PimOperand& op) {
+    return op.type_ == PIM_OPERAND::GRF_A || op.type_ == PIM_OPERAND::GRF_B;
+}
+
+}  // namespace
+
+PimAssembler::PimAssembler(int crf_depth) : crf_depth_(crf_depth) {}
+
+PimInstruction* PimAssembler::Assemble(const std::string& source,
+                                       const std::string& name) {
+    uint64_t hash = HashSource(source);
+    auto it = cache_.find(hash);
+    if (it != cache_.end()) {
+        if (it->second.source != source) {
+            std::cerr << name << ": ukernel hash collides with a cached one"
+                      << std::endl;
+            exit(1);
+        }
+        return it->second.insts.data();
+    }
+
+    Program& program = cache_[hash];
+    std::string error = Parse(source, program.insts);
+    if (!error.empty()) {
+        std::cerr << name << ":" << error << std::endl;
+        exit(1);
+    }
+    program.source = source;
+    program.insts.resize(crf_depth_);
+    return program.insts.data();
+}
+
+PimInstruction* PimAssembler::AssembleFile(const std::string& path) {
+    std::ifstream file(path);
+    if (file.fail()) {
+        std::cerr << "Cannot open ukernel file " << path << std::endl;
+        exit(1);
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    return Assemble(source.str(), path);
+}
+
+std::string PimAssembler::Validate(const std::string& source) const {
+    std::vector<PimInstruction> insts;
+    return Parse(source, insts);
+}
+
+// Returns "line: message" of the first error, empty if none
+std::string PimAssembler::Parse(const std::string& source,
+                                std::vector<PimInstruction>& insts) const {
+    std::vector<int> lines;
+    std::istringstream in(source);
+    std::string line;
+    int line_num = 0;
+    while (std::getline(in, line)) {
+        line_num++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream fields(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (fields >> token) {
+            for (auto& c : token) c = toupper(c);
+            tokens.push_back(token);
+        }
+        if (tokens.empty()) continue;
+
+        std::string where = std::to_string(line_num) + ": ";
+        std::string op = tokens[0];
+        bool aam = false;
+        if (op.size() > 4 && op.compare(op.size() - 4, 4, "_AAM") == 0) {
+            aam = true;
+            op.erase(op.size() - 4);
+        }
+        size_t num_args = tokens.size() - 1;
+
+        if (op == "EXIT" || op == "NOP") {
+            if (aam || num_args != 0)
+                return where + op + " takes no operands";
+            if (op == "EXIT")
+                insts.push_back(PimInstruction(PIM_OPERATION::EXIT, 0, 0));
+            else
+                insts.push_back(PimInstruction(PIM_OPERATION::NOP, 0, 0x10));
+        } else if (op == "JUMP") {
+            long offset = 0, count = 0;
+            if (aam || num_args < 2 || num_args > 3 ||
+                !ParseNumber(tokens[1], &offset) ||
+                !ParseNumber(tokens[2], &count))
+                return where + "JUMP needs an offset and a loop count";
+            if (num_args == 3 && tokens[3] != "YIELD")
+                return where + "bad JUMP flag " + tokens[3];
+            // dst 1: yield to the host at every jump
+            insts.push_back(PimInstruction(PIM_OPERATION::JUMP,
+                                           num_args == 3 ? 1 : 0, 0,
+                                           (int)offset, (int)count));
+        } else if (num_args >= 2 && isdigit(tokens[1][0])) {
+            // fixed-role op: dst src [imm0 [imm1]]
+            static const std::map<std::string, PIM_OPERATION> fixed = {
+                {"LD", PIM_OPERATION::LD},   {"ADD", PIM_OPERATION::ADD},
+                {"MUL", PIM_OPERATION::MUL}, {"BN", PIM_OPERATION::BN},
+                {"GEMV", PIM_OPERATION::GEMV}, {"ST", PIM_OPERATION::ST}};
+            auto it = fixed.find(op);
+            if (it == fixed.end() || aam) {
+                static const std::string reg_ops =
+                    " MAC MAD MOV FILL RELU CLAMP LUT MAX ARGMAX RSUM RMAX RARGMAX QMUL QMAC ";
+                if (reg_ops.find(" " + op + " ") == std::string::npos)
+                    return where + "unknown op " + tokens[0];
+                return where + tokens[0] + " has no bank mask form";
+            }
+            long args[4] = {0, 0, 0, 0};
+            if (num_args > 4) return where + "too many operands";
+            for (size_t i = 0; i < num_args; i++) {
+                if (!ParseNumber(tokens[i + 1], &args[i]))
+                    return where + "bad number " + tokens[i + 1];
+            }
+            PIM_OPERATION pim_op = it->second;
+            if (args[1] < 0 || args[1] > 0x3f)
+                return where + "src mask must be within 0x3f";
+            if (args[2] < INT16_MIN || args[2] > INT16_MAX)
+                return where + "imm0 must fit in 16 bits";
+            if (pim_op == PIM_OPERATION::GEMV) {
+                if (args[0] != 4 && args[0] != 5)
+                    return where + "GEMV dst is 4 (ACC0) or 5 (ACC1)";
+                if (args[2] > PIM_MAX_BATCH)
+                    return where + "GEMV batch exceeds PIM_MAX_BATCH";
+                if (args[3] < 0 || args[3] >= SRF_BUFFERS)
+                    return where + "GEMV SRF buffer exceeds SRF_BUFFERS";
+            } else if (pim_op != PIM_OPERATION::LD &&
+                       (args[0] < 0 || args[0] > 3)) {
+                return where + op + " dst must be a bank 0-3";
+            }
+            if (pim_op == PIM_OPERATION::ST &&
+                (args[2] < 0 || args[2] >= PIM_MAX_BATCH))
+                return where + "ST vector exceeds PIM_MAX_BATCH";
+            insts.push_back(PimInstruction(pim_op, (int)args[0],
+                                           (unsigned)args[1], (int)args[2],
+                                           (int)args[3]));
+        } else {
+            // register op
+            static const std::map<std::string, PIM_OPERATION> reg = {
+                {"ADD", PIM_OPERATION::ADD},   {"MUL", PIM_OPERATION::MUL},
+                {"MAC", PIM_OPERATION::MAC},   {"MAD", PIM_OPERATION::MAD},
+                {"MOV", PIM_OPERATION::MOV},   {"FILL", PIM_OPERATION::FILL},
+                {"RELU", PIM_OPERATION::RELU}, {"CLAMP", PIM_OPERATION::CLAMP},
+                {"LUT", PIM_OPERATION::LUT},   {"MAX", PIM_OPERATION::MAX},
+                {"ARGMAX", PIM_OPERATION::ARGMAX}, {"RSUM", PIM_OPERATION::RSUM},
+                {"RMAX", PIM_OPERATION::RMAX}, {"RARGMAX", PIM_OPERATION::RARGMAX},
+                {"QMUL", PIM_OPERATION::QMUL}, {"QMAC", PIM_OPERATION::QMAC}};
+            auto it = reg.find(op);
+            if (it == reg.end()) return where + "unknown op " + tokens[0];
+            PIM_OPERATION pim_op = it->second;
+            bool is_mov =
+                pim_op == PIM_OPERATION::MOV || pim_op == PIM_OPERATION::FILL;
+            bool is_reduce = pim_op == PIM_OPERATION::RSUM ||
+                             pim_op == PIM_OPERATION::RMAX ||
+                             pim_op == PIM_OPERATION::RARGMAX;
+            bool is_unary = is_mov || is_reduce ||
+                            pim_op == PIM_OPERATION::RELU ||
+                            pim_op == PIM_OPERATION::LUT ||
+                            pim_op == PIM_OPERATION::ARGMAX;
+            size_t min_args = is_unary ? 2 : 3;
+            if (pim_op == PIM_OPERATION::CLAMP) min_args = 4;
+            size_t max_args = pim_op == PIM_OPERATION::MAD ? 4 : min_args;
+            if (num_args < min_args || num_args > max_args)
+                return where + op + " takes " + std::to_string(min_args) +
+                       " operands";
+
+            PimOperand ops[4];
+            for (size_t i = 0; i < num_args; i++) {
+                bool has_idx = true;
+                if (!ParseOperand(tokens[i + 1], &ops[i], &has_idx))
+                    return where + "bad operand " + tokens[i + 1];
+                if (!has_idx && (!aam || !IsGrf(ops[i])))
+                    return where + tokens[i + 1] + " needs an index";
+            }
+            const PimOperand& dst = ops[0];
+            const PimOperand& src0 = ops[1];
+            if (dst.IsScalar())
+                return where + "SRF is not writable by PIM instructions";
+            if (src0.IsScalar() && !is_mov)
+                return where + "SRF can only be src1 or src2";
+            if (pim_op == PIM_OPERATION::FILL &&
+                (!src0.IsBank() || !IsGrf(dst)))
+                return where + "FILL copies a bank into the GRF";
+            if (pim_op == PIM_OPERATION::ARGMAX &&
+                (dst.type_ != PIM_OPERAND::GRF_A || !src0.IsBank()))
+                return where + "ARGMAX takes a bank into GRF_A";
+            if (pim_op == PIM_OPERATION::RARGMAX &&
+                (dst.type_ != PIM_OPERAND::GRF_A ||
+                 src0.type_ != PIM_OPERAND::GRF_A))
+                return where + "RARGMAX reduces GRF_A into GRF_A";
+            if ((pim_op == PIM_OPERATION::ARGMAX || is_reduce) && aam)
+                return where + op + " has no AAM form";
+            if (pim_op == PIM_OPERATION::MAD && num_args == 3) {
+                if (ops[2].type_ != PIM_OPERAND::SRF_M)
+                    return where + "MAD without src2 needs SRF_M as src1";
+                ops[3] = PimOperand(PIM_OPERAND::SRF_A, ops[2].idx_);
+            }
+            if (aam && !IsGrf(ops[0]) && !IsGrf(ops[1]) && !IsGrf(ops[2]) &&
+                !IsGrf(ops[3]))
+                return where + "AAM without GRF operand";
+            insts.push_back(
+                PimInstruction(pim_op, ops[0], ops[1], ops[2], ops[3], aam));
+        }
+        lines.push_back(line_num);
+    }
+    return Check(insts, lines);
+}
+
+// control flow of a parsed program
+std::string PimAssembler::Check(const std::vector<PimInstruction>& insts,
+                                const std::vector<int>& lines) const {
+    if ((int)insts.size() > crf_depth_) {
+        return std::to_string(lines[crf_depth_]) + ": program exceeds " +
+               std::to_string(crf_depth_) + " CRF entries";
+    }
+    bool has_exit = false;
+    for (size_t pc = 0; pc < insts.size(); pc++) {
+        const PimInstruction& inst = insts[pc];
+        std::string where = std::to_string(lines[pc]) + ": ";
+        if (inst.PIM_OP == PIM_OPERATION::EXIT) has_exit = true;
+        if (inst.PIM_OP != PIM_OPERATION::JUMP) continue;
+        int target = (int)pc + inst.imm0_;
+        if (inst.imm0_ >= 0 || target < 0)
+            return where + "JUMP target must be an earlier instruction";
+        if (inst.imm1_ < 1)
+            return where + "JUMP loop count must be at least 1";
+        // inner loops have to sit inside the body
+        for (size_t i = target; i < pc; i++) {
+            if (insts[i].PIM_OP == PIM_OPERATION::EXIT)
+                return where + "JUMP body has an EXIT";
+            if (insts[i].PIM_OP == PIM_OPERATION::JUMP &&
+                (int)i + insts[i].imm0_ < target)
+                return where + "JUMP overlaps the loop at line " +
+                       std::to_string(lines[i]);
+        }
+    }
+    if (!has_exit) return std::to_string(lines.empty() ? 1 : lines.back()) + ": program has no EXIT";
+    return "";
+}
+
+}  // namespace dramsim3
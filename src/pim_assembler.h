@@ -0,0 +1,78 @@
+#ifndef __PIM_ASSEMBLER_H
+#define __PIM_ASSEMBLER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pim_config.h"
+
+namespace dramsim3 {
+
+// Assembles μkernel text into CRF programs. One instruction per line, fields
+// separated by blanks (PIMFuncSim/CRF.txt uses 10 character columns), '#'
+// or ';' starts a comment, numbers are decimal, 0x or 0b:
+//
+//   EXIT
+//   NOP
+//   JUMP      offset    count  [YIELD]
+//                                  back to PPC+offset, count more times.
+//                                  Loops nest, YIELD goes back to ABG mode
+//                                  at every jump and resumes there in BG
+//   LD|ADD|MUL|BN|GEMV|ST   dst  src  [imm0 [imm1]]
+//                                  fixed-role ops, src is the bank mask,
+//                                  GEMV imm0 is the batch, imm1 the SRF buffer
+//   ADD|MUL|MAC[_AAM]       dst  src0 src1
+//   QMUL|QMAC[_AAM]         dst  src0 src1
+//   MAD[_AAM]               dst  src0 src1 [src2]
+//   MOV|FILL                dst  src0
+//   RELU|LUT                dst  src0
+//   CLAMP                   dst  src0 src1 src2
+//   MAX                     dst  src0 src1
+//   ARGMAX                  GRF_An BANKn
+//   RSUM|RMAX|RARGMAX       dst  src0
+//
+// Register operands are BANK0-3 (EVEN_BANK is BANK0, ODD_BANK is BANK1),
+// GRF_A0-7, GRF_B0-7, SRF_A0-7 and SRF_M0-7. GRF operands of _AAM
+// instructions take their index from the command address and may leave it
+// out. MAD without src2 adds SRF_A of src1's SRF_M index. RELU, CLAMP
+// (to src1 ~ src2) and LUT (the activation table of the unit) take lanes
+// as signed Q8.8. MAX and ARGMAX compare signed lanes, ARGMAX keeps the
+// position in GRF_Bn. The R ops reduce the lanes and then the bankgroups of
+// the channel into lane 0 of dst of bankgroup 0. QMUL and QMAC multiply as
+// Q8.8, round and saturate.
+class PimAssembler {
+   public:
+    explicit PimAssembler(int crf_depth);
+
+    // Returns the program padded with NOP to the CRF depth, ready for
+    // PushCRF. Programs are cached by source hash, an invalid source prints
+    // name:line: message and exits.
+    PimInstruction* Assemble(const std::string& source,
+                             const std::string& name = "ukernel");
+    PimInstruction* AssembleFile(const std::string& path);
+
+    // Empty if source is a valid program, the first error otherwise
+    std::string Validate(const std::string& source) const;
+
+    size_t GetCacheSize() const { return cache_.size(); }
+
+   private:
+    struct Program {
+        std::string source;
+        std::vector<PimInstruction> insts;
+    };
+
+    std::string Parse(const std::string& source,
+                      std::vector<PimInstruction>& insts) const;
+    std::string Check(const std::vector<PimInstruction>& insts,
+                      const std::vector<int>& lines) const;
+
+    int crf_depth_;
+    std::map<uint64_t, Program> cache_;  // FNV-1a of the source -> program
+};
+
+}  // namespace dramsim3
+
+#endif  // __PIM_ASSEMBLER_H
@@ -1,53 +1,275 @@
-#ifndef __PIM_CONFIG_H_
-#define __PIM_CONFIG_H_
-
-// set unit size
-typedef uint16_t unit_t;
-
-#define UNIT_SIZE		(int)(sizeof(unit_t))
-#define WORD_SIZE		32
-#define UNITS_PER_WORD	(WORD_SIZE / UNIT_SIZE)
-
-#define CACHE_SIZE		8 * (UNITS_PER_WORD * UNIT_SIZE)
-#define SRF_SIZE		(UNITS_PER_WORD * UNIT_SIZE)
-#define ACC_SIZE		2 * (UNITS_PER_WORD * UNIT_SIZE)
-
-
-enum class PIM_OPERATION {
-	JUMP = 0,
-	NOP,
-	EXIT,
-	LD,
-	ADD,
-	MUL,
-	BN,
-	GEMV,
-	ST
-};
-
-// 528sumin add command and src_
-class PimInstruction {
-public:
-	PimInstruction():
-		PIM_OP(PIM_OPERATION::NOP),
-		dst_(-1),
-		src_(0),
-		imm0_(0),
-		imm1_(0) {}
-		
-	PimInstruction(PIM_OPERATION pim_op, int dst, unsigned src, int imm0 = 0, int imm1 = 0) :
-		PIM_OP(pim_op),
-		dst_(dst),
-		src_(src),
-		imm0_(imm0),
-		imm1_(imm1) {}
-
-	PIM_OPERATION PIM_OP;
-	int dst_;
-	unsigned src_;
-	int imm0_;
-	int imm1_;
-};
-
-
-#endif // __PIM_CONFIG_H
+#ifndef __PIM_CONFIG_H_
+#define __PIM_CONFIG_H_
+
+// set unit size
+typedef uint16_t unit_t;
+
+#define UNIT_SIZE		(int)(sizeof(unit_t))
+#define WORD_SIZE		32
+#define UNITS_PER_WORD	(WORD_SIZE / UNIT_SIZE)
+
+// input vectors a batched GEMV keeps in SRF/ACC at once, SRF has one word
+// and ACC two words per vector
+#define PIM_MAX_BATCH	8
+
+// SRF is double buffered for GEMV: the host writes the next SRF words
+// (columns PIM_MAX_BATCH ~ 2*PIM_MAX_BATCH-1 select buffer 1) while the
+// kernel computes with the other buffer, GEMV imm1 selects the buffer
+#define SRF_BUFFERS		2
+
+#define CACHE_SIZE		8 * (UNITS_PER_WORD * UNIT_SIZE)
+#define SRF_SIZE		(SRF_BUFFERS * PIM_MAX_BATCH * UNITS_PER_WORD * UNIT_SIZE)
+#define ACC_SIZE		(2 * PIM_MAX_BATCH * UNITS_PER_WORD * UNIT_SIZE)
+
+
+enum class PIM_OPERATION {
+	JUMP = 0,
+	NOP,
+	EXIT,
+	LD,
+	ADD,
+	MUL,
+	BN,
+	GEMV,
+	ST,
+	MAC,
+	MAD,
+	MOV,
+	FILL,
+	RELU,
+	CLAMP,
+	LUT,
+	MAX,
+	ARGMAX,
+	RSUM,
+	RMAX,
+	RARGMAX,
+	QMUL,
+	QMAC
+};
+
+#define NUM_PIM_OPERATIONS	((int)PIM_OPERATION::QMAC + 1)
+
+// ARGMAX position of a lane that has not seen a value yet
+#define PIM_NO_POSITION	0xffff
+
+// GRF_A and GRF_B hold this many words each, SRF_M and SRF_A this many
+// scalars each (SRF_M is units 0-7 and SRF_A units 8-15 of the SRF word)
+#define GRF_ENTRIES		8
+#define SRF_ENTRIES		8
+
+// arithmetic ops per lane of one instruction (GEMV: two MACs per lane)
+inline int PimOperationLaneOps(PIM_OPERATION op) {
+	switch (op) {
+	case PIM_OPERATION::ADD:
+	case PIM_OPERATION::MUL:
+	case PIM_OPERATION::RELU:
+	case PIM_OPERATION::MAX:
+	case PIM_OPERATION::ARGMAX:
+	case PIM_OPERATION::RSUM:
+	case PIM_OPERATION::RMAX:
+	case PIM_OPERATION::RARGMAX:
+	case PIM_OPERATION::QMUL:
+		return 1;
+	case PIM_OPERATION::BN:
+	case PIM_OPERATION::MAC:
+	case PIM_OPERATION::MAD:
+	case PIM_OPERATION::CLAMP:
+	case PIM_OPERATION::LUT:
+	case PIM_OPERATION::QMAC:
+		return 2;
+	case PIM_OPERATION::GEMV:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+// lower case name of each operation, used for stats
+inline const char* PimOperationName(PIM_OPERATION op) {
+	static const char* names[NUM_PIM_OPERATIONS] = {
+		"jump", "nop", "exit", "ld", "add", "mul", "bn", "gemv", "st",
+		"mac", "mad", "mov", "fill", "relu", "clamp", "lut", "max", "argmax",
+		"rsum", "rmax", "rargmax", "qmul", "qmac"};
+	return names[(int)op];
+}
+
+// operands of register instructions, BANKn is the cache word of bank n
+enum class PIM_OPERAND {
+	NONE = 0,
+	BANK0,
+	BANK1,
+	BANK2,
+	BANK3,
+	GRF_A,
+	GRF_B,
+	SRF_A,
+	SRF_M
+};
+
+class PimOperand {
+public:
+	PimOperand(PIM_OPERAND type = PIM_OPERAND::NONE, int idx = 0) :
+		type_(type),
+		idx_(idx) {}
+
+	bool IsBank() const {
+		return type_ >= PIM_OPERAND::BANK0 && type_ <= PIM_OPERAND::BANK3;
+	}
+	int Bank() const { return (int)type_ - (int)PIM_OPERAND::BANK0; }
+	bool IsScalar() const {
+		return type_ == PIM_OPERAND::SRF_A || type_ == PIM_OPERAND::SRF_M;
+	}
+
+	PIM_OPERAND type_;
+	int idx_;
+};
+
+// RELU, CLAMP, LUT, QMUL and QMAC see lanes as signed fixed point with
+// PIM_FRAC_BITS fraction bits (Q8.8)
+#define PIM_FRAC_BITS	8
+
+// Q8.8 product of a and b plus acc, rounded to nearest and saturated to 16
+// bits (QMUL, QMAC)
+inline unit_t PimMulQ(unit_t a, unit_t b, unit_t acc = 0) {
+	int32_t p = ((int32_t)(int16_t)a * (int16_t)b + (1 << (PIM_FRAC_BITS - 1))) >> PIM_FRAC_BITS;
+	int32_t y = (int16_t)acc + p;
+	y = y < INT16_MIN ? INT16_MIN : (y > INT16_MAX ? INT16_MAX : y);
+	return (unit_t)y;
+}
+
+// LUT approximates an activation piecewise linear over [-LUT_RANGE,
+// LUT_RANGE) in LUT_SEGMENTS segments. The table has the intercept of every
+// segment in units 0 ~ LUT_SEGMENTS-1 and its slope in the others, both
+// Q8.8, and is written to the LUT row like the SRF.
+//  In the range the max error against the exact activation (saturated to
+//  Q8.8) is below 0.01 (2.5 LSB) for gelu, silu, sigmoid and tanh, and below
+//  0.15 for exp, 0.4% of its value. Out of the range the end segments go on
+#define LUT_RANGE		8
+#define LUT_SEGMENTS	128
+#define LUT_SEGMENT_SHIFT	5	// log2(2 * LUT_RANGE / LUT_SEGMENTS) + PIM_FRAC_BITS
+#define LUT_WORDS		(2 * LUT_SEGMENTS / UNITS_PER_WORD)
+#define LUT_SIZE		(LUT_WORDS * UNITS_PER_WORD * UNIT_SIZE)
+
+// LUT of one lane, inputs out of the range extend the first or last
+// segment and the result saturates to 16 bits
+inline unit_t PimLutLookup(const unit_t* lut, unit_t x) {
+	int32_t v = (int16_t)x;
+	int32_t lo = -(LUT_RANGE << PIM_FRAC_BITS);
+	int32_t seg = (v - lo) >> LUT_SEGMENT_SHIFT;
+	seg = seg < 0 ? 0 : (seg >= LUT_SEGMENTS ? LUT_SEGMENTS - 1 : seg);
+	int32_t dx = v - (lo + (seg << LUT_SEGMENT_SHIFT));
+	int32_t y = (int16_t)lut[seg] + (((int16_t)lut[LUT_SEGMENTS + seg] * dx) >> PIM_FRAC_BITS);
+	y = y < INT16_MIN ? INT16_MIN : (y > INT16_MAX ? INT16_MAX : y);
+	return (unit_t)y;
+}
+
+// 528sumin add command and src_
+class PimInstruction {
+public:
+	PimInstruction():
+		PIM_OP(PIM_OPERATION::NOP),
+		dst_(-1),
+		src_(0),
+		imm0_(0),
+		imm1_(0),
+		is_reg_(false),
+		is_aam_(false) {}
+		
+	PimInstruction(PIM_OPERATION pim_op, int dst, unsigned src, int imm0 = 0, int imm1 = 0) :
+		PIM_OP(pim_op),
+		dst_(dst),
+		src_(src),
+		imm0_(imm0),
+		imm1_(imm1),
+		is_reg_(false),
+		is_aam_(false) {}
+
+	// register instruction (ADD, MUL, MAC, MAD, MOV, FILL, RELU, CLAMP, LUT,
+	// the reductions, QMUL and QMAC): dst = src0 op src1, MAD dst = src0 *
+	// src1 + src2, CLAMP bounds src0 to src1 ~ src2
+	// every R/W command triggers one, bank sources are read into the cache
+	// by that command. is_aam takes GRF indices from the command's column
+	// and row instead of idx_
+	PimInstruction(PIM_OPERATION pim_op, PimOperand dst, PimOperand src0,
+		PimOperand src1 = PimOperand(), PimOperand src2 = PimOperand(),
+		bool is_aam = false) :
+		PIM_OP(pim_op),
+		dst_(-1),
+		src_(0x10),
+		imm0_(0),
+		imm1_(0),
+		is_reg_(true),
+		is_aam_(is_aam),
+		dst_op_(dst),
+		src0_op_(src0),
+		src1_op_(src1),
+		src2_op_(src2) {
+		const PimOperand* srcs[3] = {&src0, &src1, &src2};
+		for (int i = 0; i < 3; i++) {
+			if (srcs[i]->IsBank()) { src_ |= 1u << srcs[i]->Bank(); }
+		}
+	}
+
+	PIM_OPERATION PIM_OP;
+	int dst_;
+	unsigned src_;
+	int imm0_;
+	int imm1_;
+
+	bool is_reg_;
+	bool is_aam_;
+	PimOperand dst_op_;
+	PimOperand src0_op_;
+	PimOperand src1_op_;
+	PimOperand src2_op_;
+};
+
+// CRF entry as the host writes it to the CRF row, 4 entries per word
+//  [3:0] op, [4] register form, [5] AAM
+//  fixed-role: [9:6] dst (15: -1), [15:10] src, [31:16] imm0, [63:32] imm1
+//  register:   dst, src0, src1, src2 at [13:6], [21:14], [29:22], [37:30],
+//              operand type in the low and index in the high 4 bits, [38]
+//              op bit 4 (ops from MAX on have the register form only)
+#define CRF_ENTRY_SIZE			8
+#define CRF_ENTRIES_PER_WORD	(WORD_SIZE / CRF_ENTRY_SIZE)
+
+inline uint64_t EncodePimInstruction(const PimInstruction& inst) {
+	uint64_t code = (uint64_t)inst.PIM_OP & 0xf;
+	code |= (uint64_t)inst.is_reg_ << 4;
+	code |= (uint64_t)inst.is_aam_ << 5;
+	if (inst.is_reg_) {
+		code |= (((uint64_t)inst.PIM_OP >> 4) & 1) << 38;
+		const PimOperand* ops[4] = {&inst.dst_op_, &inst.src0_op_, &inst.src1_op_, &inst.src2_op_};
+		for (int i = 0; i < 4; i++) {
+			uint64_t op = ((uint64_t)ops[i]->type_ & 0xf) | (((uint64_t)ops[i]->idx_ & 0xf) << 4);
+			code |= op << (6 + 8 * i);
+		}
+	}
+	else {
+		code |= ((uint64_t)inst.dst_ & 0xf) << 6;
+		code |= ((uint64_t)inst.src_ & 0x3f) << 10;
+		code |= ((uint64_t)inst.imm0_ & 0xffff) << 16;
+		code |= ((uint64_t)(uint32_t)inst.imm1_) << 32;
+	}
+	return code;
+}
+
+inline PimInstruction DecodePimInstruction(uint64_t code) {
+	PIM_OPERATION pim_op = (PIM_OPERATION)(code & 0xf);
+	if ((code >> 4) & 1) {
+		pim_op = (PIM_OPERATION)((int)pim_op | (int)(((code >> 38) & 1) << 4));
+		PimOperand ops[4];
+		for (int i = 0; i < 4; i++) {
+			uint64_t op = (code >> (6 + 8 * i)) & 0xff;
+			ops[i] = PimOperand((PIM_OPERAND)(op & 0xf), (int)(op >> 4));
+		}
+		return PimInstruction(pim_op, ops[0], ops[1], ops[2], ops[3], (code >> 5) & 1);
+	}
+	int dst = (int)((code >> 6) & 0xf);
+	return PimInstruction(pim_op, dst == 0xf ? -1 : dst, (unsigned)((code >> 10) & 0x3f),
+		(int)(int16_t)((code >> 16) & 0xffff), (int)(int32_t)(code >> 32));
+}
+
+
+#endif // __PIM_CONFIG_H
@@ -8,7 +8,14 @@ PimFuncSim::PimFuncSim(Config& config)
     for (int i = 0; i < config_.channels * config_.banks / 4; i++) {
         pim_unit_.push_back(new PimUnit(config_, i));
     }
-    base_row_ = BaseRow();
+    base_row_.assign(config_.channels, BaseRow());
+
+    // Set default bankmode of channel to "SB"
+    bankmode.assign(config_.channels, "SB");
+    bankmode_id.assign(config_.channels, 0);
+    srf_writes_.assign(config_.channels, 0);
+    crf_insts_.assign(config_.channels, 0);
+    mode_changes_.assign(config_.channels, 0);
 }
 
 void PimFuncSim::init(uint8_t* pmemAddr_, uint64_t pmemAddr_size_,
@@ -17,11 +24,8 @@ void PimFuncSim::init(uint8_t* pmemAddr_, uint64_t pmemAddr_size_,
     pmemAddr_size = pmemAddr_size_;
     pmemAddr = pmemAddr_;
 
-
-    // Set default bankmode of channel to "SB"
-    for (int i = 0; i < config_.channels; i++) {
-        bankmode.push_back("SB");
-    }
+    bankmode.assign(config_.channels, "SB");
+    bankmode_id.assign(config_.channels, 0);
     
     std::cout << "PimFuncSim initialized!\n";
 
@@ -56,18 +60,24 @@ bool PimFuncSim::ModeChanger(uint64_t hex_addr) {
     if (addr.row == SB_ROW) {
         if (bankmode[addr.channel] == "ABG") {
             bankmode[addr.channel] = "SB";
+            bankmode_id[addr.channel] = 0;
+            mode_changes_[addr.channel] += 1;
         }
         return true;
     }
     else if (addr.row == ABG_ROW) {
         if (bankmode[addr.channel] == "SB") {
             bankmode[addr.channel] = "ABG";
+            bankmode_id[addr.channel] = 2;
+            mode_changes_[addr.channel] += 1;
         }
         return true;
     }
     else if (addr.row == BG_ROW) {
         if (bankmode[addr.channel] == "ABG") {
             bankmode[addr.channel] = "BG";
+            bankmode_id[addr.channel] = 1;
+            mode_changes_[addr.channel] += 1;
         }
         return true;
     }
@@ -103,6 +113,13 @@ void PimFuncSim::DRAM_IO(Transaction* trans) {
     if (is_mode_change)
         return;
 
+    // SRF writes are accepted in BG mode, so the next SRF buffer can be
+    // written while the kernel runs on the other one
+    if (bankmode[addr.channel] == "BG" && is_write && addr.row == SRF_ROW) {
+        SetSrf(addr.channel, addr.column, DataPtr);
+        return;
+    }
+
     // should not call DRAM_IO when BG mode
     if (bankmode[addr.channel] == "BG") {
         std::cerr << "DRAM_IO executed in BG mode" << std::endl;
@@ -121,11 +138,15 @@ void PimFuncSim::DRAM_IO(Transaction* trans) {
         }
     }
     else if (bankmode[addr.channel] == "ABG"){        
-        if (addr.row == 0x3ffb){
+        if (addr.row == SRF_ROW){
             //std::cout << "Is proper?: " << *((uint16_t*)DataPtr) << std::endl;
-            for(int i=0; i < config_.bankgroups; i++){
-               pim_unit_[addr.channel * config_.bankgroups + i]->SetSrf(DataPtr);
-            }
+            SetSrf(addr.channel, addr.column, DataPtr);
+        }
+        else if (addr.row == CRF_ROW) {
+            WriteCRF(addr.channel, addr.column, DataPtr);
+        }
+        else if (addr.row == LUT_ROW) {
+            SetLut(addr.channel, addr.column, DataPtr);
         }
     }
     
@@ -139,26 +160,116 @@ void PimFuncSim::PIM_OP(int channel) {
     for (int i = 0; i < 4; i++) {
         if(pim_unit_[channel * config_.bankgroups + i]->PIM_OP()){exit = true;}
     }
+    if (pim_unit_[channel * config_.bankgroups]->reduce_dst != NULL) {
+        ReduceBankgroups(channel);
+    }
     if(exit){
+        if (bankmode[channel] != "ABG") { mode_changes_[channel] += 1; }
         bankmode[channel] = "ABG";
+        bankmode_id[channel] = 2;
+    }
+}
+
+// second level of RSUM, RMAX and RARGMAX: bankgroup 0 combines lane 0 of
+// the result of every bankgroup, the lower bankgroup wins on a tie
+void PimFuncSim::ReduceBankgroups(int channel) {
+    PimUnit* first = pim_unit_[channel * config_.bankgroups];
+    unit_t* dst = first->reduce_dst;
+    for (int i = 1; i < config_.bankgroups; i++) {
+        PimUnit* unit = pim_unit_[channel * config_.bankgroups + i];
+        unit_t v = unit->reduce_dst[0];
+        switch (first->reduce_op) {
+        case PIM_OPERATION::RSUM:
+            dst[0] += v;
+            break;
+        case PIM_OPERATION::RMAX:
+            if ((int16_t)v > (int16_t)dst[0]) { dst[0] = v; }
+            break;
+        default:    // RARGMAX
+            if (unit->reduce_pos[0] != PIM_NO_POSITION &&
+                (first->reduce_pos[0] == PIM_NO_POSITION || (int16_t)v > (int16_t)dst[0])) {
+                dst[0] = v;
+                memcpy(first->reduce_pos, unit->reduce_pos, 3 * UNIT_SIZE);
+            }
+        }
+        first->rf_accesses += 1;
     }
 }
 
 void PimFuncSim::SetBaseRow(BaseRow base_row) {
-    base_row_ = base_row;
+    base_row_.assign(config_.channels, base_row);
+}
+
+void PimFuncSim::SetBaseRow(int channel, BaseRow base_row) {
+    base_row_[channel] = base_row;
 }
 
 void PimFuncSim::PushCRF(PimInstruction* kernel) {
+    // count programmed entries up to and including EXIT
+    int num_insts = 0;
+    while (num_insts < config_.crf_depth && kernel[num_insts++].PIM_OP != PIM_OPERATION::EXIT) {}
+    for (int i = 0; i < config_.channels; i++) {
+        crf_insts_[i] += num_insts;
+    }
+
     PimInstruction* p = kernel;
     for (int i = 0; i < config_.channels * config_.banks / 4; i++) {
         p = kernel;
         //std::cout << "address of p is: " << std::hex << p << std::endl;
         //std::cout << "OP of p is: " << (int)((*p).PIM_OP) << std::endl;
-        for (int j = 0; j < 32; j++) {
+        for (int j = 0; j < config_.crf_depth; j++) {
             pim_unit_[i]->CRF[j] = *p;
             p++;
         }
+        // a new kernel starts from the top
+        pim_unit_[i]->PPC = 0;
+        pim_unit_[i]->LC.assign(config_.crf_depth, 0);
+    }
+}
+
+// Write SRF word column of every pim_unit of the channel (broadcast over
+// bankgroups)
+void PimFuncSim::SetSrf(int channel, int column, uint8_t* DataPtr) {
+    for (int i = 0; i < config_.bankgroups; i++) {
+        pim_unit_[channel * config_.bankgroups + i]->SetSrf(DataPtr, column % (SRF_BUFFERS * PIM_MAX_BATCH));
+    }
+    srf_writes_[channel] += 1;
+}
+
+// Write LUT word column of every pim_unit of the channel (broadcast over
+// bankgroups)
+void PimFuncSim::SetLut(int channel, int column, uint8_t* DataPtr) {
+    if (column >= LUT_WORDS) {
+        std::cerr << "LUT write to column " << column << " beyond "
+                  << LUT_WORDS << " words" << std::endl;
+        exit(1);
+    }
+    for (int i = 0; i < config_.bankgroups; i++) {
+        pim_unit_[channel * config_.bankgroups + i]->SetLut(DataPtr, column);
+    }
+}
+
+// Program CRF entries column*4 ~ column*4+3 of every pim_unit of the
+// channel (broadcast over bankgroups) from a write to the CRF row
+void PimFuncSim::WriteCRF(int channel, int column, uint8_t* DataPtr) {
+    int first = column * CRF_ENTRIES_PER_WORD;
+    if (first + CRF_ENTRIES_PER_WORD > config_.crf_depth) {
+        std::cerr << "CRF write to column " << column << " beyond crf_depth "
+                  << config_.crf_depth << std::endl;
+        exit(1);
+    }
+    for (int i = 0; i < config_.bankgroups; i++) {
+        PimUnit* unit = pim_unit_[channel * config_.bankgroups + i];
+        for (int j = 0; j < CRF_ENTRIES_PER_WORD; j++) {
+            uint64_t code;
+            memcpy(&code, DataPtr + j * CRF_ENTRY_SIZE, CRF_ENTRY_SIZE);
+            unit->CRF[first + j] = DecodePimInstruction(code);
+        }
+        // a new kernel starts from the top
+        unit->PPC = 0;
+        unit->LC.assign(config_.crf_depth, 0);
     }
+    crf_insts_[channel] += CRF_ENTRIES_PER_WORD;
 }
 
 // 528sumin --> changed the way pim_func_sim encode the command address and broadcast to all pim_units
@@ -172,7 +283,7 @@ void PimFuncSim::PIM_Read(Command cmd) {
     for (int i = 0; i < 4; i++) {
         addr.bankgroup = i;
         uint64_t base_addr = ReverseAddressMapping(addr);
-        pim_unit_[channel_ * config_.bankgroups + i]->Pim_Read(base_addr, base_row_);
+        pim_unit_[channel_ * config_.bankgroups + i]->Pim_Read(base_addr, base_row_[channel_]);
     }
 }
 
@@ -184,7 +295,7 @@ void PimFuncSim::PIM_Write(Command cmd) {
     for (int i = 0; i < 4; i++) {
         addr.bankgroup = i;
         uint64_t base_addr = ReverseAddressMapping(addr);
-        pim_unit_[channel_ * config_.bankgroups + i]->Pim_Write(base_addr, base_row_);
+        pim_unit_[channel_ * config_.bankgroups + i]->Pim_Write(base_addr, base_row_[channel_]);
     }
 }
 }
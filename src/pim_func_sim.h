@@ -12,6 +12,9 @@
 #define SB_ROW             0x3fff
 #define BG_ROW             0x3ffe
 #define ABG_ROW	    0x3ffd
+#define SRF_ROW            0x3ffb
+#define CRF_ROW            0x3ffa
+#define LUT_ROW            0x3ff9
 
 namespace dramsim3 {
 
@@ -24,15 +27,24 @@ public:
 	void PIM_Read(Command cmd);
 	void PIM_Write(Command cmd);
 	void PIM_OP(int channel);
+	void ReduceBankgroups(int channel);
 
 	std::vector<string> bankmode;
+	// bankmode as 0 (SB), 1 (BG) or 2 (ABG), for the per cycle stats
+	std::vector<int> bankmode_id;
 	std::vector<PimUnit*> pim_unit_;
 
 	void PushCRF(PimInstruction* kernel);
+	void WriteCRF(int channel, int column, uint8_t* DataPtr);
+	void SetSrf(int channel, int column, uint8_t* DataPtr);
+	void SetLut(int channel, int column, uint8_t* DataPtr);
 	
+	// base rows of every channel, or of one channel when kernels run
+	// concurrently on disjoint channels
 	void SetBaseRow(BaseRow base_row);
+	void SetBaseRow(int channel, BaseRow base_row);
 
-	BaseRow base_row_;
+	std::vector<BaseRow> base_row_;
 
 	uint8_t* pmemAddr;
 	uint64_t pmemAddr_size;
@@ -46,6 +58,11 @@ public:
 	uint64_t ReverseAddressMapping(Address& addr);
 	void init(uint8_t* pmemAddr, uint64_t pmemAddr_size, unsigned int burstSize);
 
+	// per channel programming stats, collected by the controllers
+	std::vector<uint64_t> srf_writes_;	// SRF write transactions
+	std::vector<uint64_t> crf_insts_;	// CRF entries programmed
+	std::vector<uint64_t> mode_changes_;	// effective bank mode transitions
+
 
 protected:
 	Config& config_;
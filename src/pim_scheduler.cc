@@ -0,0 +1,172 @@
+#include "pim_scheduler.h"
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "transaction_generator.h"
+
+namespace dramsim3 {
+
+PimScheduler::PimScheduler(const std::string& config_file,
+                           const std::string& output_dir)
+    : memory_system_(config_file, output_dir,
+                     std::bind(&PimScheduler::ReadCallBack, this,
+                               std::placeholders::_1, std::placeholders::_2),
+                     std::bind(&PimScheduler::WriteCallBack, this,
+                               std::placeholders::_1)),
+      config_(config_file, output_dir),
+      allocator_(SIZE_ROW * NUM_BANK, MAP_LUT),
+      clk_(0),
+      channel_used_(NUM_CHANNEL, NULL),
+      channel_shared_(NUM_CHANNEL, NULL),
+      turn_(-1),
+      is_running_(false),
+      issued_(0),
+      channel_issued_(NUM_CHANNEL, false) {
+    pmemAddr_size_ = (uint64_t)4 * 1024 * 1024 * 1024;
+    pmemAddr_ = (uint8_t*)mmap(NULL, pmemAddr_size_, PROT_READ | PROT_WRITE,
+                               MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (pmemAddr_ == (uint8_t*)MAP_FAILED) perror("mmap");
+    memory_system_.init(pmemAddr_, pmemAddr_size_, SIZE_WORD);
+}
+
+PimScheduler::~PimScheduler() { munmap(pmemAddr_, pmemAddr_size_); }
+
+void PimScheduler::Launch(TransactionGenerator* kernel, int first, int count,
+                          bool shared) {
+    if (kernel->scheduler_ != this) {
+        std::cerr << "PimScheduler: kernel was not constructed for this scheduler"
+                  << std::endl;
+        exit(1);
+    }
+    std::vector<TransactionGenerator*>& used = shared ? channel_shared_ : channel_used_;
+    for (int ch = first; ch < first + count; ch++) {
+        if (ch < 0 || ch >= NUM_CHANNEL || used[ch] != NULL) {
+            std::cerr << "PimScheduler: channel " << ch
+                      << " is not free for another kernel" << std::endl;
+            exit(1);
+        }
+        used[ch] = kernel;
+    }
+    kernel->SetChannels(first, count);
+    kernel->shared_ = shared;
+    kernel->scheduler_ = this;
+    kernels_.push_back(kernel);
+    // launched by a kernel that is done, starts in the same cycle
+    if (is_running_) {
+        running_.push_back(true);
+        threads_.push_back(
+            std::thread(&PimScheduler::RunKernel, this, (int)kernels_.size() - 1));
+    }
+}
+
+uint64_t PimScheduler::Run() {
+    uint64_t start_clk = clk_;
+    {
+        // kernels wait for their turn until every thread is in threads_
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_running_ = true;
+        running_.assign(kernels_.size(), true);
+        turn_ = kernels_.empty() ? -1 : 0;
+        for (size_t i = 0; i < kernels_.size(); i++) {
+            threads_.push_back(std::thread(&PimScheduler::RunKernel, this, (int)i));
+        }
+    }
+    // threads_ grows while kernels launch others from KernelDone, the
+    // last one is known once every thread before it is done
+    for (size_t i = 0;; i++) {
+        std::thread thread;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (i == threads_.size()) break;
+            thread = std::move(threads_[i]);
+        }
+        thread.join();
+    }
+
+    // the kernels keep the memory for CheckResult and PrintStats
+    is_running_ = false;
+    threads_.clear();
+    kernels_.clear();
+    channel_used_.assign(NUM_CHANNEL, NULL);
+    channel_shared_.assign(NUM_CHANNEL, NULL);
+    return clk_ - start_clk;
+}
+
+// issue slots of the host are shared by every kernel, mutex_ is not needed
+// as only the kernel with the turn issues
+bool PimScheduler::TakeIssueSlot(int channel) {
+    if (issued_ == config_.host_issue_width || channel_issued_[channel])
+        return false;
+    issued_++;
+    channel_issued_[channel] = true;
+    return true;
+}
+
+// a done transaction goes to the kernels running on its channel, they
+// skip the addresses they did not request
+void PimScheduler::ReadCallBack(uint64_t addr, uint8_t* DataPtr) {
+    int channel = config_.AddressMapping(addr).channel;
+    if (channel_used_[channel] != NULL) channel_used_[channel]->ReadCallBack(addr, DataPtr);
+    if (channel_shared_[channel] != NULL) channel_shared_[channel]->ReadCallBack(addr, DataPtr);
+}
+
+void PimScheduler::WriteCallBack(uint64_t addr) {
+    int channel = config_.AddressMapping(addr).channel;
+    if (channel_used_[channel] != NULL) channel_used_[channel]->WriteCallBack(addr);
+    if (channel_shared_[channel] != NULL) channel_shared_[channel]->WriteCallBack(addr);
+}
+
+void PimScheduler::RunKernel(int slot) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return turn_ == slot; });
+    }
+    TransactionGenerator* kernel = kernels_[slot];
+    kernel->Initialize();
+    kernel->SetData();
+    kernel->Execute();
+    kernel->GetResult();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_[slot] = false;
+    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        if (channel_used_[ch] == kernel) channel_used_[ch] = NULL;
+        if (channel_shared_[ch] == kernel) channel_shared_[ch] = NULL;
+    }
+    KernelDone(kernel);
+    Pass(slot);
+}
+
+void PimScheduler::Tick(TransactionGenerator* kernel) {
+    int slot = 0;
+    while (kernels_[slot] != kernel) slot++;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Pass(slot);
+    cv_.wait(lock, [&] { return turn_ == slot; });
+}
+
+void PimScheduler::Pass(int slot) {
+    int num_kernels = (int)kernels_.size();
+    for (int i = 1; i <= num_kernels; i++) {
+        int next = (slot + i) % num_kernels;
+        if (!running_[next]) continue;
+        // every running kernel had its turn in this cycle
+        if (next <= slot) {
+            memory_system_.ClockTick();
+            clk_++;
+            issued_ = 0;
+            channel_issued_.assign(NUM_CHANNEL, false);
+        }
+        turn_ = next;
+        cv_.notify_all();
+        return;
+    }
+    turn_ = -1;
+    cv_.notify_all();
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,96 @@
+#ifndef __PIM_SCHEDULER_H
+#define __PIM_SCHEDULER_H
+
+#include <sys/mman.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./configuration.h"
+#include "./memory_system.h"
+#include "./pim_allocator.h"
+
+namespace dramsim3 {
+
+class TransactionGenerator;
+
+// Runs kernels at the same time on disjoint channel groups of one memory,
+// e.g. ADD on channels 0-7 and GEMV on channels 8-15, or host traffic
+// (HostTransactionGenerator) next to a PIM kernel. Bank mode, base rows and
+// CRF are per channel, so the kernels do not see each other.
+//  Every kernel runs Initialize, SetData, Execute and GetResult in a thread
+//  of its own, but one thread runs at a time: a kernel issues its
+//  transactions of the cycle and hands over at its next Tick(), the memory
+//  ticks once every running kernel did. Runs are deterministic.
+class PimScheduler {
+   public:
+    PimScheduler(const std::string& config_file, const std::string& output_dir);
+
+    virtual ~PimScheduler();
+
+    // Run kernel on channels first ~ first+count-1 at the next Run(), or
+    // right away when called from KernelDone. kernel is constructed with
+    // this scheduler, count is a power of two and first a multiple of count.
+    // A shared kernel is host traffic in SB mode that may use the channels
+    // of another kernel too, it issues to such a channel only while the
+    // channel is in SB mode (e.g. while the kernel writes its operands)
+    void Launch(TransactionGenerator* kernel, int first, int count,
+                bool shared = false);
+    // Run the launched kernels to the end, returns the cycles it took
+    uint64_t Run();
+
+    uint64_t GetClk() const { return clk_; }
+    void PrintStats() { memory_system_.PrintStats(); }
+    // placement of every kernel launched here, buffers from it may be bound
+    // to operands of several kernels (TransactionGenerator::Bind). Delete
+    // the kernels before the scheduler
+    PimAllocator& GetAllocator() { return allocator_; }
+
+   protected:
+    // kernel is done and its channels are free again. Runs in the cycle
+    // the kernel ended in with mutex_ held, may Launch further kernels
+    virtual void KernelDone(TransactionGenerator* kernel) {}
+    bool IsChannelFree(int channel) const {
+        return channel_used_[channel] == NULL;
+    }
+
+   private:
+    friend class TransactionGenerator;
+
+    void Tick(TransactionGenerator* kernel);
+    bool TakeIssueSlot(int channel);
+    void ReadCallBack(uint64_t addr, uint8_t* DataPtr);
+    void WriteCallBack(uint64_t addr);
+    void RunKernel(int slot);
+    // hand the turn to the next running kernel, mutex_ held
+    void Pass(int slot);
+
+    MemorySystem memory_system_;
+    Config config_;
+    uint8_t* pmemAddr_;
+    uint64_t pmemAddr_size_;
+    PimAllocator allocator_;
+    uint64_t clk_;
+
+    std::vector<TransactionGenerator*> kernels_;
+    std::vector<std::thread> threads_;
+    std::vector<bool> running_;
+    // kernel launched on every channel, NULL when the channel is free
+    std::vector<TransactionGenerator*> channel_used_;
+    // shared kernel of every channel, NULL when there is none
+    std::vector<TransactionGenerator*> channel_shared_;
+    int turn_;  // slot of the kernel that may run, -1 when all are done
+    bool is_running_;
+    // issue slots of the host taken in this cycle
+    int issued_;
+    std::vector<bool> channel_issued_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+}  // namespace dramsim3
+
+#endif  // __PIM_SCHEDULER_H
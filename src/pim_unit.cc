@@ -5,7 +5,8 @@ namespace dramsim3 {
 
 PimUnit::PimUnit(Config& config, int id) : pim_id(id), config_(config) {
 	PPC = 0;
-	LC = 0;
+	CRF.resize(config_.crf_depth);
+	LC.assign(config_.crf_depth, 0);
 	operand_cache = 0;
 
 	// initialize Cache's
@@ -14,6 +15,11 @@ PimUnit::PimUnit(Config& config, int id) : pim_id(id), config_(config) {
 	SRF_ = (unit_t*)malloc(SRF_SIZE);
 	// initialize ACC
 	ACC_ = (unit_t*)malloc(ACC_SIZE);
+	// initialize GRF's
+	GRF_A_ = (unit_t*)malloc(GRF_ENTRIES * WORD_SIZE);
+	GRF_B_ = (unit_t*)malloc(GRF_ENTRIES * WORD_SIZE);
+	// initialize LUT
+	LUT_ = (unit_t*)malloc(LUT_SIZE);
 	
 
 	for (int i = 0; i < (CACHE_SIZE / (int)sizeof(unit_t)); i++) {
@@ -25,10 +31,23 @@ PimUnit::PimUnit(Config& config, int id) : pim_id(id), config_(config) {
 	for (int i = 0; i < (ACC_SIZE / (int)sizeof(unit_t)); i++) {
 		ACC_[i] = 0;
 	}
+	for (int i = 0; i < GRF_ENTRIES * UNITS_PER_WORD; i++) {
+		GRF_A_[i] = 0;
+		GRF_B_[i] = 0;
+	}
+	for (int i = 0; i < (LUT_SIZE / (int)sizeof(unit_t)); i++) {
+		LUT_[i] = 0;
+	}
 	
 	for (int i = 0; i < 8; i++){cache_dirty[i]=false; cache_aam[i] = 0;}
+	cmd_aam[0] = cmd_aam[1] = 0;
+	cmd_word[0] = cmd_word[1] = 0;
+	reduce_op = PIM_OPERATION::NOP;
+	reduce_dst = NULL;
+	reduce_pos = NULL;
 
 	cache_written = false;
+	ResetStats();
 	
 	idle_row = IDLE_ROW << (config_.ro_pos + config_.shift_bits); // 528sumin use idle row instead of -1
 }
@@ -40,13 +59,31 @@ void PimUnit::init(uint8_t* pmemAddr, uint64_t pmemAddr_size, unsigned int burst
 	burstSize_ = burstSize;
 	operand_cache = 0;
 	PPC = 0;
-	LC = 0;
+	LC.assign(config_.crf_depth, 0);
 	cache_written = false;
 	for (int i = 0; i < 8; i++){cache_dirty[i]=false;}
 }
 
-void PimUnit::SetSrf(uint8_t* DataPtr){
-    memcpy(SRF_, DataPtr, SRF_SIZE);
+void PimUnit::ResetStats() {
+	for (int i = 0; i < NUM_PIM_OPERATIONS; i++) {
+		inst_count[i] = 0;
+	}
+	idle_slots = 0;
+	bank_read_bytes = 0;
+	bank_write_bytes = 0;
+	rf_accesses = 0;
+}
+
+// slot: SRF word of the batch vector in the buffer, selected by the column
+// of the write (slot / PIM_MAX_BATCH is the buffer)
+void PimUnit::SetSrf(uint8_t* DataPtr, int slot){
+    memcpy(SRF_ + slot * UNITS_PER_WORD, DataPtr, WORD_SIZE);
+    rf_accesses += 1;
+}
+
+// column: LUT word, see LUT_SEGMENTS
+void PimUnit::SetLut(uint8_t* DataPtr, int column){
+    memcpy(LUT_ + column * UNITS_PER_WORD, DataPtr, WORD_SIZE);
 }
 
 bool PimUnit::PIM_OP() {
@@ -54,6 +91,7 @@ bool PimUnit::PIM_OP() {
 	// the other is used for banks to R/W
 	// change operand cache at every PIM_OP
 	operand_cache = !operand_cache ? 1 : 0;
+	reduce_dst = NULL;
 
 	// PIM_READ has read some and stored in cache
 	// if there were no PIM_READ -> Cache is not updated -> cache_written is 0
@@ -65,24 +103,29 @@ bool PimUnit::PIM_OP() {
 		// Point to next PIM_INSTRUCTION
 		PPC += 1;
 	}
+	else {
+		idle_slots += 1;
+	}
 
-	// Deal with PIM operation NOP & JUMP
-	//  Performed by using LC(Loop Counter)
+	// Deal with PIM operation JUMP
+	//  Performed by using LC(Loop Counter), one per JUMP so loops can nest
 	//  LC copies the number of iterations and gets lower by 1 when executed
 	//  Repeats until LC gets to 1 and escapes the iteration
-	if (CRF[PPC].PIM_OP == PIM_OPERATION::JUMP) {
-		if (LC == 0) {
-			LC = CRF[PPC].imm1_;
-			PPC += (uint8_t)CRF[PPC].imm0_;
-		}
-		else if (LC > 1) {
-			PPC += (uint8_t)CRF[PPC].imm0_;
-			LC -= 1;
-		}
-		else if (LC == 1) {
+	//  An inner loop falling through to an outer JUMP is resolved at once
+	while (CRF[PPC].PIM_OP == PIM_OPERATION::JUMP) {
+		int& lc = LC[PPC];
+		if (lc == 1) {
+			lc = 0;
 			PPC += 1;
-			LC = 0;
+			continue;
 		}
+		lc = (lc == 0) ? CRF[PPC].imm1_ : lc - 1;
+		bool yield = CRF[PPC].dst_ == 1;
+		PPC += CRF[PPC].imm0_;
+		// JUMP YIELD: back to ABG so that the host can write SRF, the
+		// kernel goes on from PPC in the next BG mode
+		if (yield) { return true; }
+		break;
 	}
 
 	// When pointed PIM_INSTRUCTION is EXIT, kernel is finished
@@ -96,24 +139,81 @@ bool PimUnit::PIM_OP() {
 }
 
 void PimUnit::Execute() {
-	// currently only support ADD
+	inst_count[(int)CRF[PPC].PIM_OP] += 1;
 	switch (CRF[PPC].PIM_OP) {
 	case PIM_OPERATION::ADD:
-		_ADD();
-		break;
 	case PIM_OPERATION::MUL:
-		_MUL();
+		if (CRF[PPC].is_reg_) { _REG(); }
+		else if (CRF[PPC].PIM_OP == PIM_OPERATION::ADD) { _ADD(); }
+		else { _MUL(); }
+		rf_accesses += 3;
+		break;
+	case PIM_OPERATION::MAC:
+		_REG();
+		rf_accesses += 4;	// dst is read as well
+		break;
+	case PIM_OPERATION::MAD:
+		_REG();
+		rf_accesses += 4;
+		break;
+	case PIM_OPERATION::MOV:
+	case PIM_OPERATION::FILL:
+		_MOV();
+		rf_accesses += 2;
+		break;
+	case PIM_OPERATION::RELU:
+		_ACT();
+		rf_accesses += 2;
+		break;
+	case PIM_OPERATION::CLAMP:
+		_ACT();
+		rf_accesses += 4;
+		break;
+	case PIM_OPERATION::LUT:
+		_ACT();
+		rf_accesses += 4;	// intercept and slope from the LUT
+		break;
+	case PIM_OPERATION::MAX:
+	case PIM_OPERATION::QMUL:
+		_REG();
+		rf_accesses += 3;
+		break;
+	case PIM_OPERATION::QMAC:
+		_REG();
+		rf_accesses += 4;	// dst is read as well
+		break;
+	case PIM_OPERATION::ARGMAX:
+		_ARGMAX();
+		rf_accesses += 5;	// value and position are read and written
+		break;
+	case PIM_OPERATION::RSUM:
+	case PIM_OPERATION::RMAX:
+		_RED();
+		rf_accesses += 2;
+		break;
+	case PIM_OPERATION::RARGMAX:
+		_RED();
+		rf_accesses += 4;
 		break;
 	case PIM_OPERATION::BN:
 	        _BN();
+		rf_accesses += 4;
 	        break;
 	case PIM_OPERATION::GEMV:
 		_GEMV();
+		rf_accesses += 5;	// 2 banks, SRF, ACC read and write
+		if (CRF[PPC].imm0_ > 1) {
+			// every further vector of the batch: SRF, ACC read and write
+			inst_count[(int)PIM_OPERATION::GEMV] += CRF[PPC].imm0_ - 1;
+			rf_accesses += 3 * (CRF[PPC].imm0_ - 1);
+		}
 		break;
 	case PIM_OPERATION::LD: // load to cache, nothing to calculate
+	case PIM_OPERATION::NOP:
 		break;
 	case PIM_OPERATION::ST: // store cache with ACC
 		_ST();
+		rf_accesses += 2;
 	        break;
 	default:
 		std::cout << "not add" << std::endl;
@@ -146,6 +246,12 @@ void PimUnit::Pim_Read(uint64_t hex_addr, BaseRow base_row){
 	
 	uint64_t ba_offset = 0;
 
+	// AAM indices: column, and row parity at bit 5
+	uint64_t cmd_col = (hex_addr >> (config_.co_pos + config_.shift_bits)) & 0x1f;
+	uint64_t cmd_row = (hex_addr >> (config_.ro_pos + config_.shift_bits)) & 1;
+	cmd_aam[RW_cache_index] = (uint8_t)(cmd_col | (cmd_row << 5));
+	cmd_word[RW_cache_index] = (uint16_t)((config_.AddressMapping(hex_addr).row << 5) | cmd_col);
+
 	if (source_bank & 0b1){
 		if (base_row.ba0_ == idle_row) {  // 528sumin use idle row
 			std::cerr << "ba0 not a valid base row_R" << std::endl;
@@ -154,6 +260,8 @@ void PimUnit::Pim_Read(uint64_t hex_addr, BaseRow base_row){
 		ba_offset = (uint64_t)0 << (config_.ba_pos + config_.shift_bits);
 		source_addr = hex_addr + base_row.ba0_ + ba_offset;	
 		memcpy((CACHE_+(RW_cache_index*UNITS_PER_WORD)), pmemAddr_ + source_addr, WORD_SIZE);
+		bank_read_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_written = true;
 		cache_aam[RW_cache_index] = (uint8_t)((source_addr >> (config_.co_pos + config_.shift_bits)) & 0x3f);
 	}
@@ -165,6 +273,8 @@ void PimUnit::Pim_Read(uint64_t hex_addr, BaseRow base_row){
 		ba_offset = (uint64_t)1 << (config_.ba_pos + config_.shift_bits);
 		source_addr = hex_addr + base_row.ba1_ + ba_offset;
 		memcpy((CACHE_ + (1 * 2 + RW_cache_index) * UNITS_PER_WORD), pmemAddr_ + source_addr, WORD_SIZE);
+		bank_read_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_written = true;
 		cache_aam[RW_cache_index+2] = (uint8_t)((source_addr >> (config_.co_pos + config_.shift_bits)) & 0x3f);
 	}
@@ -176,6 +286,8 @@ void PimUnit::Pim_Read(uint64_t hex_addr, BaseRow base_row){
 		ba_offset = (uint64_t)2 << (config_.ba_pos + config_.shift_bits);
 		source_addr = hex_addr + base_row.ba2_ + ba_offset;
 		memcpy((CACHE_ + (2 * 2 + RW_cache_index) * UNITS_PER_WORD), pmemAddr_ + source_addr, WORD_SIZE);
+		bank_read_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_written = true;
 		cache_aam[RW_cache_index+4] = (uint8_t)((source_addr >> (config_.co_pos + config_.shift_bits)) & 0x3f);
 	}
@@ -187,6 +299,8 @@ void PimUnit::Pim_Read(uint64_t hex_addr, BaseRow base_row){
 		ba_offset = (uint64_t)3 << (config_.ba_pos + config_.shift_bits);
 		source_addr = hex_addr + base_row.ba3_ + ba_offset;
 		memcpy((CACHE_ + (3 * 2 + RW_cache_index) * UNITS_PER_WORD), pmemAddr_ + source_addr, WORD_SIZE);
+		bank_read_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_written = true;
 		cache_aam[RW_cache_index+6] = (uint8_t)((source_addr >> (config_.co_pos + config_.shift_bits)) & 0x3f);
 	}
@@ -207,7 +321,7 @@ void PimUnit::Pim_Write(uint64_t hex_addr, BaseRow base_row) {
 		if (base_row.ba0_ == idle_row) {
 			std::cerr << "ba0 not a valid base row_W" << std::endl;
 			std::cout << "PPC at error: " << (int)PPC << std::endl;
-		        std::cout << "LC at error: " << LC << std::endl;
+		        std::cout << "LC at error: " << LC[PPC] << std::endl;
 			exit(1);
 		}
 		ba_offset = (uint64_t)0 << (config_.ba_pos + config_.shift_bits);
@@ -215,6 +329,8 @@ void PimUnit::Pim_Write(uint64_t hex_addr, BaseRow base_row) {
 		//if(!pim_id){std::cout << "drain addr: " << std::hex << drain_addr << std::endl;}
 		//if(!pim_id){std::cout << "in cache: " << *((uint16_t*)(CACHE_ + (RW_cache_index * UNITS_PER_WORD))) << std::endl;}
 		memcpy(pmemAddr_ + drain_addr, (CACHE_ + (RW_cache_index * UNITS_PER_WORD)), WORD_SIZE);
+		bank_write_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_dirty[RW_cache_index] = false;
 	}
 	else if (cache_dirty[RW_cache_index + 2]) {
@@ -227,6 +343,8 @@ void PimUnit::Pim_Write(uint64_t hex_addr, BaseRow base_row) {
 		//if(!pim_id){std::cout << "drain addr: " << std::hex << drain_addr << std::endl;}
 		//if(!pim_id){std::cout << "base ba1 z: " << std::hex << base_row.ba1_ << std::endl;}
 		memcpy(pmemAddr_ + drain_addr, (CACHE_ + (1 * 2 + RW_cache_index) * UNITS_PER_WORD), WORD_SIZE);
+		bank_write_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_dirty[RW_cache_index + 2] = false;
 	}
 	else if (cache_dirty[RW_cache_index + 4]) {
@@ -238,6 +356,8 @@ void PimUnit::Pim_Write(uint64_t hex_addr, BaseRow base_row) {
 		drain_addr = hex_addr + base_row.ba2_ + ba_offset;
 		//if(!pim_id){std::cout << "drain addr: " << std::hex << drain_addr << std::endl;}
 		memcpy(pmemAddr_ + drain_addr, (CACHE_ + (2 * 2 + RW_cache_index) * UNITS_PER_WORD), WORD_SIZE);
+		bank_write_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_dirty[RW_cache_index + 4] = false;
 	}
 	else if (cache_dirty[RW_cache_index + 6]) {
@@ -249,6 +369,8 @@ void PimUnit::Pim_Write(uint64_t hex_addr, BaseRow base_row) {
 		drain_addr = hex_addr + base_row.ba3_ + ba_offset;
 		//if(!pim_id){std::cout << "drain addr: " << std::hex << drain_addr << std::endl;}
 		memcpy(pmemAddr_ + drain_addr, (CACHE_ + (3 * 2 + RW_cache_index) * UNITS_PER_WORD), WORD_SIZE);
+		bank_write_bytes += WORD_SIZE;
+		rf_accesses += 1;
 		cache_dirty[RW_cache_index + 6] = false;
 	}
 }
@@ -354,9 +476,195 @@ void PimUnit::_GEMV(){
 	}
 	else{ std::cerr << "gemv dst not properly set\n"; exit(1); }
 	
-	//std::cout << "SRF? " << SRF_[vec_index*2] << std::endl;
+	// imm0_ > 1: batched GEMV, vector b uses SRF word b and ACC word
+	// (dst_ - 4) + 2 * b, the bank words are read once for all vectors.
+	// imm1_ selects the SRF buffer
+	int batch = CRF[PPC].imm0_ > 1 ? CRF[PPC].imm0_ : 1;
+	unit_t* srf_buf = SRF_ + CRF[PPC].imm1_ * PIM_MAX_BATCH * UNITS_PER_WORD;
+	for (int b = 0; b < batch; b++) {
+		unit_t* srf = srf_buf + b * UNITS_PER_WORD;
+		unit_t* acc = dst + b * 2 * UNITS_PER_WORD;
+		//std::cout << "SRF? " << srf[vec_index*2] << std::endl;
+		for (int i = 0; i < 16; i++) {
+			acc[i] += src0[i] * srf[vec_index*2] + src1[i] * srf[vec_index*2+1];
+		}
+	}
+}
+
+// register operand of the current instruction, GRF index from AAM if set
+unit_t* PimUnit::Operand(const PimOperand& op, bool is_dst) {
+	int aam = cmd_aam[operand_cache];
+	int idx = op.idx_;
+	switch (op.type_) {
+	case PIM_OPERAND::BANK0:
+	case PIM_OPERAND::BANK1:
+	case PIM_OPERAND::BANK2:
+	case PIM_OPERAND::BANK3:
+		if (is_dst) { cache_dirty[op.Bank() * 2 + operand_cache] = true; }
+		return CACHE_ + (op.Bank() * 2 + operand_cache) * UNITS_PER_WORD;
+	case PIM_OPERAND::GRF_A:
+		if (CRF[PPC].is_aam_) { idx = aam & 0b111; }
+		return GRF_A_ + (idx % GRF_ENTRIES) * UNITS_PER_WORD;
+	case PIM_OPERAND::GRF_B:
+		if (CRF[PPC].is_aam_) { idx = ((aam >> 3) & 0b11) + ((aam >> 5) & 1) * 4; }
+		return GRF_B_ + (idx % GRF_ENTRIES) * UNITS_PER_WORD;
+	case PIM_OPERAND::SRF_M:
+		if (is_dst) { break; }
+		return SRF_ + (idx % SRF_ENTRIES);
+	case PIM_OPERAND::SRF_A:
+		if (is_dst) { break; }
+		return SRF_ + SRF_ENTRIES + (idx % SRF_ENTRIES);
+	default:
+		break;
+	}
+	std::cerr << "not proper operand " << (int)op.type_ << " at PPC " << (int)PPC << std::endl;
+	exit(1);
+}
+
+// ADD, MUL, MAC, MAD, MAX, QMUL, QMAC on register operands, SRF sources are
+// broadcast
+void PimUnit::_REG() {
+	const PimInstruction& inst = CRF[PPC];
+	unit_t* src0 = Operand(inst.src0_op_, false);
+	unit_t* src1 = Operand(inst.src1_op_, false);
+	unit_t* src2 = inst.PIM_OP == PIM_OPERATION::MAD ? Operand(inst.src2_op_, false) : NULL;
+	int step1 = inst.src1_op_.IsScalar() ? 0 : 1;
+	int step2 = inst.src2_op_.IsScalar() ? 0 : 1;
+	unit_t* dst = Operand(inst.dst_op_, true);
+
+	for (int i = 0; i < 16; i++) {
+		unit_t a = src0[i];
+		unit_t b = src1[i * step1];
+		switch (inst.PIM_OP) {
+		case PIM_OPERATION::ADD:
+			dst[i] = a + b;
+			break;
+		case PIM_OPERATION::MUL:
+			dst[i] = a * b;
+			break;
+		case PIM_OPERATION::MAC:
+			dst[i] += a * b;
+			break;
+		case PIM_OPERATION::MAX:
+			dst[i] = (int16_t)a > (int16_t)b ? a : b;
+			break;
+		case PIM_OPERATION::QMUL:
+			dst[i] = PimMulQ(a, b);
+			break;
+		case PIM_OPERATION::QMAC:
+			dst[i] = PimMulQ(a, b, dst[i]);
+			break;
+		default:	// MAD
+			dst[i] = a * b + src2[i * step2];
+		}
+	}
+}
+
+// MOV and FILL: copy a word between banks and GRF, an SRF source is broadcast
+void PimUnit::_MOV() {
+	unit_t* src = Operand(CRF[PPC].src0_op_, false);
+	unit_t* dst = Operand(CRF[PPC].dst_op_, true);
+	int step = CRF[PPC].src0_op_.IsScalar() ? 0 : 1;
+	for (int i = 0; i < 16; i++) {
+		dst[i] = src[i * step];
+	}
+}
+
+// RELU, CLAMP and LUT on lanes as signed Q8.8, SRF bounds are broadcast
+void PimUnit::_ACT() {
+	const PimInstruction& inst = CRF[PPC];
+	unit_t* src = Operand(inst.src0_op_, false);
+	unit_t* lo = inst.PIM_OP == PIM_OPERATION::CLAMP ? Operand(inst.src1_op_, false) : NULL;
+	unit_t* hi = inst.PIM_OP == PIM_OPERATION::CLAMP ? Operand(inst.src2_op_, false) : NULL;
+	int step1 = inst.src1_op_.IsScalar() ? 0 : 1;
+	int step2 = inst.src2_op_.IsScalar() ? 0 : 1;
+	unit_t* dst = Operand(inst.dst_op_, true);
+
 	for (int i = 0; i < 16; i++) {
-		dst[i] += src0[i] * SRF_[vec_index*2] + src1[i] * SRF_[vec_index*2+1];
+		int16_t v = (int16_t)src[i];
+		switch (inst.PIM_OP) {
+		case PIM_OPERATION::RELU:
+			dst[i] = v < 0 ? 0 : (unit_t)v;
+			break;
+		case PIM_OPERATION::CLAMP:
+			if (v < (int16_t)lo[i * step1]) { v = (int16_t)lo[i * step1]; }
+			if (v > (int16_t)hi[i * step2]) { v = (int16_t)hi[i * step2]; }
+			dst[i] = (unit_t)v;
+			break;
+		default:	// LUT
+			dst[i] = PimLutLookup(LUT_, src[i]);
+		}
+	}
+}
+
+// ARGMAX: lanes of the dst GRF_A word keep the max (signed) of the bank
+// words seen, the same GRF_B word their position, row * 32 + column of the
+// command times 4 plus the bank. The first one wins on a tie
+void PimUnit::_ARGMAX() {
+	const PimInstruction& inst = CRF[PPC];
+	unit_t* src = Operand(inst.src0_op_, false);
+	unit_t* acc = Operand(inst.dst_op_, true);
+	unit_t* pos = GRF_B_ + (acc - GRF_A_);
+	unit_t p = (unit_t)(cmd_word[operand_cache] * 4 + inst.src0_op_.Bank());
+	for (int i = 0; i < 16; i++) {
+		if (pos[i] == PIM_NO_POSITION || (int16_t)src[i] > (int16_t)acc[i]) {
+			acc[i] = src[i];
+			pos[i] = p;
+		}
+	}
+}
+
+// RSUM, RMAX, RARGMAX: tree reduce over the lanes of src0 into lane 0 of
+// dst, the other lanes are cleared. RARGMAX reduces a GRF_A word with the
+// positions in GRF_B (see _ARGMAX) and leaves position, lane and bankgroup
+// in lanes 0-2 of the GRF_B word of dst, the lower position wins on a tie
+void PimUnit::_RED() {
+	const PimInstruction& inst = CRF[PPC];
+	PIM_OPERATION op = inst.PIM_OP;
+	unit_t* src = Operand(inst.src0_op_, false);
+	unit_t* dst = Operand(inst.dst_op_, true);
+	unit_t val[16], pos[16], lane[16];
+	for (int i = 0; i < 16; i++) {
+		val[i] = src[i];
+		pos[i] = op == PIM_OPERATION::RARGMAX ? GRF_B_[(src - GRF_A_) + i] : 0;
+		lane[i] = (unit_t)i;
+	}
+	for (int s = 8; s > 0; s >>= 1) {
+		for (int i = 0; i < s; i++) {
+			int j = i + s;
+			if (op == PIM_OPERATION::RSUM) {
+				val[i] += val[j];
+				continue;
+			}
+			bool take = (int16_t)val[j] > (int16_t)val[i];
+			if (op == PIM_OPERATION::RARGMAX && pos[j] != PIM_NO_POSITION) {
+				take = take || pos[i] == PIM_NO_POSITION ||
+					(val[j] == val[i] && pos[j] < pos[i]);
+			}
+			else if (op == PIM_OPERATION::RARGMAX) {
+				take = false;
+			}
+			if (take) {
+				val[i] = val[j];
+				pos[i] = pos[j];
+				lane[i] = lane[j];
+			}
+		}
+	}
+	for (int i = 0; i < 16; i++) {
+		dst[i] = i == 0 ? val[0] : 0;
+	}
+	reduce_op = op;
+	reduce_dst = dst;
+	reduce_pos = NULL;
+	if (op == PIM_OPERATION::RARGMAX) {
+		reduce_pos = GRF_B_ + (dst - GRF_A_);
+		for (int i = 0; i < 16; i++) {
+			reduce_pos[i] = 0;
+		}
+		reduce_pos[0] = pos[0];
+		reduce_pos[1] = lane[0];
+		reduce_pos[2] = (unit_t)(pim_id % config_.bankgroups);
 	}
 }
 
@@ -368,6 +676,7 @@ void PimUnit::_ST(){
 	cache_dirty[CRF[PPC].dst_ * 2 + operand_cache] = true;
 	
 	src = ACC_ + UNITS_PER_WORD * (CRF[PPC].dst_ & 1); // src is ACC[0] when dst even, ACC[1] when dst odd
+	src += 2 * UNITS_PER_WORD * CRF[PPC].imm0_; // imm0_: vector of a batched GEMV
 	
 	for (int i = 0; i < 16; i++) {
 		dst[i] = src[i];
@@ -24,22 +24,25 @@ public:
 	PimUnit(Config& config, int id);
 	void init(uint8_t* pmemAddr, uint64_t pmemAddr_size, unsigned int burstSize);
 
-	uint8_t PPC; // program counter
-	int LC;
+	int PPC; // program counter
+	std::vector<int> LC; // loop counter of the JUMP at each CRF entry
 	int pim_id;
 
 	bool cache_written = false;
 	bool cache_dirty[8];
 	uint8_t cache_aam[8];
+	uint8_t cmd_aam[2];	// column and row parity of the command that filled cache
+	uint16_t cmd_word[2];	// row * 32 + column of that command, for ARGMAX
 
-	PimInstruction CRF[32];
+	std::vector<PimInstruction> CRF;
 
 	void Pim_Read(uint64_t hex_addr, BaseRow base_row);
 	bool PIM_OP();
 	void Pim_Write(uint64_t hex_addr, BaseRow base_row);
 	void Execute();
 	
-	void SetSrf(uint8_t* DataPtr);
+	void SetSrf(uint8_t* DataPtr, int slot = 0);
+	void SetLut(uint8_t* DataPtr, int column);
 
 	unsigned GetSourceBank();
 
@@ -48,19 +51,44 @@ public:
 	void _BN();
 	void _GEMV();
 	void _ST();
+	void _REG();
+	void _MOV();
+	void _ACT();
+	void _ARGMAX();
+	void _RED();
+
+	// lane 0 of the last RSUM, RMAX or RARGMAX (and its position word), the
+	// channel combines it over the bankgroups. reduce_dst is NULL after any
+	// other instruction
+	PIM_OPERATION reduce_op;
+	unit_t* reduce_dst;
+	unit_t* reduce_pos;
 
 	unit_t* CACHE_;
 	unit_t* SRF_;
 	unit_t* ACC_;
+	unit_t* GRF_A_;
+	unit_t* GRF_B_;
+	unit_t* LUT_;
 
 	uint8_t* pmemAddr_;
 	uint64_t pmemAddr_size_;
 	unsigned int burstSize_;
 
+	// stats since last ResetStats(), collected by the channel's controller
+	uint64_t inst_count[NUM_PIM_OPERATIONS];
+	uint64_t idle_slots;		// PIM_OP without operands in cache
+	uint64_t bank_read_bytes;	// bank -> cache
+	uint64_t bank_write_bytes;	// cache -> bank
+	uint64_t rf_accesses;		// cache/SRF/ACC word reads and writes
+	void ResetStats();
+
 protected:
 	Config& config_;
 
 private:
+	unit_t* Operand(const PimOperand& op, bool is_dst);
+
 	unsigned operand_cache;
 	uint64_t idle_row;
 };
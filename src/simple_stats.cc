@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "fmt/format.h"
+#include "pim_config.h"
 #include "simple_stats.h"
 
 namespace dramsim3 {
@@ -37,12 +38,29 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
     InitStat("num_srefx_cmds", "counter", "Number of SREFX commands");
     InitStat("hbm_dual_cmds", "counter", "Number of cycles dual cmds issued");
 
+    // PIM counters
+    InitStat("sb_mode_cycles", "counter", "Cycles in SB mode");
+    InitStat("abg_mode_cycles", "counter", "Cycles in ABG mode");
+    InitStat("bg_mode_cycles", "counter", "Cycles in BG (PIM) mode");
+    InitStat("pim_mode_changes", "counter", "Number of bank mode changes");
+    InitStat("pim_srf_writes", "counter", "Number of SRF write transactions");
+    InitStat("pim_crf_insts", "counter", "Number of CRF entries programmed");
+    InitStat("pim_internal_bytes", "counter",
+             "Bytes moved between banks and PIM caches");
+    InitStat("pim_rf_accesses", "counter",
+             "Number of PIM register file word accesses");
+    InitStat("pim_throttle_cycles", "counter",
+             "Cycles BG mode commands were held by the thermal throttle");
+
     // double stats
     InitStat("act_energy", "double", "Activation energy");
     InitStat("read_energy", "double", "Read energy");
     InitStat("write_energy", "double", "Write energy");
     InitStat("ref_energy", "double", "Refresh energy");
     InitStat("refb_energy", "double", "Refresh-bank energy");
+    InitStat("pim_alu_energy", "double", "PIM ALU energy");
+    InitStat("pim_rf_energy", "double", "PIM register file energy");
+    InitStat("pim_mode_energy", "double", "PIM bank mode change energy");
 
     // Vector counter stats
     InitVecStat("all_bank_idle_cycles", "vec_counter",
@@ -51,6 +69,16 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
                 "rank", config_.ranks);
     InitVecStat("sref_cycles", "vec_counter", "Cyles of rank in SREF mode",
                 "rank", config_.ranks);
+    // one PimUnit per bankgroup, JUMP/NOP/EXIT are not executed by the ALU
+    for (int op = (int)PIM_OPERATION::LD; op < NUM_PIM_OPERATIONS; op++) {
+        std::string op_name = PimOperationName((PIM_OPERATION)op);
+        InitVecStat("pim_" + op_name + "_insts", "vec_counter",
+                    "Number of " + op_name + " instructions executed",
+                    "pim_unit", config_.bankgroups);
+    }
+    InitVecStat("pim_idle_slots", "vec_counter",
+                "PIM_OP slots without operands", "pim_unit",
+                config_.bankgroups);
 
     // Vector of double stats
     InitVecStat("act_stb_energy", "vec_double", "Active standby energy", "rank",
@@ -68,8 +96,16 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
 
     // some irregular stats
     InitStat("average_bandwidth", "calculated", "Average bandwidth");
+    InitStat("pim_internal_bandwidth", "calculated",
+             "Average bank to PIM unit bandwidth");
+    InitStat("pim_alu_utilization", "calculated",
+             "Fraction of PIM_OP slots that executed an instruction");
     InitStat("total_energy", "calculated", "Total energy (pJ)");
     InitStat("average_power", "calculated", "Average power (mW)");
+    InitStat("pim_energy", "calculated", "PIM energy, part of total (pJ)");
+    InitStat("pim_ops", "calculated", "PIM arithmetic ops (per lane)");
+    InitStat("pim_pj_per_op", "calculated", "Total energy per PIM op (pJ)");
+    InitStat("pim_tops_per_watt", "calculated", "PIM ops per total energy (TOPS/W)");
     InitStat("average_read_latency", "calculated",
              "Average read request latency (cycles)");
     InitStat("average_interarrival", "calculated",
@@ -103,11 +139,24 @@ double SimpleStats::RankBackgroundEnergy(const int rank) const{
            vec_doubles_.at("sref_energy")[rank];
 }
 
-void SimpleStats::PrintEpochStats() {
+double SimpleStats::TotalEnergy() const {
+    auto counters = counters_;
+    for (const auto& it : epoch_counters_) {
+        counters[it.first] += it.second;
+    }
+    auto vec_counters = vec_counters_;
+    for (const auto& it : epoch_vec_counters_) {
+        for (size_t i = 0; i < it.second.size(); i++) {
+            vec_counters[it.first][i] += it.second[i];
+        }
+    }
+    return ComputeEnergy(counters, vec_counters).Total();
+}
+
+void SimpleStats::PrintEpochStats(StatsSink* sink) {
     UpdateEpochStats();
-    if (config_.output_level >= 1) {
-        std::ofstream j_out(config_.json_epoch_name, std::ofstream::app);
-        j_out << j_data_;
+    if (config_.output_level >= 1 && sink) {
+        sink->Write(j_data_, std::to_string(channel_id_));
     }
     if (config_.output_level >= 2) {
         std::cout << GetTextHeader(false);
@@ -119,22 +168,17 @@ void SimpleStats::PrintEpochStats() {
     print_pairs_.clear();
 }
 
-void SimpleStats::PrintFinalStats() {
+void SimpleStats::PrintFinalStats(StatsSink* sink, std::ostream* txt_out) {
     UpdateFinalStats();
 
-    if (config_.output_level >= 0) {
-        std::ofstream j_out(config_.json_stats_name, std::ofstream::app);
-        j_out << "\"" << std::to_string(channel_id_) << "\":";
-        j_out << j_data_;
+    if (config_.output_level >= 0 && sink) {
+        sink->Write(j_data_, std::to_string(channel_id_));
     }
 
-    if (config_.output_level >= 1) {
-        // HACK: overwrite existing file if this is first channel
-        auto perm = channel_id_ == 0 ? std::ofstream::out : std::ofstream::app;
-        std::ofstream txt_out(config_.txt_stats_name, perm);
-        txt_out << GetTextHeader(true);
+    if (config_.output_level >= 1 && txt_out) {
+        *txt_out << GetTextHeader(true);
         for (const auto& it : print_pairs_) {
-            PrintStatText(txt_out, it.first, it.second,
+            PrintStatText(*txt_out, it.first, it.second,
                           header_descs_[it.first]);
         }
     }
@@ -296,6 +340,95 @@ double SimpleStats::GetHistoAvg(const HistoCount& hist_counts) const {
                : static_cast<double>(accu_sum) / static_cast<double>(count);
 }
 
+double SimpleStats::Energy::Total() const {
+    double total = act + read + write + ref + refb + Pim();
+    for (size_t i = 0; i < act_stb.size(); i++) {
+        total += act_stb[i] + pre_stb[i] + sref[i];
+    }
+    return total;
+}
+
+SimpleStats::Energy SimpleStats::ComputeEnergy(
+    const std::unordered_map<std::string, uint64_t>& counters,
+    const VecStat& vec_counters) const {
+    Energy energy;
+    energy.act = counters.at("num_act_cmds") * config_.act_energy_inc;
+    energy.read = counters.at("num_read_cmds") * config_.read_energy_inc;
+    energy.write = counters.at("num_write_cmds") * config_.write_energy_inc;
+    energy.ref = counters.at("num_ref_cmds") * config_.ref_energy_inc;
+    energy.refb = counters.at("num_refb_cmds") * config_.refb_energy_inc;
+
+    for (int i = 0; i < config_.ranks; i++) {
+        energy.act_stb.push_back(vec_counters.at("rank_active_cycles")[i] *
+                                 config_.act_stb_energy_inc);
+        energy.pre_stb.push_back(vec_counters.at("all_bank_idle_cycles")[i] *
+                                 config_.pre_stb_energy_inc);
+        energy.sref.push_back(vec_counters.at("sref_cycles")[i] *
+                              config_.sref_energy_inc);
+    }
+
+    energy.pim_alu = 0.0;
+    energy.pim_ops = 0;
+    for (int op = (int)PIM_OPERATION::LD; op < NUM_PIM_OPERATIONS; op++) {
+        std::string name =
+            std::string("pim_") + PimOperationName((PIM_OPERATION)op) + "_insts";
+        for (auto count : vec_counters.at(name)) {
+            energy.pim_alu += count * config_.pim_op_energy[op];
+            energy.pim_ops += count * PimOperationLaneOps((PIM_OPERATION)op) *
+                              UNITS_PER_WORD;
+        }
+    }
+    energy.pim_rf = counters.at("pim_rf_accesses") * config_.pim_rf_energy;
+    energy.pim_mode =
+        counters.at("pim_mode_changes") * config_.pim_mode_switch_energy;
+    return energy;
+}
+
+double SimpleStats::UpdateEnergy(const Energy& energy) {
+    doubles_["act_energy"] = energy.act;
+    doubles_["read_energy"] = energy.read;
+    doubles_["write_energy"] = energy.write;
+    doubles_["ref_energy"] = energy.ref;
+    doubles_["refb_energy"] = energy.refb;
+    vec_doubles_["act_stb_energy"] = energy.act_stb;
+    vec_doubles_["pre_stb_energy"] = energy.pre_stb;
+    vec_doubles_["sref_energy"] = energy.sref;
+
+    doubles_["pim_alu_energy"] = energy.pim_alu;
+    doubles_["pim_rf_energy"] = energy.pim_rf;
+    doubles_["pim_mode_energy"] = energy.pim_mode;
+    calculated_["pim_ops"] = energy.pim_ops;
+    calculated_["pim_energy"] = energy.Pim();
+
+    double total_energy = energy.Total();
+    calculated_["total_energy"] = total_energy;
+    UpdatePimEfficiency(total_energy);
+    return total_energy;
+}
+
+// energy per op counts DRAM and PIM energy, as a host would pay for both
+void SimpleStats::UpdatePimEfficiency(double total_energy) {
+    double ops = calculated_["pim_ops"];
+    calculated_["pim_pj_per_op"] = ops > 0 ? total_energy / ops : 0.0;
+    // ops per pJ is 1e12 ops per J, which is TOPS/W
+    calculated_["pim_tops_per_watt"] =
+        total_energy > 0 ? ops / total_energy : 0.0;
+}
+
+double SimpleStats::PimUtilization(const VecStat& vec_counters) const {
+    uint64_t busy = 0;
+    for (int op = (int)PIM_OPERATION::LD; op < NUM_PIM_OPERATIONS; op++) {
+        std::string name =
+            std::string("pim_") + PimOperationName((PIM_OPERATION)op) + "_insts";
+        for (auto count : vec_counters.at(name)) busy += count;
+    }
+    uint64_t idle = 0;
+    for (auto count : vec_counters.at("pim_idle_slots")) idle += count;
+    return busy + idle == 0 ? 0.0
+                            : static_cast<double>(busy) /
+                                  static_cast<double>(busy + idle);
+}
+
 void SimpleStats::UpdatePrints(bool epoch) {
     j_data_["channel"] = channel_id_;
 
@@ -363,33 +496,6 @@ void SimpleStats::UpdateEpochStats() {
     // push counter values as is
     UpdateCounters();
 
-    // update computed stats
-    doubles_["act_energy"] =
-        epoch_counters_["num_act_cmds"] * config_.act_energy_inc;
-    doubles_["read_energy"] =
-        epoch_counters_["num_read_cmds"] * config_.read_energy_inc;
-    doubles_["write_energy"] =
-        epoch_counters_["num_write_cmds"] * config_.write_energy_inc;
-    doubles_["ref_energy"] =
-        epoch_counters_["num_ref_cmds"] * config_.ref_energy_inc;
-    doubles_["refb_energy"] =
-        epoch_counters_["num_refb_cmds"] * config_.refb_energy_inc;
-
-    // vector doubles, update first, then push
-    double background_energy = 0.0;
-    for (int i = 0; i < config_.ranks; i++) {
-        double act_stb = epoch_vec_counters_["rank_active_cycles"][i] *
-                         config_.act_stb_energy_inc;
-        double pre_stb = epoch_vec_counters_["all_bank_idle_cycles"][i] *
-                         config_.pre_stb_energy_inc;
-        double sref_energy =
-            epoch_vec_counters_["sref_cycles"][i] * config_.sref_energy_inc;
-        vec_doubles_["act_stb_energy"][i] = act_stb;
-        vec_doubles_["pre_stb_energy"][i] = pre_stb;
-        vec_doubles_["sref_energy"][i] = sref_energy;
-        background_energy += act_stb + pre_stb + sref_energy;
-    }
-
     UpdateHistoBins();
 
     // calculated stats
@@ -398,11 +504,12 @@ void SimpleStats::UpdateEpochStats() {
     double total_time = epoch_counters_["num_cycles"] * config_.tCK;
     double avg_bw = total_reqs * config_.request_size_bytes / total_time;
     calculated_["average_bandwidth"] = avg_bw;
+    calculated_["pim_internal_bandwidth"] =
+        epoch_counters_["pim_internal_bytes"] / total_time;
+    calculated_["pim_alu_utilization"] = PimUtilization(epoch_vec_counters_);
 
-    double total_energy = doubles_["act_energy"] + doubles_["read_energy"] +
-                          doubles_["write_energy"] + doubles_["ref_energy"] +
-                          doubles_["refb_energy"] + background_energy;
-    calculated_["total_energy"] = total_energy;
+    double total_energy =
+        UpdateEnergy(ComputeEnergy(epoch_counters_, epoch_vec_counters_));
     calculated_["average_power"] = total_energy / epoch_counters_["num_cycles"];
     calculated_["average_read_latency"] =
         GetHistoAvg(epoch_histo_counts_.at("read_latency"));
@@ -425,31 +532,6 @@ void SimpleStats::UpdateEpochStats() {
 void SimpleStats::UpdateFinalStats() {
     UpdateCounters();
 
-    // update computed stats
-    doubles_["act_energy"] = counters_["num_act_cmds"] * config_.act_energy_inc;
-    doubles_["read_energy"] =
-        counters_["num_read_cmds"] * config_.read_energy_inc;
-    doubles_["write_energy"] =
-        counters_["num_write_cmds"] * config_.write_energy_inc;
-    doubles_["ref_energy"] = counters_["num_ref_cmds"] * config_.ref_energy_inc;
-    doubles_["refb_energy"] =
-        counters_["num_refb_cmds"] * config_.refb_energy_inc;
-
-    // vector doubles, update first, then push
-    double background_energy = 0.0;
-    for (int i = 0; i < config_.ranks; i++) {
-        double act_stb =
-            vec_counters_["rank_active_cycles"][i] * config_.act_stb_energy_inc;
-        double pre_stb = vec_counters_["all_bank_idle_cycles"][i] *
-                         config_.pre_stb_energy_inc;
-        double sref_energy =
-            vec_counters_["sref_cycles"][i] * config_.sref_energy_inc;
-        vec_doubles_["act_stb_energy"][i] = act_stb;
-        vec_doubles_["pre_stb_energy"][i] = pre_stb;
-        vec_doubles_["sref_energy"][i] = sref_energy;
-        background_energy += act_stb + pre_stb + sref_energy;
-    }
-
     // histograms
     UpdateHistoBins();
 
@@ -459,11 +541,11 @@ void SimpleStats::UpdateFinalStats() {
     double total_time = counters_["num_cycles"] * config_.tCK;
     double avg_bw = total_reqs * config_.request_size_bytes / total_time;
     calculated_["average_bandwidth"] = avg_bw;
+    calculated_["pim_internal_bandwidth"] =
+        counters_["pim_internal_bytes"] / total_time;
+    calculated_["pim_alu_utilization"] = PimUtilization(vec_counters_);
 
-    double total_energy = doubles_["act_energy"] + doubles_["read_energy"] +
-                          doubles_["write_energy"] + doubles_["ref_energy"] +
-                          doubles_["refb_energy"] + background_energy;
-    calculated_["total_energy"] = total_energy;
+    double total_energy = UpdateEnergy(ComputeEnergy(counters_, vec_counters_));
     calculated_["average_power"] = total_energy / counters_["num_cycles"];
     // calculated_["average_read_latency"] = GetHistoAvg("read_latency");
     calculated_["average_read_latency"] =
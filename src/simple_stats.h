@@ -8,6 +8,7 @@
 
 #include "configuration.h"
 #include "json.hpp"
+#include "stats_sink.h"
 
 namespace dramsim3 {
 
@@ -17,6 +18,11 @@ class SimpleStats {
     // incrementing counter
     void Increment(const std::string name) { epoch_counters_[name] += 1; }
 
+    // increment counter by number
+    void IncrementBy(const std::string name, uint64_t num) {
+        epoch_counters_[name] += num;
+    }
+
     // incrementing for vec counter
     void IncrementVec(const std::string name, int pos) {
         epoch_vec_counters_[name][pos] += 1;
@@ -33,11 +39,16 @@ class SimpleStats {
     // return per rank background energy
     double RankBackgroundEnergy(const int r) const;
 
-    // Epoch update
-    void PrintEpochStats();
+    // total energy (pJ) of the counts so far, DRAM and PIM as in
+    // total_energy, without ending the epoch
+    double TotalEnergy() const;
+
+    // Epoch update, record goes to sink if given
+    void PrintEpochStats(StatsSink* sink = nullptr);
 
     // Final statas output
-    void PrintFinalStats();
+    void PrintFinalStats(StatsSink* sink = nullptr,
+                         std::ostream* txt_out = nullptr);
 
     // Reset (usually after one phase of simulation)
     void Reset();
@@ -58,6 +69,23 @@ class SimpleStats {
     void UpdateHistoBins();
     void UpdatePrints(bool epoch);
     double GetHistoAvg(const HistoCount& histo_counts) const;
+    double PimUtilization(const VecStat& vec_counters) const;
+
+    // energy (pJ) of a set of counts, split as in the stats
+    struct Energy {
+        double act, read, write, ref, refb;
+        std::vector<double> act_stb, pre_stb, sref;  // per rank
+        double pim_alu, pim_rf, pim_mode;
+        uint64_t pim_ops;
+        double Pim() const { return pim_alu + pim_rf + pim_mode; }
+        double Total() const;
+    };
+    Energy ComputeEnergy(
+        const std::unordered_map<std::string, uint64_t>& counters,
+        const VecStat& vec_counters) const;
+    // push the parts to the stats, returns the total
+    double UpdateEnergy(const Energy& energy);
+    void UpdatePimEfficiency(double total_energy);
     std::string GetTextHeader(bool is_final) const;
     void UpdateEpochStats();
     void UpdateFinalStats();
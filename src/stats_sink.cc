@@ -0,0 +1,137 @@
+#include "stats_sink.h"
+
+#include <iostream>
+#include <unordered_map>
+
+#include "common.h"
+
+namespace dramsim3 {
+
+StatsFormat GetStatsFormat(const std::string& format_str) {
+    if (format_str == "json") {
+        return StatsFormat::JSON;
+    } else if (format_str == "jsonl") {
+        return StatsFormat::JSONL;
+    } else if (format_str == "csv") {
+        return StatsFormat::CSV;
+    }
+    std::cerr << "Unknown stats format " << format_str
+              << ", use json, jsonl or csv" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+    return StatsFormat::JSON;
+}
+
+namespace {
+// quoted when it holds a separator, a quote or a line break, quotes doubled
+std::string CsvCell(const std::string& value) {
+    if (value.find_first_of(",\"\r\n") == std::string::npos) return value;
+    std::string cell = "\"";
+    for (char c : value) {
+        if (c == '"') cell += '"';
+        cell += c;
+    }
+    return cell + "\"";
+}
+}  // namespace
+
+std::string StatsFormatExtension(StatsFormat format) {
+    switch (format) {
+        case StatsFormat::JSONL:
+            return ".jsonl";
+        case StatsFormat::CSV:
+            return ".csv";
+        default:
+            return ".json";
+    }
+}
+
+StatsSink::StatsSink(const std::string& file_name, StatsFormat format,
+                     bool keyed)
+    : file_name_(file_name),
+      buffer_(1 << 20),
+      format_(format),
+      keyed_(keyed),
+      closed_(false),
+      num_records_(0) {
+    // bigger buffer than the default so small epochs do not hit the disk
+    out_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+    out_.open(file_name_, std::fstream::out);
+    if (out_.fail()) {
+        std::cerr << "Cannot open stats file " << file_name << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    if (format_ == StatsFormat::JSON) {
+        out_ << (keyed_ ? "{" : "[");
+    }
+}
+
+StatsSink::~StatsSink() { Close(); }
+
+void StatsSink::Write(const Json& record, const std::string& key) {
+    if (closed_) Reopen();
+    if (format_ == StatsFormat::JSON) {
+        if (num_records_ > 0) out_ << ",\n";
+        if (keyed_) out_ << "\"" << key << "\":";
+        out_ << record;
+    } else if (format_ == StatsFormat::JSONL) {
+        out_ << record << '\n';
+    } else {
+        std::vector<std::pair<std::string, std::string> > cells;
+        Flatten(record, "", cells);
+        if (num_records_ == 0) {
+            for (size_t i = 0; i < cells.size(); i++) {
+                columns_.push_back(cells[i].first);
+                out_ << (i == 0 ? "" : ",") << CsvCell(cells[i].first);
+            }
+            out_ << '\n';
+        }
+        std::unordered_map<std::string, const std::string*> values;
+        for (const auto& cell : cells) {
+            values[cell.first] = &cell.second;
+        }
+        for (size_t i = 0; i < columns_.size(); i++) {
+            if (i != 0) out_ << ',';
+            auto it = values.find(columns_[i]);
+            if (it != values.end()) out_ << CsvCell(*it->second);
+        }
+        out_ << '\n';
+    }
+    num_records_++;
+}
+
+void StatsSink::Close() {
+    if (closed_) return;
+    if (format_ == StatsFormat::JSON) {
+        out_ << (keyed_ ? "}" : "]");
+    }
+    out_.close();
+    closed_ = true;
+}
+
+void StatsSink::Reopen() {
+    out_.open(file_name_, std::fstream::in | std::fstream::out);
+    if (out_.fail()) {
+        std::cerr << "Cannot reopen stats file " << file_name_ << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    // JSON goes on over the closing bracket
+    out_.seekp(format_ == StatsFormat::JSON ? -1 : 0, std::fstream::end);
+    closed_ = false;
+}
+
+void StatsSink::Flatten(
+    const Json& record, const std::string& prefix,
+    std::vector<std::pair<std::string, std::string> >& cells) const {
+    for (auto it = record.begin(); it != record.end(); ++it) {
+        std::string name = prefix.empty() ? it.key() : prefix + "." + it.key();
+        if (it->is_object()) {
+            Flatten(*it, name, cells);
+        } else if (it->is_string()) {
+            cells.emplace_back(name, it->get<std::string>());
+        } else {
+            cells.emplace_back(name, it->dump());
+        }
+    }
+}
+
+}  // namespace dramsim3
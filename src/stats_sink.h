@@ -0,0 +1,48 @@
+#ifndef __STATS_SINK_H
+#define __STATS_SINK_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace dramsim3 {
+
+enum class StatsFormat { JSON, JSONL, CSV };
+
+StatsFormat GetStatsFormat(const std::string& format_str);
+std::string StatsFormatExtension(StatsFormat format);
+
+// One persistent, buffered output file for stats records.
+// JSON:  a list of records (or an object of records if keyed) closed on Close()
+// JSONL: one record per line
+// CSV:   one row per record, columns fixed by the first record with nested
+//        objects flattened to "name.key", cells quoted as in RFC 4180
+// A Write after Close reopens the file and appends, a JSON file is closed
+// again by the next Close
+class StatsSink {
+   public:
+    using Json = nlohmann::json;
+    StatsSink(const std::string& file_name, StatsFormat format, bool keyed);
+    ~StatsSink();
+    void Write(const Json& record, const std::string& key);
+    void Close();
+
+   private:
+    void Reopen();
+    void Flatten(const Json& record, const std::string& prefix,
+                 std::vector<std::pair<std::string, std::string> >& cells) const;
+
+    std::string file_name_;
+    std::fstream out_;
+    std::vector<char> buffer_;
+    StatsFormat format_;
+    bool keyed_;
+    bool closed_;
+    uint64_t num_records_;
+    std::vector<std::string> columns_;
+};
+
+}  // namespace dramsim3
+#endif  // __STATS_SINK_H
@@ -28,7 +28,8 @@ ThermalCalculator::ThermalCalculator(const Config &config)
       sample_id(0),
       background_energy_(config_.channels,
                          std::vector<double>(config_.ranks, 0)),
-      avg_logic_power_(0.0) {
+      avg_logic_power_(0.0),
+      max_temp_(config.amb_temp) {
     // Initialize dimX, dimY, numP
     // The dimension of the chip is determined such that the floorplan is
     // as square as possilbe. If a square floorplan cannot be reached,
@@ -515,6 +516,46 @@ void ThermalCalculator::UpdateCMDPower(const int channel, const Command &cmd,
     return;
 }
 
+void ThermalCalculator::UpdatePimPower(const int channel, const int bankgroup,
+                                       const double energy) {
+    int case_id;
+    double device_scale;
+    if (config_.IsHMC() || config_.IsHBM()) {
+        device_scale = 1;
+        case_id = 0;
+    } else {
+        // PIM units are modeled on rank 0
+        device_scale = (double)config_.devices_per_rank;
+        case_id = channel * config_.ranks;
+    }
+
+    int vault_id_x, vault_id_y;
+    std::tie(vault_id_x, vault_id_y) = MapToVault(channel);
+
+    // the unit sits between the banks of its bankgroup, so spread the energy
+    // evenly over all of their grids
+    int bank_grids = config_.num_x_grids * config_.num_y_grids;
+    double grid_energy =
+        energy / (bank_grids * config_.banks_per_group) / 1000.0 / device_scale;
+    for (int ib = 0; ib < config_.banks_per_group; ib++) {
+        int bank_id_x, bank_id_y;
+        std::tie(bank_id_x, bank_id_y) = MapToBank(bankgroup, ib);
+        int z = MapToZ(channel, ib);
+        int x0 = vault_id_x * (bank_x * config_.num_x_grids) +
+                 bank_id_x * config_.num_x_grids;
+        int y0 = vault_id_y * (bank_y * config_.num_y_grids) +
+                 bank_id_y * config_.num_y_grids;
+        int z_offset = z * (dimX * dimY);
+        for (int gy = 0; gy < config_.num_y_grids; gy++) {
+            for (int gx = 0; gx < config_.num_x_grids; gx++) {
+                int idx = z_offset + (y0 + gy) * dimX + x0 + gx;
+                accu_Pmap[case_id][idx] += grid_energy;
+                cur_Pmap[case_id][idx] += grid_energy;
+            }
+        }
+    }
+}
+
 void ThermalCalculator::UpdateBackgroundEnergy(const int channel,
                                                const int rank,
                                                const double energy) {
@@ -554,6 +595,7 @@ void ThermalCalculator::SetLogicPower(double logic_power) {
 void ThermalCalculator::PrintTransPT(uint64_t clk) {
     UpdateEpoch(clk);
     double ms = clk * config_.tCK * 1e-6;
+    max_temp_ = 0;
     for (int ir = 0; ir < num_case; ir++) {
         CalcTransT(ir);
         double maxT = 0;
@@ -569,6 +611,7 @@ void ThermalCalculator::PrintTransPT(uint64_t clk) {
         }
         std::cout << "MaxT of case " << ir << " is " << maxT << " [C] at " << ms
                   << " ms\n";
+        max_temp_ = max_temp_ > maxT ? max_temp_ : maxT;
         // only outputs full file when output level >= 2
         if (config_.output_level >= 2) {
             PrintCSV_trans(epoch_temperature_file_csv_, cur_Pmap, T_trans, ir,
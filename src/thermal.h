@@ -24,6 +24,12 @@ class ThermalCalculator {
                         const uint64_t clk);
     void UpdateBackgroundEnergy(const int channel, const int rank,
                                 const double energy);
+    // PIM ALU/register file energy of the PimUnit of a bankgroup, spread
+    // over the banks of that bankgroup
+    void UpdatePimPower(const int channel, const int bankgroup,
+                        const double energy);
+    // max temperature [C] of the last transient epoch
+    double GetMaxTemperature() const { return max_temp_; }
     // assuming evenly distributed logic layer power
     void UpdateEpoch(const uint64_t clk);
     void SetLogicPower(double logic_power);
@@ -110,6 +116,7 @@ class ThermalCalculator {
 
     std::vector<std::vector<double>> background_energy_;
     double avg_logic_power_;
+    double max_temp_;
 };
 }  // namespace dramsim3
 
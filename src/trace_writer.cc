@@ -0,0 +1,255 @@
+#include "trace_writer.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "fmt/format.h"
+
+namespace dramsim3 {
+
+namespace {
+const char kTraceMagic[4] = {'D', 'S', '3', 'T'};
+const uint16_t kTraceVersion = 1;
+const size_t kBlockSize = 1 << 20;  // raw bytes per block
+
+// LZ parameters
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 0xffff;
+const int kHashBits = 14;
+
+inline uint32_t Read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void PutLength(std::vector<uint8_t>& dst, size_t len) {
+    while (len >= 255) {
+        dst.push_back(255);
+        len -= 255;
+    }
+    dst.push_back(static_cast<uint8_t>(len));
+}
+
+void EmitSequence(std::vector<uint8_t>& dst, const uint8_t* lit,
+                  size_t lit_len, size_t offset, size_t match_len) {
+    size_t ml = match_len - kMinMatch;
+    uint8_t token = static_cast<uint8_t>((lit_len < 15 ? lit_len : 15) << 4);
+    token |= static_cast<uint8_t>(ml < 15 ? ml : 15);
+    dst.push_back(token);
+    if (lit_len >= 15) PutLength(dst, lit_len - 15);
+    dst.insert(dst.end(), lit, lit + lit_len);
+    dst.push_back(static_cast<uint8_t>(offset & 0xff));
+    dst.push_back(static_cast<uint8_t>(offset >> 8));
+    if (ml >= 15) PutLength(dst, ml - 15);
+}
+
+void EmitLastLiterals(std::vector<uint8_t>& dst, const uint8_t* lit,
+                      size_t lit_len) {
+    dst.push_back(static_cast<uint8_t>((lit_len < 15 ? lit_len : 15) << 4));
+    if (lit_len >= 15) PutLength(dst, lit_len - 15);
+    dst.insert(dst.end(), lit, lit + lit_len);
+}
+
+bool GetLength(const uint8_t*& ip, const uint8_t* end, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip >= end) return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+}  // namespace
+
+void LZCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& dst) {
+    dst.clear();
+    std::vector<int64_t> table(1 << kHashBits, -1);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + kMinMatch <= size) {
+        uint32_t seq = Read32(src + i);
+        uint32_t h = (seq * 2654435761u) >> (32 - kHashBits);
+        int64_t cand = table[h];
+        table[h] = static_cast<int64_t>(i);
+        if (cand >= 0 && i - cand <= kMaxOffset && Read32(src + cand) == seq) {
+            size_t len = kMinMatch;
+            while (i + len < size && src[cand + len] == src[i + len]) len++;
+            EmitSequence(dst, src + anchor, i - anchor, i - cand, len);
+            i += len;
+            anchor = i;
+        } else {
+            i++;
+        }
+    }
+    EmitLastLiterals(dst, src + anchor, size - anchor);
+}
+
+bool LZDecompress(const uint8_t* src, size_t size, std::vector<uint8_t>& dst,
+                  size_t raw_size) {
+    dst.clear();
+    dst.reserve(raw_size);
+    const uint8_t* ip = src;
+    const uint8_t* end = src + size;
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !GetLength(ip, end, lit_len)) return false;
+        if (static_cast<size_t>(end - ip) < lit_len) return false;
+        dst.insert(dst.end(), ip, ip + lit_len);
+        ip += lit_len;
+        if (ip == end) break;  // last sequence carries literals only
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match_len = (token & 0xf);
+        if (match_len == 15 && !GetLength(ip, end, match_len)) return false;
+        match_len += kMinMatch;
+        if (offset == 0 || offset > dst.size()) return false;
+        // byte by byte since the match may overlap its own output
+        size_t from = dst.size() - offset;
+        for (size_t k = 0; k < match_len; k++) dst.push_back(dst[from + k]);
+    }
+    return dst.size() == raw_size;
+}
+
+TraceWriter::TraceWriter(const std::string& file_name, TraceKind kind,
+                         int channel, bool binary, bool compress)
+    : binary_(binary), compress_(binary && compress) {
+    out_.open(file_name, std::ofstream::out | std::ofstream::binary);
+    if (out_.fail()) {
+        std::cerr << "Cannot open trace file " << file_name << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    buffer_.reserve(kBlockSize);
+    if (binary_) {
+        TraceFileHeader header;
+        memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+        header.version = kTraceVersion;
+        header.kind = static_cast<uint8_t>(kind);
+        header.flags = compress_ ? 1 : 0;
+        header.record_size = kind == TraceKind::COMMAND
+                                 ? sizeof(CmdTraceRecord)
+                                 : sizeof(AddrTraceRecord);
+        header.channel = channel;
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+}
+
+TraceWriter::~TraceWriter() { Flush(); }
+
+void TraceWriter::AddCommand(uint64_t clk, const Command& cmd) {
+    CmdTraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.clk = clk;
+    rec.row = cmd.Row();
+    rec.column = cmd.Column();
+    rec.cmd_type = static_cast<uint8_t>(cmd.cmd_type);
+    rec.channel = static_cast<int8_t>(cmd.Channel());
+    rec.rank = static_cast<int8_t>(cmd.Rank());
+    rec.bankgroup = static_cast<int8_t>(cmd.Bankgroup());
+    rec.bank = static_cast<int8_t>(cmd.Bank());
+    if (binary_) {
+        Append(&rec, sizeof(rec));
+    } else {
+        std::string line = FormatCommand(rec);
+        Append(line.data(), line.size());
+    }
+}
+
+void TraceWriter::AddTransaction(uint64_t clk, uint64_t hex_addr,
+                                 bool is_write) {
+    AddrTraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.clk = clk;
+    rec.hex_addr = hex_addr;
+    rec.is_write = is_write ? 1 : 0;
+    if (binary_) {
+        Append(&rec, sizeof(rec));
+    } else {
+        std::string line = FormatTransaction(rec);
+        Append(line.data(), line.size());
+    }
+}
+
+void TraceWriter::Append(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), p, p + size);
+    if (buffer_.size() >= kBlockSize) WriteBlock();
+}
+
+void TraceWriter::WriteBlock() {
+    if (buffer_.empty()) return;
+    if (!binary_) {
+        out_.write(reinterpret_cast<const char*>(buffer_.data()),
+                   buffer_.size());
+        buffer_.clear();
+        return;
+    }
+    TraceBlockHeader block;
+    block.raw_size = static_cast<uint32_t>(buffer_.size());
+    const std::vector<uint8_t>* payload = &buffer_;
+    if (compress_) {
+        LZCompress(buffer_.data(), buffer_.size(), compressed_);
+        // keep incompressible blocks raw
+        if (compressed_.size() < buffer_.size()) payload = &compressed_;
+    }
+    block.stored_size = static_cast<uint32_t>(payload->size());
+    out_.write(reinterpret_cast<const char*>(&block), sizeof(block));
+    out_.write(reinterpret_cast<const char*>(payload->data()),
+               payload->size());
+    buffer_.clear();
+}
+
+void TraceWriter::Flush() {
+    WriteBlock();
+    out_.flush();
+}
+
+std::string TraceWriter::FormatCommand(const CmdTraceRecord& rec) {
+    Address addr(rec.channel, rec.rank, rec.bankgroup, rec.bank, rec.row,
+                 rec.column);
+    Command cmd(static_cast<CommandType>(rec.cmd_type), addr, 0);
+    std::stringstream ss;
+    ss << cmd;
+    return fmt::format("{:<18} {}\n", rec.clk, ss.str());
+}
+
+std::string TraceWriter::FormatTransaction(const AddrTraceRecord& rec) {
+    return fmt::format("{:x} {}{}\n", rec.hex_addr,
+                       rec.is_write ? "WRITE " : "READ ", rec.clk);
+}
+
+TraceReader::TraceReader(const std::string& file_name) : valid_(false) {
+    in_.open(file_name, std::ifstream::in | std::ifstream::binary);
+    if (!in_.read(reinterpret_cast<char*>(&header_), sizeof(header_))) {
+        return;
+    }
+    valid_ = memcmp(header_.magic, kTraceMagic, sizeof(kTraceMagic)) == 0 &&
+             header_.version == kTraceVersion;
+}
+
+bool TraceReader::ReadBlock(std::vector<uint8_t>& raw) {
+    TraceBlockHeader block;
+    if (!valid_ ||
+        !in_.read(reinterpret_cast<char*>(&block), sizeof(block))) {
+        return false;
+    }
+    stored_.resize(block.stored_size);
+    if (!in_.read(reinterpret_cast<char*>(stored_.data()), block.stored_size)) {
+        std::cerr << "Truncated trace block" << std::endl;
+        return false;
+    }
+    if (block.stored_size == block.raw_size) {
+        raw.swap(stored_);
+        return true;
+    }
+    if (!LZDecompress(stored_.data(), stored_.size(), raw, block.raw_size)) {
+        std::cerr << "Corrupted trace block" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,101 @@
+#ifndef __TRACE_WRITER_H
+#define __TRACE_WRITER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace dramsim3 {
+
+// Binary trace layout (little endian):
+//   TraceFileHeader, then a sequence of blocks.
+//   every block starts with TraceBlockHeader followed by stored_size bytes,
+//   stored_size == raw_size means the block is stored uncompressed,
+//   otherwise it is an LZ compressed run of fixed-size records.
+enum class TraceKind : uint8_t { COMMAND = 0, ADDRESS = 1 };
+
+struct TraceFileHeader {
+    char magic[4];          // "DS3T"
+    uint16_t version;
+    uint8_t kind;           // TraceKind
+    uint8_t flags;          // bit0: blocks may be compressed
+    uint32_t record_size;
+    int32_t channel;        // -1 for system-wide traces
+};
+
+struct TraceBlockHeader {
+    uint32_t raw_size;
+    uint32_t stored_size;
+};
+
+struct CmdTraceRecord {
+    uint64_t clk;
+    int32_t row;
+    int32_t column;
+    uint8_t cmd_type;
+    // signed, refresh and SREF commands carry -1 for the levels they span
+    int8_t channel;
+    int8_t rank;
+    int8_t bankgroup;
+    int8_t bank;
+    uint8_t pad[3];
+};
+
+struct AddrTraceRecord {
+    uint64_t clk;
+    uint64_t hex_addr;
+    uint8_t is_write;
+    uint8_t pad[7];
+};
+
+// Buffered per-channel (or per-system) trace sink. Records are appended to
+// an in-memory block and only hit the file when the block is full or the
+// writer is destroyed, so tracing no longer flushes once per command.
+class TraceWriter {
+   public:
+    TraceWriter(const std::string& file_name, TraceKind kind, int channel,
+                bool binary, bool compress);
+    ~TraceWriter();
+    void AddCommand(uint64_t clk, const Command& cmd);
+    void AddTransaction(uint64_t clk, uint64_t hex_addr, bool is_write);
+    void Flush();
+
+    static std::string FormatCommand(const CmdTraceRecord& rec);
+    static std::string FormatTransaction(const AddrTraceRecord& rec);
+
+   private:
+    void Append(const void* data, size_t size);
+    void WriteBlock();
+
+    std::ofstream out_;
+    bool binary_;
+    bool compress_;
+    std::vector<uint8_t> buffer_;
+    std::vector<uint8_t> compressed_;
+};
+
+// Reads back a binary trace, one decoded block at a time
+class TraceReader {
+   public:
+    TraceReader(const std::string& file_name);
+    bool IsValid() const { return valid_; }
+    TraceKind Kind() const { return static_cast<TraceKind>(header_.kind); }
+    uint32_t RecordSize() const { return header_.record_size; }
+    bool ReadBlock(std::vector<uint8_t>& raw);
+
+   private:
+    std::ifstream in_;
+    TraceFileHeader header_;
+    bool valid_;
+    std::vector<uint8_t> stored_;
+};
+
+// LZ77 style block codec (LZ4 sequence layout), no external dependency
+void LZCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& dst);
+bool LZDecompress(const uint8_t* src, size_t size, std::vector<uint8_t>& dst,
+                  size_t raw_size);
+
+}  // namespace dramsim3
+#endif  // __TRACE_WRITER_H
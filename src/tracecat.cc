@@ -0,0 +1,61 @@
+#include <iostream>
+#include "./../ext/headers/args.hxx"
+#include "trace_writer.h"
+
+using namespace dramsim3;
+
+// decode binary command/address traces back into the text trace format
+int main(int argc, const char **argv) {
+    args::ArgumentParser parser(
+        "Binary trace decoder.",
+        "Examples: \n"
+        "./build/tracecat dramsim3ch_0cmd.trace.bin > ch_0cmd.trace\n"
+        "./build/tracecat dramsim3addr.trace.bin -n 100");
+    args::HelpFlag help(parser, "help", "Display the help menu", {'h', "help"});
+    args::ValueFlag<uint64_t> num_records_arg(
+        parser, "num_records", "Stop after this many records (0: all)",
+        {'n', "num-records"}, 0);
+    args::Positional<std::string> trace_arg(
+        parser, "trace", "The binary trace file name (mandatory)");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string trace_file = args::get(trace_arg);
+    if (trace_file.empty()) {
+        std::cerr << parser;
+        return 1;
+    }
+
+    TraceReader reader(trace_file);
+    if (!reader.IsValid()) {
+        std::cerr << trace_file << " is not a binary trace file" << std::endl;
+        return 1;
+    }
+
+    uint64_t limit = args::get(num_records_arg);
+    uint64_t count = 0;
+    size_t rec_size = reader.RecordSize();
+    std::vector<uint8_t> block;
+    while (reader.ReadBlock(block)) {
+        for (size_t off = 0; off + rec_size <= block.size(); off += rec_size) {
+            if (reader.Kind() == TraceKind::COMMAND) {
+                std::cout << TraceWriter::FormatCommand(
+                    *reinterpret_cast<const CmdTraceRecord *>(&block[off]));
+            } else {
+                std::cout << TraceWriter::FormatTransaction(
+                    *reinterpret_cast<const AddrTraceRecord *>(&block[off]));
+            }
+            if (++count == limit) return 0;
+        }
+    }
+    return 0;
+}
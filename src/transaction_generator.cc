@@ -1,4 +1,9 @@
 #include "transaction_generator.h"
+#include "pim_scheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 
 namespace dramsim3 {
 
@@ -32,25 +37,25 @@ namespace dramsim3 {
     //  *DataPtr : buffer used for both RD/WR transaction (read common.h)
     void TransactionGenerator::TryAddTransaction(uint64_t hex_addr, bool is_write,
         uint8_t* DataPtr) {
-        // Wait until memory_system is ready to get Transaction
-        while (!memory_system_.WillAcceptTransaction(hex_addr, is_write)) {
-            memory_system_.ClockTick();
-            clk_++;
+        // Wait until memory_system is ready to get Transaction and the host
+        // has an issue slot for its channel in this cycle. Shared kernels
+        // wait until the channel is in SB mode as well
+        int channel = config_->AddressMapping(hex_addr).channel;
+        while ((shared_ && !memory_system_->IsSingleBankMode(channel)) ||
+               !memory_system_->WillAcceptTransaction(hex_addr, is_write) ||
+               !TakeIssueSlot(channel)) {
+            Tick();
         }
         // Send transaction to memory_system
         if (is_write) {
             uint8_t* new_data = (uint8_t*)malloc(burstSize_);
             std::memcpy(new_data, DataPtr, burstSize_);
             //std::cout << std::hex << clk_ << "\twrite\t" << hex_addr << std::dec << std::endl;
-            memory_system_.AddTransaction(hex_addr, is_write, new_data);
-            memory_system_.ClockTick();
-            clk_++;
+            memory_system_->AddTransaction(hex_addr, is_write, new_data);
         }
         else {
             //std::cout << std::hex << clk_ << "\tread\t" << hex_addr << std::dec << std::endl;
-            memory_system_.AddTransaction(hex_addr, is_write, DataPtr);
-            memory_system_.ClockTick();
-            clk_++;
+            memory_system_->AddTransaction(hex_addr, is_write, DataPtr);
         }
 
 #if 0
@@ -71,17 +76,291 @@ namespace dramsim3 {
 
     }
 
+    // Program kernel into the CRF of every PimUnit (ABG mode): one write of
+    // CRF_ENTRIES_PER_WORD entries per column of the CRF row and channel,
+    // up to the EXIT. Waits for the writes so the kernel is in place before
+    // the next mode change
+    void TransactionGenerator::ProgramCRF(PimInstruction* kernel) {
+        int num_insts = 0;
+        while (num_insts < config_->crf_depth && kernel[num_insts++].PIM_OP != PIM_OPERATION::EXIT) {}
+        int num_cols = (num_insts + CRF_ENTRIES_PER_WORD - 1) / CRF_ENTRIES_PER_WORD;
+#ifdef debug_mode
+        std::cout << "\nHOST:\tProgram ukernel \n";
+#endif
+        uint8_t data[SIZE_WORD];
+        for (int co = 0; co < num_cols; co++) {
+            for (int i = 0; i < CRF_ENTRIES_PER_WORD; i++) {
+                uint64_t code = EncodePimInstruction(kernel[co * CRF_ENTRIES_PER_WORD + i]);
+                std::memcpy(data + i * CRF_ENTRY_SIZE, &code, CRF_ENTRY_SIZE);
+            }
+            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                Address addr(ch, 0, 0, 0, MAP_CRF, co);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                TryAddTransaction(hex_addr, true, data);
+            }
+        }
+        Barrier();
+    }
+
     // Prevent turning out of order between transaction parts
     //  Change memory's threshold and wait until all pending transactions are
     //  executed
     void TransactionGenerator::Barrier() {
         //return;
-        memory_system_.SetWriteBufferThreshold(0);
-        while (memory_system_.IsPendingTransaction()) {
-            memory_system_.ClockTick();
-            clk_++;
+        SetWriteBufferThreshold(0);
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            while (memory_system_->IsPendingTransaction(ch)) {
+                Tick();
+            }
+        }
+        SetWriteBufferThreshold(-1);
+    }
+
+    // Wait until every channel has issued count commands that step the
+    // kernel since it went to BG mode. Orders a transaction after the PIM
+    // commands it depends on without draining the controller
+    void TransactionGenerator::WaitPimCommands(uint64_t count) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            while (memory_system_->PimCommandCount(ch) < count) {
+                Tick();
+            }
+        }
+    }
+
+    // Advance the memory one cycle. Under a PimScheduler the cycle ends once
+    // every running kernel has issued its transactions for it
+    void TransactionGenerator::Tick() {
+        if (scheduler_ != NULL)
+            scheduler_->Tick(this);
+        else
+            memory_system_->ClockTick();
+        clk_++;
+        issued_ = 0;
+        channel_issued_.assign(NUM_CHANNEL, false);
+    }
+
+    // The host issues up to host_issue_width transactions per cycle, at most
+    // one per channel. Under a PimScheduler the kernels share the slots
+    bool TransactionGenerator::TakeIssueSlot(int channel) {
+        if (scheduler_ != NULL)
+            return scheduler_->TakeIssueSlot(channel);
+        if (issued_ == config_->host_issue_width || channel_issued_[channel])
+            return false;
+        issued_++;
+        channel_issued_[channel] = true;
+        return true;
+    }
+
+    TransactionGenerator::TransactionGenerator(const std::string& config_file,
+        const std::string& output_dir, PimScheduler* scheduler)
+        : scheduler_(scheduler),
+        shared_(false),
+        config_(new Config(config_file, output_dir)),
+        clk_(0),
+        own_allocator_(SIZE_ROW * NUM_BANK, MAP_LUT),
+        allocator_(&own_allocator_),
+        assembler_(config_->crf_depth),
+        ch_first_(0),
+        ch_end_(NUM_CHANNEL),
+        num_bank_(NUM_BANK),
+        issued_(0),
+        channel_issued_(NUM_CHANNEL, false) {
+        burstSize_ = 32;
+        data_temp_ = (uint8_t*)malloc(burstSize_);
+        is_print_ = false;
+        start_clk_ = 0;
+        cnt_ = 0;
+
+        if (scheduler_ != NULL) {
+            memory_system_ = &scheduler_->memory_system_;
+            pmemAddr_ = scheduler_->pmemAddr_;
+            pmemAddr_size_ = scheduler_->pmemAddr_size_;
+            allocator_ = &scheduler_->allocator_;
+            return;
+        }
+        own_memory_system_.reset(new MemorySystem(
+            config_file, output_dir,
+            std::bind(&TransactionGenerator::ReadCallBack, this,
+                std::placeholders::_1, std::placeholders::_2),
+            std::bind(&TransactionGenerator::WriteCallBack, this,
+                std::placeholders::_1)));
+        memory_system_ = own_memory_system_.get();
+        pmemAddr_size_ = (uint64_t)4 * 1024 * 1024 * 1024;
+        pmemAddr_ = (uint8_t*)mmap(NULL, pmemAddr_size_,
+            PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_PRIVATE,
+            -1, 0);
+        if (pmemAddr_ == (uint8_t*)MAP_FAILED)
+            perror("mmap");
+        memory_system_->init(pmemAddr_, pmemAddr_size_, burstSize_);
+    }
+
+    TransactionGenerator::~TransactionGenerator() {
+        for (auto& buffer : buffers_)
+            allocator_->Free(buffer);
+        if (own_memory_system_)
+            munmap(pmemAddr_, pmemAddr_size_);
+        delete(config_);
+    }
+
+    void TransactionGenerator::SetChannels(int first, int count) {
+        PimAllocator::CheckChannels(first, count);
+        ch_first_ = first;
+        ch_end_ = first + count;
+        num_bank_ = (uint64_t)count * NUM_BANK_PER_CHANNEL;
+    }
+
+    PimBuffer TransactionGenerator::Alloc(uint64_t bytes, PimInterleave interleave) {
+        PimBuffer buffer = allocator_->Alloc(bytes, interleave, ch_first_, ch_end_ - ch_first_);
+        buffers_.push_back(buffer);
+        return buffer;
+    }
+
+    void TransactionGenerator::Bind(const std::string& operand, const PimBuffer& buffer) {
+        bound_[operand] = buffer;
+    }
+
+    PimBuffer TransactionGenerator::AllocOperand(const std::string& operand, uint64_t bytes,
+        PimInterleave interleave) {
+        auto it = bound_.find(operand);
+        if (it == bound_.end())
+            return Alloc(bytes, interleave);
+        const PimBuffer& buffer = it->second;
+        if (buffer.interleave != interleave || buffer.ch_first != ch_first_ ||
+            (1 << buffer.ch_shift) != ch_end_ - ch_first_ ||
+            allocator_->GetBytes(buffer) < bytes) {
+            std::cerr << "operand " << operand << " needs a buffer of " << bytes
+                      << " bytes, interleave " << (int)interleave << ", on channels "
+                      << ch_first_ << " ~ " << ch_end_ - 1 << std::endl;
+            exit(1);
+        }
+        return buffer;
+    }
+
+    void TransactionGenerator::SetMode(int mode) {
+        for (int ch = ch_first_; ch < ch_end_; ch++)
+            memory_system_->SetMode(ch, mode);
+    }
+
+    void TransactionGenerator::SetBaseRow(BaseRow base_row) {
+        for (int ch = ch_first_; ch < ch_end_; ch++)
+            memory_system_->SetBaseRow(ch, base_row);
+    }
+
+    void TransactionGenerator::SetWriteBufferThreshold(int threshold) {
+        for (int ch = ch_first_; ch < ch_end_; ch++)
+            memory_system_->SetWriteBufferThreshold(ch, threshold);
+    }
+
+    void TransactionGenerator::LoadLut(const unit_t* lut) {
+        for (int co = 0; co < LUT_WORDS; co++) {
+            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                Address addr(ch, 0, 0, 0, MAP_LUT, co);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                TryAddTransaction(hex_addr, true, (uint8_t*)(lut + co * UNITS_PER_WORD));
+            }
+        }
+        Barrier();
+    }
+
+    double PimActivationValue(PimActivation act, double x) {
+        switch (act) {
+        case PimActivation::GELU:
+            return 0.5 * x * (1.0 + std::erf(x / std::sqrt(2.0)));
+        case PimActivation::SILU:
+            return x / (1.0 + std::exp(-x));
+        case PimActivation::SIGMOID:
+            return 1.0 / (1.0 + std::exp(-x));
+        case PimActivation::TANH:
+            return std::tanh(x);
+        default:
+            return std::exp(x);
+        }
+    }
+
+    // every segment is the chord of act, moved by half the spread of the
+    // error over its Q8.8 inputs (minimax for a convex or concave segment).
+    // The lookup saturates, so a segment that crosses the Q8.8 maximum keeps
+    // the slope of act and one above it is flat at the maximum
+    void PimActivationLut(PimActivation act, unit_t* lut) {
+        double scale = 1 << PIM_FRAC_BITS;
+        double width = 2.0 * LUT_RANGE / LUT_SEGMENTS;
+        int steps = 1 << LUT_SEGMENT_SHIFT;
+        auto fixed = [&](double v) {
+            v = std::round(v * scale);
+            return (unit_t)(int16_t)std::max((double)INT16_MIN, std::min((double)INT16_MAX, v));
+        };
+        for (int k = 0; k < LUT_SEGMENTS; k++) {
+            double x0 = -LUT_RANGE + k * width;
+            double y0 = PimActivationValue(act, x0);
+            if (y0 >= INT16_MAX / scale) {
+                lut[k] = (unit_t)INT16_MAX;
+                lut[LUT_SEGMENTS + k] = 0;
+                continue;
+            }
+            double slope = (PimActivationValue(act, x0 + width) - y0) / width;
+            double lo = 0, hi = 0;
+            for (int i = 1; i < steps; i++) {
+                double dx = i / scale;
+                double e = PimActivationValue(act, x0 + dx) - (y0 + slope * dx);
+                lo = std::min(lo, e);
+                hi = std::max(hi, e);
+            }
+            lut[k] = fixed(y0 + (lo + hi) / 2);
+            lut[LUT_SEGMENTS + k] = fixed(slope);
+        }
+    }
+
+    // BG-mode sweep of bank ba over op_count words: the reads of every row
+    // and 2 writes that drain the last results of the row (2*tCCD_L).
+    //  Instead of a Barrier per row, each channel queues its next row as soon
+    //  as its controller has taken every transaction of the previous one. The
+    //  per bank command queue does not precharge past older commands of the
+    //  bank, so the drain writes still run before the next row opens, and
+    //  channels no longer wait for the slowest one
+    // repeat reads every column that many times in a row, for μkernels that
+    // run a chain of instructions per word
+    void TransactionGenerator::RowSweep(int ba, uint64_t op_count, int repeat) {
+        int num_ch = ch_end_ - ch_first_;
+        std::vector<uint64_t> row(num_ch, 0);
+        std::vector<uint64_t> idx(num_ch, 0);
+        uint64_t row_count = (op_count + NUM_WORD_PER_ROW - 1) / NUM_WORD_PER_ROW;
+        int done = 0;
+        int next_ch = 0;
+        // the 2 drain writes go out as soon as the reads of the row are issued
+        SetWriteBufferThreshold(1);
+        while (done < num_ch) {
+            bool issued = false;
+            // round robin over the ready channels, TryAddTransaction moves
+            // on to the next cycle when the issue slots are used up
+            for (int i = 0; i < num_ch && !issued; i++) {
+                int c = (next_ch + i) % num_ch;
+                int ch = ch_first_ + c;
+                if (row[c] == row_count)
+                    continue;
+                if (idx[c] == 0 && row[c] > 0 && memory_system_->IsQueuedTransaction(ch))
+                    continue;
+                uint64_t reads = std::min((uint64_t)NUM_WORD_PER_ROW, op_count - row[c] * NUM_WORD_PER_ROW) * repeat;
+                bool is_write = idx[c] >= reads;
+                // the column of the drain writes does not matter
+                int col = is_write ? (int)(idx[c] - reads) : (int)(idx[c] / repeat);
+                Address addr(ch, 0, 0, ba, (int)row[c], col);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                if (!memory_system_->WillAcceptTransaction(hex_addr, is_write))
+                    continue;
+                TryAddTransaction(hex_addr, is_write, data_temp_);
+                if (++idx[c] == reads + 2) {
+                    idx[c] = 0;
+                    if (++row[c] == row_count)
+                        done++;
+                }
+                next_ch = c + 1;
+                issued = true;
+            }
+            if (!issued) {
+                Tick();
+            }
         }
-        memory_system_.SetWriteBufferThreshold(-1);
     }
 
 
@@ -89,85 +368,71 @@ namespace dramsim3 {
     // Initialize variables and ukernel
     void AddTransactionGenerator::Initialize() {
         // base address of operands
-        addr_x_ = 0;
-        addr_y_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = addr_y_ + Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        buf_x_ = AllocOperand("x", n_ * UNIT_SIZE, PimInterleave::CONV0);
+        buf_y_ = AllocOperand("y", n_ * UNIT_SIZE, PimInterleave::CONV2);
+        buf_z_ = AllocOperand("z", n_ * UNIT_SIZE, PimInterleave::CONV1);
         
 	// base row of operands
-        base_row_x_ = addr_x_;
-        base_row_y_ = addr_y_;
-        base_row_z_ = addr_z_;
+        base_row_x_ = allocator_->GetBaseRow(buf_x_);
+        base_row_y_ = allocator_->GetBaseRow(buf_y_);
+        base_row_z_ = allocator_->GetBaseRow(buf_z_);
         base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
 
 	// row_count_:	number of rows involved in the calculation
-        row_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK) / (SIZE_ROW * NUM_BANK); 
+        row_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * num_bank_) / (SIZE_ROW * num_bank_); 
         // op_count_: 	number of burst per bank
-        op_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK) / (SIZE_WORD*NUM_BANK);   
+        op_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_) / (SIZE_WORD*num_bank_);   
 
-        ukernel_add_ = (PimInstruction*)malloc(sizeof(PimInstruction) * 32);
-        
-        // PimInstruction(type, dst, src, imm0 =0, imm1 =0)  "pim_config.h"
+        // OP  dst  src  (see pim_assembler.h)
         // src have 4 bit, 0b(bank3)(bank2)(bank1)(bank0)
-        // set dst and src to be 0 when unused (must!!!)
-        ukernel_add_[0] = PimInstruction(PIM_OPERATION::ADD, 1, 0b0101);
-        ukernel_add_[1] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1); // 531up
-        ukernel_add_[2] = PimInstruction(PIM_OPERATION::ADD, 0, 0b1010);
-        ukernel_add_[3] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_add_[4] = PimInstruction(PIM_OPERATION::ADD, 3, 0b0101);
-        ukernel_add_[5] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_add_[6] = PimInstruction(PIM_OPERATION::ADD, 2, 0b1010);
-        ukernel_add_[7] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_add_[8] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);             
+        std::string loop = std::to_string(op_count_ - 1);
+        ukernel_add_ = assembler_.Assemble(
+            "ADD       1         0b0101\n"
+            "JUMP      -1        " + loop + "\n"
+            "ADD       0         0b1010\n"
+            "JUMP      -1        " + loop + "\n"
+            "ADD       3         0b0101\n"
+            "JUMP      -1        " + loop + "\n"
+            "ADD       2         0b1010\n"
+            "JUMP      -1        " + loop + "\n"
+            "EXIT\n", "add");
     }
 
 
     // Write operand data and μkernel to physical memory and PIM registers
     void AddTransactionGenerator::SetData() {
         // strided size of one operand with one computation part(minimum)
-        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
 
         uint64_t address;
-        // Write input data x to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONV0(addr_x_ + offset);
+        // Write input data x to physical memory, a bound x is there already
+        for (int offset = 0; offset < strided_size && !IsBound("x"); offset += SIZE_WORD) {
+            address = allocator_->Address(buf_x_, offset);
             TryAddTransaction(address, true, x_ + offset);
         }
         
         // Write input data y to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONV2(addr_y_ + offset);
+        for (int offset = 0; offset < strided_size && !IsBound("y"); offset += SIZE_WORD) {
+            address = allocator_->Address(buf_y_, offset);
             TryAddTransaction(address, true, y_ + offset);
         }
         Barrier();
         
+        launch_ = Mark();
+
         // Mode transition: SB -> ABG
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] SB -> ABG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(2);  // set mode to all bank group mode
-        // push ukernel_add_ to every pim_unit "pim_func_sim.cc"
-        memory_system_.PushCRF(ukernel_add_); 
-/*
-        SETCRF() 기능 나중에 구현
-
-#ifdef debug_mode
-        std::cout << "\nHOST:\tProgram μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_add_[co * 8]);
-            }
-        }
-        Barrier();
-*/
+        SetMode(2);  // set mode to all bank group mode
+        // write ukernel_add_ to the CRF of every pim_unit
+        ProgramCRF(ukernel_add_);
     }
 
 
@@ -182,7 +447,7 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] SB -> BG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
@@ -192,12 +457,12 @@ namespace dramsim3 {
         // 모든 controller에 모드 변환을 알림
         // 아직 따로 모드 변환을 알리지 않으면 오류가 나는 상황
         // !!! must call SetMode(0) after BG operation is finished
-        memory_system_.SetMode(1); // tell memory controller to change the controller mode to BG mode
+        SetMode(1); // tell memory controller to change the controller mode to BG mode
 
         // write trans가 2개 이상일 때 부터 write transaction이 cmd로 변환된다.
         // must be set to 1 before BG-operation
         // must be set to -1 after BG-operation finished
-        memory_system_.SetWriteBufferThreshold(1);
+        SetWriteBufferThreshold(1);
 
         // dst should be changed 4 times
         for (int ba = 0; ba < 4; ba++) {
@@ -218,52 +483,18 @@ namespace dramsim3 {
                 base_row_ = BaseRow(base_row_idle_, base_row_y_, base_row_z_, base_row_x_);
             }
             // at Every DST loop, base row should be updated by SetBaseRow
-            memory_system_.SetBaseRow(base_row_);  // 메모리 시스템에 base row 보낸다.
-
-            /*************************************************
-            * Send Transaction
-            **************************************************/
-            
-            // for a given dst bank, calculate every row (row_offset: 0~(row_count_-1))
-            for (int row_offset = 0; row_offset < row_count_; row_offset++) {
-                * data_temp_ |= 1;
-                // for every col in current row, send read transaction to execute PIM OP
-                for (int col = 0; col < NUM_WORD_PER_ROW; col++) {                  
-                    // stop reading next column when all the operands are read
-                    if (row_offset * NUM_WORD_PER_ROW + col == op_count_)
-                        break;
-
-                    // send Source Bank Read
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        // must have, channel, bank, row_offset, column
-                        // "pim_func_sim.cc" will decode this information and distribute command to every banks
-                        // "controller" use this information to calculate proper cycle"
-                        Address addr(ch, 0, 0,  ba, row_offset, col);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(hex_addr, false, data_temp_); 
-                    }
-                }
-
-                // write transaction to drain out the results 
-                // 2*CCD_L의 딜레이를 계산하기 위해 추가된다.
-                // !!! this is a must! for every single row
-                // 해당하는 row의 계산이 다 끝나면 2번의 사이클 동안 기다려야 모든 값이 bank에 저장된다.
-                // 이 시간을 DRAMSIM에 구현하기 위해 write transaction을 매 row 계산마다 2번씩 가해주어야 한다.
-                for (int i = 0; i < 2; i++) {
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ba, row_offset, i); // value of column does not matter
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(hex_addr, true, data_temp_);
-                    }
-                }
+            SetBaseRow(base_row_);  // 메모리 시스템에 base row 보낸다.
 
-                Barrier(); // is a must!!!, should make a barrier at every row operation
-            }
+            // for a given dst bank, calculate every row, each channel at its
+            // own pace. The base row changes with the dst bank, so wait for
+            // every channel before the next one
+            RowSweep(ba, op_count_);
+            Barrier();
         }
         // for every DST, calculation is finished
         // ABG mode to BG mode is converted via EXIT command --> no need to add additional cycles
-        memory_system_.SetMode(2); 			// tell memory sysem to change the controllers mode to ABG mode
-        memory_system_.SetWriteBufferThreshold(-1); 	// change threshold to default value
+        SetMode(2); 			// tell memory sysem to change the controllers mode to ABG mode
+        SetWriteBufferThreshold(-1); 	// change threshold to default value
     }
 
     // Read PIM computation result from physical memory
@@ -273,22 +504,23 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "HOST:\t[4] ABG -> SB \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(0); 
+        SetMode(0); 
+        readback_ = Mark();
 
-        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data z
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
+        // Read output data z, a bound z stays in PIM for the next kernel
 #ifdef debug_mode
         std::cout << "\nHOST:\tRead output data z\n";
 #endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
+        for (int offset = 0; offset < strided_size && !IsBound("z"); offset += SIZE_WORD) {
             uint64_t address;
-            address = ADDR_CONV1(addr_z_ + offset);
+            address = allocator_->Address(buf_z_, offset);
             TryAddTransaction(address, false, z_ + offset);
         }
         Barrier();
@@ -296,6 +528,10 @@ namespace dramsim3 {
 
     // Calculate error between the result of PIM computation and actual answer
     void AddTransactionGenerator::CheckResult() {
+        if (IsBound("z")) {
+            std::cout << "z kept in PIM, not checked" << std::endl;
+            return;
+        }
         int err = 0;
         uint16_t sum;
         for (int i = 0; i < n_; i++) {
@@ -311,68 +547,69 @@ namespace dramsim3 {
     // Initialize variables and ukernel
     void MulTransactionGenerator::Initialize() {
         // base address of operands
-        addr_x_ = 0;
-        addr_y_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = addr_y_ + Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        buf_x_ = AllocOperand("x", n_ * UNIT_SIZE, PimInterleave::CONV0);
+        buf_y_ = AllocOperand("y", n_ * UNIT_SIZE, PimInterleave::CONV1);
+        buf_z_ = AllocOperand("z", n_ * UNIT_SIZE, PimInterleave::CONV2);
 
-        base_row_x_ = addr_x_;
-        base_row_y_ = addr_y_;
-        base_row_z_ = addr_z_;
+        base_row_x_ = allocator_->GetBaseRow(buf_x_);
+        base_row_y_ = allocator_->GetBaseRow(buf_y_);
+        base_row_z_ = allocator_->GetBaseRow(buf_z_);
         base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
         
-        row_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK) / (SIZE_ROW * NUM_BANK); 
-        op_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK) / (SIZE_WORD*NUM_BANK);   
-
-        ukernel_mul_ = (PimInstruction*)malloc(sizeof(PimInstruction) * 32);
-        
-        // PimInstruction(type, dst, src, imm0 =0, imm1 =0)      
-        ukernel_mul_[0] = PimInstruction(PIM_OPERATION::MUL, 2, 0b0011);
-        ukernel_mul_[1] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1); 
-        ukernel_mul_[2] = PimInstruction(PIM_OPERATION::MUL, 3, 0b0011);
-        ukernel_mul_[3] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_mul_[4] = PimInstruction(PIM_OPERATION::MUL, 0, 0b1100);
-        ukernel_mul_[5] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_mul_[6] = PimInstruction(PIM_OPERATION::MUL, 1, 0b1100);
-        ukernel_mul_[7] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_mul_[8] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);             
+        row_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_ROW * num_bank_) / (SIZE_ROW * num_bank_); 
+        op_count_ = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_) / (SIZE_WORD*num_bank_);   
+
+        std::string loop = std::to_string(op_count_ - 1);
+        ukernel_mul_ = assembler_.Assemble(
+            "MUL       2         0b0011\n"
+            "JUMP      -1        " + loop + "\n"
+            "MUL       3         0b0011\n"
+            "JUMP      -1        " + loop + "\n"
+            "MUL       0         0b1100\n"
+            "JUMP      -1        " + loop + "\n"
+            "MUL       1         0b1100\n"
+            "JUMP      -1        " + loop + "\n"
+            "EXIT\n", "mul");
     }
     
     // Write operand data and μkernel to physical memory and PIM registers
     void MulTransactionGenerator::SetData() {
         // strided size of one operand with one computation part(minimum)
-        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
 
 #ifdef debug_mode
         std::cout << "HOST:\tSet input data\n";
 #endif
 
         uint64_t address;
-        // Write input data x to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONV0(addr_x_ + offset);
+        // Write input data x to physical memory, a bound x is there already
+        for (int offset = 0; offset < strided_size && !IsBound("x"); offset += SIZE_WORD) {
+            address = allocator_->Address(buf_x_, offset);
             TryAddTransaction(address, true, x_ + offset);
         }
         
         // Write input data y to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONV1(addr_y_ + offset);
+        for (int offset = 0; offset < strided_size && !IsBound("y"); offset += SIZE_WORD) {
+            address = allocator_->Address(buf_y_, offset);
             TryAddTransaction(address, true, y_ + offset);
         }
         Barrier();
         
+        launch_ = Mark();
+
 	// Mode transition: SB -> ABG
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] SB -> ABG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(2);  // set mode to all bank group mode
+        SetMode(2);  // set mode to all bank group mode
 
-        memory_system_.PushCRF(ukernel_mul_); 
+        ProgramCRF(ukernel_mul_);
     }
 
     // Execute PIM computation
@@ -385,16 +622,16 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] ABG -> BG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
 
-        memory_system_.SetMode(1); // tell memory controller to change the controllers mode to BG mode
+        SetMode(1); // tell memory controller to change the controllers mode to BG mode
 
-        memory_system_.SetWriteBufferThreshold(1);
+        SetWriteBufferThreshold(1);
 
         for (int ba = 0; ba < 4; ba++) {
             BaseRow base_row_;
@@ -411,46 +648,14 @@ namespace dramsim3 {
             case 3:
                 base_row_ = BaseRow(base_row_idle_, base_row_z_, base_row_y_, base_row_x_);
             }
-            memory_system_.SetBaseRow(base_row_); 
-
-            /*************************************************
-            * Send Transaction
-            **************************************************/
-            // now which variable bank represent is defined
-            // should calculate every row in this defined state
-            for (int row_offset = 0; row_offset < row_count_; row_offset++) {
-                * data_temp_ |= 1;
-                
-                for (int col = 0; col < NUM_WORD_PER_ROW; col++) {
-                    
-                    // all X finished, then break
-                    if (row_offset * NUM_WORD_PER_ROW + col == op_count_)
-                        break;
-
-                    // send Source Bank Read
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0,  ba, row_offset, col);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(hex_addr, false, data_temp_); 
-                    }
-                }
+            SetBaseRow(base_row_); 
 
-                // write transaction to drain out the results 
-                // 2*CCD_L의 딜레이를 계산하기 위해 추가된다.
-                for (int i = 0; i < 2; i++) {
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ba, row_offset, i); // at this time, col does not matter
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-			 // putting 2 write command in bank0 at same row is the only thing that matters
-                        TryAddTransaction(hex_addr, true, data_temp_);
-                    }
-                }
-
-                Barrier(); // 1 row finished, wait till all the row operations are done
-            }
+            // calculate every row in this defined state (see RowSweep)
+            RowSweep(ba, op_count_);
+            Barrier();
         }
-        memory_system_.SetMode(2); // tell memory sysem to change the controllers mode to SB mode
-        memory_system_.SetWriteBufferThreshold(-1); // change threshold to default value
+        SetMode(2); // tell memory sysem to change the controllers mode to SB mode
+        SetWriteBufferThreshold(-1); // change threshold to default value
     }
     
     // Read PIM computation result from physical memory
@@ -460,22 +665,23 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "HOST:\t[4] ABG -> SB \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(0);
+        SetMode(0);
+        readback_ = Mark();
 
-        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data z
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
+        // Read output data z, a bound z stays in PIM for the next kernel
 #ifdef debug_mode
         std::cout << "\nHOST:\tRead output data z\n";
 #endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
+        for (int offset = 0; offset < strided_size && !IsBound("z"); offset += SIZE_WORD) {
             uint64_t address;
-            address = ADDR_CONV2(addr_z_ + offset);
+            address = allocator_->Address(buf_z_, offset);
             TryAddTransaction(address, false, z_ + offset);
         }
         Barrier();
@@ -483,6 +689,10 @@ namespace dramsim3 {
     
     // Calculate error between the result of PIM computation and actual answer
     void MulTransactionGenerator::CheckResult() {
+        if (IsBound("z")) {
+            std::cout << "z kept in PIM, not checked" << std::endl;
+            return;
+        }
         int err = 0;
         uint16_t prod;
         for (int i = 0; i < n_; i++) {
@@ -495,47 +705,48 @@ namespace dramsim3 {
     
     void BatchNormTransactionGenerator::Initialize() {
         // base address of operands
-        addr_x_ = 0;
-        addr_w_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_y_ = addr_w_ + Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = addr_y_ + Ceiling(f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        buf_x_ = Alloc(l_ * f_ * UNIT_SIZE, PimInterleave::CONV0);
+        buf_w_ = Alloc(l_ * f_ * UNIT_SIZE, PimInterleave::CONV2);
+        // y and z are replicated to 4096 * 2 units by the host (see SetData)
+        buf_y_ = Alloc(4096 * 2 * UNIT_SIZE, PimInterleave::CONV1);
+        buf_z_ = Alloc(4096 * 2 * UNIT_SIZE, PimInterleave::CONV3);
         // base row
-        base_row_x_ = addr_x_;
-        base_row_w_ = addr_w_;
-        base_row_y_ = addr_y_;
-        base_row_z_ = addr_z_;
+        base_row_x_ = allocator_->GetBaseRow(buf_x_);
+        base_row_w_ = allocator_->GetBaseRow(buf_w_);
+        base_row_y_ = allocator_->GetBaseRow(buf_y_);
+        base_row_z_ = allocator_->GetBaseRow(buf_z_);
         base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
         // how many rows (X and W)
-        row_count_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK) / (SIZE_ROW * NUM_BANK);
+        row_count_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * num_bank_) / (SIZE_ROW * num_bank_);
         // how many operation needed
-        op_count_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * NUM_BANK) / (SIZE_WORD * NUM_BANK);
-        
-        ukernel_bn_ = (PimInstruction*)malloc(sizeof(PimInstruction)*32);
+        op_count_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * num_bank_) / (SIZE_WORD * num_bank_);
         
-        ukernel_bn_[0] =  PimInstruction(PIM_OPERATION::LD, 0, 0b1010);
-        ukernel_bn_[1] =  PimInstruction(PIM_OPERATION::LD, 0, 0b1010);
-        ukernel_bn_[2] =  PimInstruction(PIM_OPERATION::BN, 2, 0b0001);
-        ukernel_bn_[3] =  PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_bn_[4] =  PimInstruction(PIM_OPERATION::LD, 0, 0b0101);
-        ukernel_bn_[5] =  PimInstruction(PIM_OPERATION::LD, 0, 0b0101);
-        ukernel_bn_[6] =  PimInstruction(PIM_OPERATION::BN, 3, 0b0010);
-        ukernel_bn_[7] =  PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_bn_[8] =  PimInstruction(PIM_OPERATION::LD, 0, 0b1010);
-        ukernel_bn_[9] =  PimInstruction(PIM_OPERATION::LD, 0, 0b1010);
-        ukernel_bn_[10] = PimInstruction(PIM_OPERATION::BN, 0, 0b0100);
-        ukernel_bn_[11] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_bn_[12] = PimInstruction(PIM_OPERATION::LD, 0, 0b0101);
-        ukernel_bn_[13] = PimInstruction(PIM_OPERATION::LD, 0, 0b0101);
-        ukernel_bn_[14] = PimInstruction(PIM_OPERATION::BN, 1, 0b1000);
-        ukernel_bn_[15] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, op_count_-1);
-        ukernel_bn_[16] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);
+        std::string loop = std::to_string(op_count_ - 1);
+        ukernel_bn_ = assembler_.Assemble(
+            "LD        0         0b1010\n"
+            "LD        0         0b1010\n"
+            "BN        2         0b0001\n"
+            "JUMP      -1        " + loop + "\n"
+            "LD        0         0b0101\n"
+            "LD        0         0b0101\n"
+            "BN        3         0b0010\n"
+            "JUMP      -1        " + loop + "\n"
+            "LD        0         0b1010\n"
+            "LD        0         0b1010\n"
+            "BN        0         0b0100\n"
+            "JUMP      -1        " + loop + "\n"
+            "LD        0         0b0101\n"
+            "LD        0         0b0101\n"
+            "BN        1         0b1000\n"
+            "JUMP      -1        " + loop + "\n"
+            "EXIT\n", "bn");
     
     }
 
     void BatchNormTransactionGenerator::SetData(){
         // strided size of one operand with one computation part(minimum)
-        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        uint64_t strided_size_ = Ceiling(4096 * 2 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * num_bank_);
+        uint64_t strided_size_ = Ceiling(4096 * 2 * UNIT_SIZE, SIZE_WORD * num_bank_);
 
 #ifdef debug_mode
         std::cout << "HOST:\tSet input data\n";
@@ -545,34 +756,36 @@ namespace dramsim3 {
 	
         // Write input data x to physical memory
         for (int offset = 0; offset < strided_size; offset += SIZE_WORD){
-            address = ADDR_CONV0(addr_x_ + offset);
+            address = allocator_->Address(buf_x_, offset);
             TryAddTransaction(address, true, x_ + offset);
 	}
         // Write input data y to physical memory
         for (int offset = 0; offset < strided_size_; offset += SIZE_WORD) {
-            address = ADDR_CONV1(addr_y_ + offset);
+            address = allocator_->Address(buf_y_, offset);
             TryAddTransaction(address, true, y_ + offset);
         }
         // Write input data z to physical memory
         for (int offset = 0; offset < strided_size_; offset += SIZE_WORD) {
-            address = ADDR_CONV3(addr_z_ + offset);
+            address = allocator_->Address(buf_z_, offset);
             TryAddTransaction(address, true, z_ + offset);
         }
         Barrier();
         
+        launch_ = Mark();
+
         // Mode transition: SB -> ABG
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] SB -> ABG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(2);  // set mode to all bank group mode
+        SetMode(2);  // set mode to all bank group mode
         
-        memory_system_.PushCRF(ukernel_bn_);
+        ProgramCRF(ukernel_bn_);
     }
 
     void BatchNormTransactionGenerator::Execute() {
@@ -582,15 +795,15 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] ABG -> BG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
 
-        memory_system_.SetMode(1); // tell memory controller to change the controllers mode to BG mode
-        memory_system_.SetWriteBufferThreshold(1);
+        SetMode(1); // tell memory controller to change the controllers mode to BG mode
+        SetWriteBufferThreshold(1);
         
         BaseRow base_row_load_;
         BaseRow base_row_bn_;
@@ -617,10 +830,10 @@ namespace dramsim3 {
             }
             
             // SetBaseRow for LOAD
-            memory_system_.SetBaseRow(base_row_load_);
+            SetBaseRow(base_row_load_);
             // load read transaction (load y and z to cache
             for(int col=0; col < 2; col++){
-                for(int ch=0; ch<NUM_CHANNEL; ch++){
+                for (int ch = ch_first_; ch < ch_end_; ch++){
                     Address addr(ch, 0, 0, ba, 0, col);
                     uint64_t hex_addr = ReverseAddressMapping(addr);
                     TryAddTransaction(hex_addr, false, data_temp_);
@@ -629,33 +842,13 @@ namespace dramsim3 {
             Barrier(); // y, z should be set before batch normalization start
             	    
             // ba bn set
-            memory_system_.SetBaseRow(base_row_bn_);
-            // row for loop
-            for(int row_offset = 0; row_offset < row_count_; row_offset++){
-                // bn read transaction
-                for(int col=0; col < NUM_WORD_PER_ROW; col++){
-                    if(row_offset*NUM_WORD_PER_ROW+col == op_count_){ break; }
-                    for(int ch = 0; ch<NUM_CHANNEL; ch++){
-                        Address addr(ch, 0, 0, ba, row_offset, col);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(hex_addr, false, data_temp_);
-                    }
-                }
-                // drain write
-                for (int i = 0; i < 2; i++) {
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ba, row_offset, i); // at this time, col does not matter
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-			 // putting 2 write command in bank0 at same row is the only thing that matters
-                        TryAddTransaction(hex_addr, true, data_temp_);
-                    }
-                }
-                // barrier
-                Barrier();
-            }
+            SetBaseRow(base_row_bn_);
+            // row sweep, each channel at its own pace
+            RowSweep(ba, op_count_);
+            Barrier();
         } 
-        memory_system_.SetMode(2);
-        memory_system_.SetWriteBufferThreshold(-1);   
+        SetMode(2);
+        SetWriteBufferThreshold(-1);   
     }
 
     void BatchNormTransactionGenerator::GetResult(){
@@ -663,22 +856,23 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "HOST:\t[4] ABG -> SB \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(0);
+        SetMode(0);
+        readback_ = Mark();
 
-        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * num_bank_);
         // Read output data w
 #ifdef debug_mode
         std::cout << "\nHOST:\tRead output data z\n";
 #endif
         for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
             uint64_t address;
-            address = ADDR_CONV2(addr_w_ + offset);
+            address = allocator_->Address(buf_w_, offset);
             TryAddTransaction(address, false, w_ + offset);
         }
         Barrier(); 
@@ -697,71 +891,92 @@ namespace dramsim3 {
         std::cout << "ERROR : " << err << std::endl;
     }
 
+    // Loop of a GEMV tile, 8 even and 8 odd columns per SRF word (step).
+    // Steps alternate between the SRF buffers (GEMV imm1) so the host can
+    // write the next SRF word while a step computes
+    static std::string GemvTileLoop(int steps, int batch) {
+        std::string half[SRF_BUFFERS];
+        for (int buf = 0; buf < SRF_BUFFERS; buf++) {
+            half[buf] =
+                "GEMV      4         0b0101    " + std::to_string(batch) + "  " + std::to_string(buf) + "\n"
+                "JUMP      -1        7\n"
+                "GEMV      5         0b1010    " + std::to_string(batch) + "  " + std::to_string(buf) + "\n"
+                "JUMP      -1        7\n";
+        }
+        std::string loop;
+        int pairs = steps / 2;
+        if (pairs > 0) {
+            loop = half[0] + half[1];
+            if (pairs > 1)
+                loop += "JUMP      -8        " + std::to_string(pairs - 1) + "\n";
+        }
+        if (steps & 1)
+            loop += half[0];
+        return loop;
+    }
+
+    // tiles runs of the tile kernel body, an outer loop around the steps
+    static std::string GemvTiles(const std::string& tile, uint64_t tiles) {
+        if (tiles < 2)
+            return tile;
+        int lines = (int)std::count(tile.begin(), tile.end(), '\n');
+        return tile + "JUMP      -" + std::to_string(lines) + "        " + std::to_string(tiles - 1) + "\n";
+    }
+
         // Initialize variables and ukernel
     void GemvTransactionGenerator::Initialize() {
-        // base address of operands
-        addr_A_ = 0;
-        addr_A2_ = Ceiling(2048 * n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_y_ = Ceiling(m_* n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        // A is split in tiles of tile_m_ rows, tails are zero padded
+        tile_m_ = NUM_UNIT_PER_WORD * num_bank_ / 2;
+        m_pad_ = Ceiling(m_, tile_m_);
+        n_pad_ = Ceiling(n_, GEMV_TILE_N);
+        num_tiles_ = m_pad_ / tile_m_;
+        tile_stride_ = Ceiling(tile_m_ * n_pad_ * UNIT_SIZE, SIZE_ROW * num_bank_);
+        x_pad_ = (uint8_t*)calloc(n_pad_, UNIT_SIZE);
+        y_pad_ = (uint8_t*)calloc(m_pad_, UNIT_SIZE);
+
+        // base address of operands. Tile k of y is stored to column k of
+        // bank 0,1, at offset 2 * k * tile_m_ units of buf_y_ (banks 2,3 of
+        // y stay unused)
+        buf_A_ = Alloc(num_tiles_ * tile_stride_, PimInterleave::CONVG);
+        buf_y_ = Alloc(2 * m_pad_ * UNIT_SIZE, PimInterleave::CONVG);
         
 	// base row of operands
-        base_row_A_ = addr_A_;
-        base_row_A2_ = addr_A2_;
-        base_row_y_ = addr_y_;
+        base_row_A_ = allocator_->GetBaseRow(buf_A_);
+        base_row_y_ = allocator_->GetBaseRow(buf_y_);
         base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
         
-        ukernel_access_size_ = SIZE_WORD * 8 * NUM_BANK;
-        ukernel_count_per_pim_ = Ceiling(2048 * n_ * UNIT_SIZE, ukernel_access_size_) / ukernel_access_size_; 
-
-        ukernel_gemv_ = (PimInstruction*)malloc(sizeof(PimInstruction) * 32);
-        
-        // PimInstruction(type, dst, src, imm0 =0, imm1 =0)  "pim_config.h"
-        // src have 4 bit, 0b(bank3)(bank2)(bank1)(bank0)
-        // set dst and src to be 0 when unused (must!!!)
-        ukernel_gemv_[0] = PimInstruction(PIM_OPERATION::GEMV, 4, 0b0101);
-        ukernel_gemv_[1] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_[2] = PimInstruction(PIM_OPERATION::GEMV, 5, 0b1010);
-        ukernel_gemv_[3] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_[4] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);
-        
-        ukernel_gemv_last_ = (PimInstruction*)malloc(sizeof(PimInstruction) * 32);
-        
-        // PimInstruction(type, dst, src, imm0 =0, imm1 =0)  "pim_config.h"
-        // src have 4 bit, 0b(bank3)(bank2)(bank1)(bank0)
-        // set dst and src to be 0 when unused (must!!!)
-        ukernel_gemv_last_[0] = PimInstruction(PIM_OPERATION::GEMV, 4, 0b0101);
-        ukernel_gemv_last_[1] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_last_[2] = PimInstruction(PIM_OPERATION::GEMV, 5, 0b1010);
-        ukernel_gemv_last_[3] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_last_[4] = PimInstruction(PIM_OPERATION::ST, 0, 0b10000);
-        ukernel_gemv_last_[5] = PimInstruction(PIM_OPERATION::ST, 1, 0b100000);
-        ukernel_gemv_last_[6] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);
-        
-        ukernel_gemv_last__ = (PimInstruction*)malloc(sizeof(PimInstruction) * 32);
-        
-        // PimInstruction(type, dst, src, imm0 =0, imm1 =0)  "pim_config.h"
-        // src have 4 bit, 0b(bank3)(bank2)(bank1)(bank0)
-        // set dst and src to be 0 when unused (must!!!)
-        ukernel_gemv_last__[0] = PimInstruction(PIM_OPERATION::GEMV, 4, 0b0101);
-        ukernel_gemv_last__[1] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_last__[2] = PimInstruction(PIM_OPERATION::GEMV, 5, 0b1010);
-        ukernel_gemv_last__[3] = PimInstruction(PIM_OPERATION::JUMP, 0, 0, -1, 7);
-        ukernel_gemv_last__[4] = PimInstruction(PIM_OPERATION::ST, 2, 0b10000);
-        ukernel_gemv_last__[5] = PimInstruction(PIM_OPERATION::ST, 3, 0b100000);
-        ukernel_gemv_last__[6] = PimInstruction(PIM_OPERATION::EXIT, 0, 0);
+        ukernel_access_size_ = SIZE_WORD * 8 * num_bank_;
+        ukernel_count_per_pim_ = Ceiling(tile_m_ * n_pad_ * UNIT_SIZE, ukernel_access_size_) / ukernel_access_size_; 
+
+        // OP  dst  src  (see pim_assembler.h)
+        // src have 4 bit, 0b(bank3)(bank2)(bank1)(bank0), ST src 0x10/0x20
+        // only makes the store run without a bank read
+        // One kernel runs every tile, it stores a tile after its last step
+        // and the reads of the ST pick the column of the tile
+        std::string tile = GemvTileLoop(ukernel_count_per_pim_, 1) +
+            "ST        0         0b10000\n"
+            "ST        1         0b100000\n";
+        ukernel_gemv_ = assembler_.Assemble(GemvTiles(tile, num_tiles_) + "EXIT\n", "gemv");
     }
     
         // Write operand data and μkernel to physical memory and PIM registers
     void GemvTransactionGenerator::SetData() {
-        // strided size of one operand with one computation part(minimum)
-        uint64_t strided_size = Ceiling(m_ * n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+        LoadWeight();
+        launch_ = Mark();
+        EnterPim();
+    }
+
+    // Transpose A into 2048 row chunks and write it in the ADDR_CONVG layout
+    void GemvTransactionGenerator::LoadWeight() {
+        // size of one tile of A
+        uint64_t tile_size = tile_m_ * n_pad_ * UNIT_SIZE;
         
-        // Transpose Input data 
-        A_T_ = (uint8_t*) malloc(sizeof(uint16_t)*m_*n_);
-        for(int M=0; M<m_; M+=2048){
-            for(int m=0; m<2048; m++){
+        // Transpose Input data, tile by tile
+        A_T_ = (uint8_t*) calloc(m_pad_ * n_pad_, sizeof(uint16_t));
+        for(int M=0; M<m_; M+=tile_m_){
+            for(int m=0; m<tile_m_ && M+m<m_; m++){
                 for(int n=0; n<n_; n++){
-                    ((uint16_t*)A_T_)[M*n_+n*2048+m] = ((uint16_t*)A_)[(M+m)*n_+n];
+                    ((uint16_t*)A_T_)[M*n_pad_+n*tile_m_+m] = ((uint16_t*)A_)[(M+m)*n_+n];
                 }
             }
         }
@@ -770,145 +985,121 @@ namespace dramsim3 {
         std::cout << "HOST:\tSet input data\n";
 #endif
         uint64_t address;
-        // Write input data x to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONVG(addr_A_ + offset);
-            TryAddTransaction(address, true, A_T_ + offset);
+        // Write input data A to physical memory
+        for (uint64_t k = 0; k < num_tiles_; k++) {
+            for (uint64_t offset = 0; offset < tile_size; offset += SIZE_WORD) {
+                address = allocator_->Address(buf_A_, k * tile_stride_ + offset);
+                TryAddTransaction(address, true, A_T_ + k * tile_size + offset);
+            }
         }
+        // write transactions keep their own copy of the data
+        free(A_T_);
+        weight_loaded_ = true;
+    }
 
-        
+    // SB -> ABG
+    void GemvTransactionGenerator::EnterPim() {
 	// Mode transition: SB -> ABG
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] SB -> ABG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(2);  // set mode to all bank group mode
-
-        memory_system_.PushCRF(ukernel_gemv_); 
+        SetMode(2);  // set mode to all bank group mode
     }
     
     
     void GemvTransactionGenerator::Execute(){
 
-        memory_system_.SetWriteBufferThreshold(1); // set write buffer threshold
-        BaseRow base_row_;
-        
-        
-        // NUM_WORD_PER_ROW / 8 = 4
-        for(int k = 0; k < m_/2048; k++){
-        for(int row_offset=0; (row_offset*4) < ukernel_count_per_pim_; row_offset++){
-            for(int co_o = 0; co_o < 4; co_o++){
-            	// SRF update
-            	std::memcpy(data_temp_, ((uint16_t*)x_) + (row_offset * 4 + co_o) * NUM_UNIT_PER_WORD, SIZE_WORD);
-                
-                // set SRF
-                for(int ch=0; ch < NUM_CHANNEL; ch++){
-                    Address addr(ch, 0, 0, 0, MAP_SRF, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    //std::cout << "Is proper--?: " << *((uint16_t*)data_temp_) << std::endl;
-                    TryAddTransaction(hex_addr, true, data_temp_);
-                }
-                Barrier();
-                
-                // if last gemv ukernel to execute, add new gemv ukernel
-                if(row_offset*4+co_o >= ukernel_count_per_pim_-1){
-                    if(k&1){memory_system_.PushCRF(ukernel_gemv_last__);}
-                    else{memory_system_.PushCRF(ukernel_gemv_last_);}
-                }
-                
-                // mode transition
-                *data_temp_ |= 1;
+        SetWriteBufferThreshold(1); // set write buffer threshold
+        std::memcpy(x_pad_, x_, n_ * UNIT_SIZE);
+        ProgramCRF(ukernel_gemv_);
+
+        // mode transition, the kernel runs every tile in BG mode
+        *data_temp_ |= 1;
 #ifdef debug_mode
         std::cout << "\nHOST:\t[1] ABG -> BG \n";
 #endif
-        	for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-     		    Address addr(ch, 0, 0, 1, MAP_BGMR, 0);
-    		    uint64_t hex_addr = ReverseAddressMapping(addr);
-    		    TryAddTransaction(hex_addr, false, data_temp_);
-     		}
-       	Barrier();
-
-        	memory_system_.SetMode(1); // tell memory controller to change the controllers mode to BG mode
-        	// iterate even(odd=0) - odd(odd=1) banks.
-        	for(int odd = 0; odd < 2; odd++){
-        	    uint64_t base_row_A = k ? base_row_A2_ : base_row_A_;
-        	    // set base row
-        	    switch(odd){
-        	    case 0:
-        	        base_row_ = BaseRow(base_row_A, base_row_idle_, base_row_A, base_row_idle_);
-        	        break;
-        	    case 1:
-        	        base_row_ = BaseRow(base_row_idle_, base_row_A, base_row_idle_, base_row_A);
-        	    }
-            	    memory_system_.SetBaseRow(base_row_);
-            	    
-            	    // send read transaction to all 8 columns
-            	    for(int col_i = 0; col_i < 8; col_i++){
-            	        int col = co_o * 8 + col_i;
-            	        for(int ch=0; ch < NUM_CHANNEL; ch++){
-            	            Address addr(ch, 0, 0, odd, row_offset, col);
-            	            uint64_t hex_addr = ReverseAddressMapping(addr);
-            	            TryAddTransaction(hex_addr, false, data_temp_);
-            	        }
-            	    }
-            	    if(!odd) Barrier(); // only barrier between odd=0 and odd=1
-        	}
-        	// drain out results to ACC (additional 2 cycles)        	
-        	for (int i = 0; i < 2; i++) {
-        	    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-        	        int col = co_o*8 + i; // how the col are selected?
-        	        // this col is selected to send 2 write command to the last used bank
-        	        Address addr(ch, 0, 0, 0, row_offset, col); 
-        	        uint64_t hex_addr = ReverseAddressMapping(addr);
-        	        TryAddTransaction(hex_addr, true, data_temp_);
-        	    }
-        	}
-		Barrier();
-		
-                // for last ukernel write 2 to drain out the results
-                if(row_offset*4+co_o >= ukernel_count_per_pim_-1){   
-                    if(k==0){
-                        base_row_ = BaseRow(base_row_y_, base_row_y_, base_row_idle_, base_row_idle_ );  
-                    }
-                    else{
-                        base_row_ = BaseRow(base_row_idle_, base_row_idle_, base_row_y_, base_row_y_ ); 
-                    }
-                    memory_system_.SetBaseRow(base_row_); 
-                    
-                    // send read transaction to activate two store command
-                    for(int ba = 0; ba<2; ba++){
-                        for(int ch=0; ch < NUM_CHANNEL; ch++){
-                            Address addr(ch, 0, 0, ba, 0, 0);
-                            uint64_t hex_addr = ReverseAddressMapping(addr);
-            	             TryAddTransaction(hex_addr, false, data_temp_);
-                        }      
-                    }
-                    
-                    // drain out the results
-                    // drain write
-                    for (int i = 0; i < 2; i++) {
-                        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                            Address addr(ch, 0, 0, 0, 0, i); // at this time, col does not matter
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 1, MAP_BGMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
+        }
+        Barrier();
+        SetMode(1); // tell memory controller to change the controllers mode to BG mode
+
+        // the commands carry the whole row of A and y, base rows stay 0
+        SetBaseRow(BaseRow(0, 0, 0, 0));
+        int row_shift = config_->ro_pos + config_->shift_bits;
+        int row = 0;
+        // the controller issues the reads of a channel in order. reads counts
+        // them, an SRF buffer is free once the command after the last read
+        // on it ran its GEMV
+        uint64_t reads = 0;
+        uint64_t srf_free[SRF_BUFFERS] = {0};
+        for (uint64_t k = 0; k < num_tiles_; k++) {
+            int row_A = allocator_->GetBaseRow(buf_A_, k * tile_stride_) >> row_shift;
+            for (int step = 0; step < ukernel_count_per_pim_; step++) {
+                // SRF word of the step to its buffer, written in BG mode
+                // while the previous step computes on the other one
+                std::memcpy(data_temp_, ((uint16_t*)x_pad_) + step * NUM_UNIT_PER_WORD, SIZE_WORD);
+                int buf = step % SRF_BUFFERS;
+                WaitPimCommands(srf_free[buf]);
+                for (int ch = ch_first_; ch < ch_end_; ch++) {
+                    Address addr(ch, 0, 0, 0, MAP_SRF, buf * PIM_MAX_BATCH);
+                    uint64_t hex_addr = ReverseAddressMapping(addr);
+                    TryAddTransaction(hex_addr, true, data_temp_);
+                }
+
+                row = row_A + step / 4;
+                int co_o = step % 4;
+                // iterate even(odd=0) - odd(odd=1) banks.
+                for (int odd = 0; odd < 2; odd++) {
+                    // send read transaction to all 8 columns
+                    for (int col_i = 0; col_i < 8; col_i++) {
+                        int col = co_o * 8 + col_i;
+                        for (int ch = ch_first_; ch < ch_end_; ch++) {
+                            Address addr(ch, 0, 0, odd, row, col);
                             uint64_t hex_addr = ReverseAddressMapping(addr);
-			     // putting 2 write command in bank0 at same row is the only thing that matters
-                            TryAddTransaction(hex_addr, true, data_temp_);
+                            TryAddTransaction(hex_addr, false, data_temp_);
                         }
+                        reads++;
                     }
-                    // barrier
-                    Barrier();   
-                    if(k != m_/2048 - 1) memory_system_.PushCRF(ukernel_gemv_);                        
                 }
-                
-                // set mode to 2, EXIT command will do the role
-                memory_system_.SetMode(2);            
+                srf_free[buf] = reads + 1;
+            }
+
+            // ST 0 and ST 1 store the ACC of tile k to column k of bank 0,1,
+            // at the address of their reads
+            row = (base_row_y_ >> row_shift) + k / NUM_WORD_PER_ROW;
+            for (int ba = 0; ba < 2; ba++) {
+                for (int ch = ch_first_; ch < ch_end_; ch++) {
+                    Address addr(ch, 0, 0, ba, row, k % NUM_WORD_PER_ROW);
+                    uint64_t hex_addr = ReverseAddressMapping(addr);
+                    TryAddTransaction(hex_addr, false, data_temp_);
+                }
+                reads++;
+            }
+        }
+
+        // drain out the results of the last tile, after its stores
+        WaitPimCommands(reads);
+        for (int i = 0; i < 2; i++) {
+            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                Address addr(ch, 0, 0, 0, row, i); // at this time, col does not matter
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                // putting 2 write command in bank0 at same row is the only thing that matters
+                TryAddTransaction(hex_addr, true, data_temp_);
             }
         }
-        }             
+        Barrier();
+
+        // set mode to 2, EXIT command will do the role
+        SetMode(2);
     }
     
     void GemvTransactionGenerator::GetResult(){
@@ -916,25 +1107,42 @@ namespace dramsim3 {
 #ifdef debug_mode
         std::cout << "HOST:\t[4] ABG -> SB \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-        memory_system_.SetMode(0);
+        SetMode(0);
+        readback_ = Mark();
 
-        uint64_t strided_size = Ceiling(m_ * UNIT_SIZE, SIZE_WORD * (NUM_BANK));
+        uint64_t tile_size = tile_m_ * UNIT_SIZE;
         uint64_t address;
-        // Write input data x to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD) {
-            address = ADDR_CONVG(addr_y_ + offset);
-            // std::cout << "original: " << std::hex << addr_y_+offset << " converted: " << address << std::endl;
-            TryAddTransaction(address, false, y_ + offset);
+        // Read output data y (with the padded tail) from physical memory
+        for (uint64_t k = 0; k < num_tiles_; k++) {
+            for (uint64_t offset = 0; offset < tile_size; offset += SIZE_WORD) {
+                address = allocator_->Address(buf_y_, 2 * k * tile_size + offset);
+                TryAddTransaction(address, false, y_pad_ + k * tile_size + offset);
+            }
         }
         Barrier();      
+        std::memcpy(y_, y_pad_, m_ * UNIT_SIZE);
     }
     
+    uint64_t GemvTransactionGenerator::Invoke(uint8_t* x) {
+        if (!weight_loaded_) {
+            std::cerr << "GEMV invoked before LoadWeight()" << std::endl;
+            exit(1);
+        }
+        uint64_t start_clk = clk_;
+        x_ = x;
+        // the previous step left the last ukernel in CRF and the banks in SB
+        EnterPim();
+        Execute();
+        GetResult();
+        return clk_ - start_clk;
+    }
+
     void GemvTransactionGenerator::CheckResult(){
         int err = 0;
         uint16_t inner_product;
@@ -948,1247 +1156,1474 @@ namespace dramsim3 {
         }
         std::cout << "ERROR: " << err << std::endl;
     }
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    /*
 
+    LstmTransactionGenerator::LstmTransactionGenerator(const std::string& config_file,
+        const std::string& output_dir, uint64_t i_f, uint64_t o_f, uint8_t* x,
+        uint8_t* y, uint8_t* h, uint8_t* b, uint8_t* Wx, uint8_t* Wh,
+        PimScheduler* scheduler)
+        : GemvTransactionGenerator(config_file, output_dir, 4 * o_f, i_f + o_f + 1,
+            NULL, NULL, y, scheduler),
+        b_(b), Wx_(Wx), Wh_(Wh), i_f_(i_f), o_f_(o_f) {
+        // A = [Wx | Wh | b], x = [x; h; 1]
+        uint64_t n = i_f_ + o_f_ + 1;
+        A_ = (uint8_t*)malloc(4 * o_f_ * n * UNIT_SIZE);
+        for (uint64_t o = 0; o < 4 * o_f_; o++) {
+            uint16_t* row = (uint16_t*)A_ + o * n;
+            std::memcpy(row, Wx_ + o * i_f_ * UNIT_SIZE, i_f_ * UNIT_SIZE);
+            std::memcpy(row + i_f_, Wh_ + o * o_f_ * UNIT_SIZE, o_f_ * UNIT_SIZE);
+            row[i_f_ + o_f_] = ((uint16_t*)b_)[o];
+        }
+        x_ = (uint8_t*)malloc(n * UNIT_SIZE);
+        ((uint16_t*)x_)[i_f_ + o_f_] = 1;
+        std::memcpy(x_, x, i_f_ * UNIT_SIZE);
+        std::memcpy(x_ + i_f_ * UNIT_SIZE, h, o_f_ * UNIT_SIZE);
+    }
 
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////////////////////////////////////////////////////////////////////////////
+    uint64_t LstmTransactionGenerator::Step(uint8_t* x, uint8_t* h) {
+        std::memcpy(x_, x, i_f_ * UNIT_SIZE);
+        std::memcpy(x_ + i_f_ * UNIT_SIZE, h, o_f_ * UNIT_SIZE);
+        return Invoke(x_);
+    }
 
-    // Initialize variables and ukernel
-    void GemvTransactionGenerator::Initialize() {
-        // TODO(bepo): currently only support m=4096
+    void LstmTransactionGenerator::CheckResult() {
+        int err = 0;
+        uint16_t* x = (uint16_t*)x_;
+        uint16_t* h = x + i_f_;
+        for (uint64_t o = 0; o < 4 * o_f_; o++) {
+            uint16_t answer = ((uint16_t*)b_)[o];
+            for (uint64_t i = 0; i < i_f_; i++)
+                answer += ((uint16_t*)Wx_)[o * i_f_ + i] * x[i];
+            for (uint64_t i = 0; i < o_f_; i++)
+                answer += ((uint16_t*)Wh_)[o * o_f_ + i] * h[i];
+            err += ABS(((uint16_t*)y_)[o] - answer);
+        }
+        std::cout << "ERROR : " << err << std::endl;
+    }
+
+    LstmPreTransactionGenerator::LstmPreTransactionGenerator(const std::string& config_file,
+        const std::string& output_dir, uint64_t o_f, uint8_t* x, uint8_t* y,
+        uint8_t* h, uint8_t* b, uint8_t* Wh, PimScheduler* scheduler)
+        : GemvTransactionGenerator(config_file, output_dir, 4 * o_f, o_f + 1,
+            NULL, NULL, y, scheduler),
+        x_pre_(x), b_(b), Wh_(Wh), o_f_(o_f) {
+        // A = [Wh | b], x = [h; 1]
+        uint64_t n = o_f_ + 1;
+        A_ = (uint8_t*)malloc(4 * o_f_ * n * UNIT_SIZE);
+        for (uint64_t o = 0; o < 4 * o_f_; o++) {
+            uint16_t* row = (uint16_t*)A_ + o * n;
+            std::memcpy(row, Wh_ + o * o_f_ * UNIT_SIZE, o_f_ * UNIT_SIZE);
+            row[o_f_] = ((uint16_t*)b_)[o];
+        }
+        x_ = (uint8_t*)malloc(n * UNIT_SIZE);
+        std::memcpy(x_, h, o_f_ * UNIT_SIZE);
+        ((uint16_t*)x_)[o_f_] = 1;
+    }
+
+    void LstmPreTransactionGenerator::Initialize() {
+        GemvTransactionGenerator::Initialize();
+        // x in the layout of y, the ADD pass over bank ba reads y there and
+        // x in bank ba^1, and writes y back. y is in bank 0,1, a word per tile
+        buf_x_pre_ = Alloc(2 * m_pad_ * UNIT_SIZE, PimInterleave::CONVG);
+        x_pre_pad_ = (uint8_t*)calloc(m_pad_, UNIT_SIZE);
+        op_count_ = num_tiles_;
+
+        std::string source;
+        for (int ba = 0; ba < 2; ba++) {
+            source += "ADD  BANK" + std::to_string(ba) + "  BANK" + std::to_string(ba) +
+                      "  BANK" + std::to_string(ba ^ 1) + "\n";
+            if (op_count_ > 1)
+                source += "JUMP  -1  " + std::to_string(op_count_ - 1) + "\n";
+        }
+        source += "EXIT\n";
+        ukernel_add_ = assembler_.Assemble(source, "lstm_pre_add");
+    }
+
+    // SB mode, before the GEMV enters PIM
+    void LstmPreTransactionGenerator::WriteProjection() {
+        std::memcpy(x_pre_pad_, x_pre_, 4 * o_f_ * UNIT_SIZE);
+        uint64_t tile_size = tile_m_ * UNIT_SIZE;
+        for (uint64_t k = 0; k < num_tiles_; k++) {
+            for (uint64_t offset = 0; offset < tile_size; offset += SIZE_WORD) {
+                uint64_t address = ADDR_CONV1(allocator_->Address(buf_x_pre_, 2 * k * tile_size + offset));
+                TryAddTransaction(address, true, x_pre_pad_ + k * tile_size + offset);
+            }
+        }
+        Barrier();
+    }
+
+    void LstmPreTransactionGenerator::SetData() {
+        WriteProjection();
+        GemvTransactionGenerator::SetData();
+    }
+
+    // GEMV into y, then y += x in the banks
+    void LstmPreTransactionGenerator::Execute() {
+        GemvTransactionGenerator::Execute();
+
+        ProgramCRF(ukernel_add_);
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
+        }
+        Barrier();
+        SetMode(1);
+
+        uint64_t base_row_x = allocator_->GetBaseRow(buf_x_pre_);
+        for (int ba = 0; ba < 2; ba++) {
+            uint64_t base_rows[4];
+            for (int b = 0; b < 4; b++)
+                base_rows[b] = b == ba ? base_row_y_ : b == (ba ^ 1) ? base_row_x : base_row_idle_;
+            SetBaseRow(BaseRow(base_rows[0], base_rows[1], base_rows[2], base_rows[3]));
+            RowSweep(ba, op_count_);
+            Barrier();
+        }
+        // EXIT took the units back to ABG mode
+        SetMode(2);
+    }
+
+    uint64_t LstmPreTransactionGenerator::Step(uint8_t* x, uint8_t* h) {
+        x_pre_ = x;
+        WriteProjection();
+        std::memcpy(x_, h, o_f_ * UNIT_SIZE);
+        return Invoke(x_);
+    }
 
-        addr_A_ = 0;
-        addr_y_ = Ceiling(m_ * n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+    void LstmPreTransactionGenerator::CheckResult() {
+        int err = 0;
+        uint16_t* h = (uint16_t*)x_;
+        for (uint64_t o = 0; o < 4 * o_f_; o++) {
+            uint16_t answer = ((uint16_t*)b_)[o] + ((uint16_t*)x_pre_)[o];
+            for (uint64_t i = 0; i < o_f_; i++)
+                answer += ((uint16_t*)Wh_)[o * o_f_ + i] * h[i];
+            err += ABS(((uint16_t*)y_)[o] - answer);
+        }
+        std::cout << "ERROR : " << err << std::endl;
+    }
 
-        ukernel_access_size_ = SIZE_WORD * 8 * NUM_BANK;
-        ukernel_count_per_pim_ = Ceiling(m_ * n_ * UNIT_SIZE, ukernel_access_size_)
-            / ukernel_access_size_;
+    // Initialize variables, ukernels are set per group in Execute
+    void GemmSmallBatchTransactionGenerator::Initialize() {
+        // same tiling as GemvTransactionGenerator
+        tile_m_ = NUM_UNIT_PER_WORD * num_bank_ / 2;
+        m_pad_ = Ceiling(m_, tile_m_);
+        n_pad_ = Ceiling(n_, GEMV_TILE_N);
+        num_tiles_ = m_pad_ / tile_m_;
+        tile_stride_ = Ceiling(tile_m_ * n_pad_ * UNIT_SIZE, SIZE_ROW * num_bank_);
+        x_pad_ = (uint8_t*)calloc(b_ * n_pad_, UNIT_SIZE);
+        y_pad_ = (uint8_t*)calloc(b_ * m_pad_, UNIT_SIZE);
+
+        // base address of operands, y holds b vectors of m_pad_ outputs.
+        // Tile t of y (tile k of vector s is t = s * num_tiles_ + k) is in
+        // column t of bank 0,1 as in GemvTransactionGenerator
+        buf_A_ = Alloc(num_tiles_ * tile_stride_, PimInterleave::CONVG);
+        buf_y_ = Alloc(2 * b_ * m_pad_ * UNIT_SIZE, PimInterleave::CONVG);
+
+        base_row_A_ = allocator_->GetBaseRow(buf_A_);
+        base_row_y_ = allocator_->GetBaseRow(buf_y_);
+        base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
 
-        // Define ukernel for gemv
-        ukernel_gemv_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_gemv_[i] = 0b00000000000000000000000000000001; // initialize
+        ukernel_access_size_ = SIZE_WORD * 8 * num_bank_;
+        ukernel_count_per_pim_ = Ceiling(tile_m_ * n_pad_ * UNIT_SIZE, ukernel_access_size_) / ukernel_access_size_;
+    }
 
-        ukernel_gemv_[0] = 0b10100100001000001000100000000000; // MAC(AAM)   GRF_B[0]  BANK  SRF_M
-        ukernel_gemv_[1] = 0b00010000000001000000100000000111; // JUMP       -1        7
-        ukernel_gemv_[2] = 0b00100000000000000000000000000000; // EXIT
+    // Program ukernel_gemm_ for every tile of a group of batch vectors (see
+    // GemvTileLoop), it stores the ACC of the vectors after the last step of a tile
+    void GemmSmallBatchTransactionGenerator::SetKernel(int batch) {
+        // GEMV imm0: number of vectors in SRF/ACC, ST imm0: vector to store
+        std::string gemm = GemvTileLoop(ukernel_count_per_pim_, batch);
 
-        // Define ukernel for reducing output data from ukernel_gemv + write to
-        // physical memory
-        ukernel_gemv_last_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_gemv_last_[i] = 0b00000000000000000000000000000000; // initialize
+        std::string store;
+        for (int s = 0; s < batch; s++) {
+            store += "ST        0         0b10000   " + std::to_string(s) + "\n";
+            store += "ST        1         0b100000  " + std::to_string(s) + "\n";
+        }
+        ukernel_gemm_ = assembler_.Assemble(GemvTiles(gemm + store, num_tiles_) + "EXIT\n", "gemm");
+    }
 
-        ukernel_gemv_last_[0] = 0b10100100001000001000100000000000; // MAC(AAM)  GRF_B[0]  BANK  SRF_M
-        ukernel_gemv_last_[1] = 0b00010000000001000000100000000111; // JUMP      -1        7
-        ukernel_gemv_last_[2] = 0b01000000100000000000000000000000; // MOV       BANK      GRF_B[0]
-        ukernel_gemv_last_[3] = 0b00100000000000000000000000000000; // EXIT
+    // Write the SRF words of step for vectors first ~ first+batch-1, column s
+    // of the step's SRF buffer is the word of vector s
+    void GemmSmallBatchTransactionGenerator::WriteSrf(uint64_t first, int batch, int step) {
+        int buf = step % SRF_BUFFERS;
+        for(int s = 0; s < batch; s++){
+            std::memcpy(data_temp_, ((uint16_t*)x_pad_) + (first + s) * n_pad_ + step * NUM_UNIT_PER_WORD, SIZE_WORD);
+            for (int ch = ch_first_; ch < ch_end_; ch++){
+                Address addr(ch, 0, 0, 0, MAP_SRF, buf * PIM_MAX_BATCH + s);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                TryAddTransaction(hex_addr, true, data_temp_);
+            }
+        }
     }
 
-    // Write operand data and μkernel to physical memory and PIM registers
-    void GemvTransactionGenerator::SetData() {
-        uint64_t strided_size = Ceiling(m_ * n_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
+    // Write A once (as GemvTransactionGenerator) and go to ABG mode
+    void GemmSmallBatchTransactionGenerator::SetData() {
+        uint64_t tile_size = tile_m_ * n_pad_ * UNIT_SIZE;
 
-        // Transpose input data A
-        A_T_ = (uint8_t*)malloc(sizeof(uint16_t) * m_ * n_);
-        for (int m = 0; m < m_; m++) {
-            for (int n = 0; n < n_; n++) {
-                ((uint16_t*)A_T_)[n * m_ + m] = ((uint16_t*)A_)[m * n_ + n];
+        uint8_t* A_T = (uint8_t*) calloc(m_pad_ * n_pad_, sizeof(uint16_t));
+        for(int M=0; M<m_; M+=tile_m_){
+            for(int m=0; m<tile_m_ && M+m<m_; m++){
+                for(int n=0; n<n_; n++){
+                    ((uint16_t*)A_T)[M*n_pad_+n*tile_m_+m] = ((uint16_t*)A_)[(M+m)*n_+n];
+                }
             }
         }
 
 #ifdef debug_mode
         std::cout << "HOST:\tSet input data\n";
 #endif
-        // Write input data A
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_A_ + offset, true, A_T_ + offset);
+        uint64_t address;
+        for (uint64_t k = 0; k < num_tiles_; k++) {
+            for (uint64_t offset = 0; offset < tile_size; offset += SIZE_WORD) {
+                address = allocator_->Address(buf_A_, k * tile_stride_ + offset);
+                TryAddTransaction(address, true, A_T + k * tile_size + offset);
+            }
+        }
+        free(A_T);
+
         Barrier();
+        launch_ = Mark();
 
-        // Mode transition: SB -> AB
+	// Mode transition: SB -> ABG
 #ifdef debug_mode
-        std::cout << "\nHOST:\t[1] SB -> AB \n";
+        std::cout << "\nHOST:\t[1] SB -> ABG \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_ABMR, 0);
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
+        SetMode(2);  // set mode to all bank group mode
     }
 
-    // Execute PIM computation
-    void GemvTransactionGenerator::Execute() {
-        ExecuteBank(EVEN_BANK);
-        ExecuteBank(ODD_BANK);
-        //Barrier();
-    }
+    void GemmSmallBatchTransactionGenerator::Execute() {
+        SetWriteBufferThreshold(1); // set write buffer threshold
 
-    // Execute PIM computation of EVEN_BANK or ODD_BANK
-    void GemvTransactionGenerator::ExecuteBank(int bank) {
-        // Program gemv μkernel
-#ifdef debug_mode
-        std::cout << "HOST:\tProgram gemv μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_gemv_[co * 8]);
-            }
-        }
-        Barrier();
+        for (uint64_t s = 0; s < b_; s++)
+            std::memcpy(x_pad_ + s * n_pad_ * UNIT_SIZE, x_ + s * n_ * UNIT_SIZE, n_ * UNIT_SIZE);
 
-        // Execute for EVEN_BANK or ODD_BANK
-        for (int ro = 0; ro * NUM_WORD_PER_ROW / 8 < ukernel_count_per_pim_; ro++) {
-            for (int co_o = 0; co_o < NUM_WORD_PER_ROW / 8; co_o++) {
-                // SRF_M modify
-                std::memcpy(data_temp_ + 16,
-                    ((uint16_t*)x_) + (ro * NUM_WORD_PER_ROW + co_o * 8),
-                    16);
+        int row_shift = config_->ro_pos + config_->shift_bits;
+        for (uint64_t first = 0; first < b_; first += PIM_MAX_BATCH) {
+            int batch = (int)std::min((uint64_t)PIM_MAX_BATCH, b_ - first);
+            SetKernel(batch);
+            ProgramCRF(ukernel_gemm_);
 
+            // mode transition, the kernel runs every tile of the group
+            *data_temp_ |= 1;
 #ifdef debug_mode
-                std::cout << "\nHOST:\tSet Srf\n";
+            std::cout << "\nHOST:\t[1] ABG -> BG \n";
 #endif
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, bank, MAP_SRF, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
+            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                Address addr(ch, 0, 0, 1, MAP_BGMR, 0);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                TryAddTransaction(hex_addr, false, data_temp_);
+            }
+            Barrier();
+            SetMode(1); // tell memory controller to change the controllers mode to BG mode
+
+            // the commands carry the whole row of A and y, base rows stay 0
+            SetBaseRow(BaseRow(0, 0, 0, 0));
+            int row = 0;
+            // reads per channel and SRF buffers as in GemvTransactionGenerator
+            uint64_t reads = 0;
+            uint64_t srf_free[SRF_BUFFERS] = {0};
+            for (uint64_t k = 0; k < num_tiles_; k++) {
+                int row_A = allocator_->GetBaseRow(buf_A_, k * tile_stride_) >> row_shift;
+                for (int step = 0; step < ukernel_count_per_pim_; step++) {
+                    // SRF words of the step, the previous step computes on
+                    // the other buffer
+                    WaitPimCommands(srf_free[step % SRF_BUFFERS]);
+                    WriteSrf(first, batch, step);
+
+                    row = row_A + step / 4;
+                    int co_o = step % 4;
+                    // every read feeds all vectors of the group
+                    for (int odd = 0; odd < 2; odd++) {
+                        for (int col_i = 0; col_i < 8; col_i++) {
+                            int col = co_o * 8 + col_i;
+                            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                                Address addr(ch, 0, 0, odd, row, col);
+                                uint64_t hex_addr = ReverseAddressMapping(addr);
+                                TryAddTransaction(hex_addr, false, data_temp_);
+                            }
+                            reads++;
+                        }
+                    }
+                    srf_free[step % SRF_BUFFERS] = reads + 1;
                 }
-                Barrier();
 
-                // if last gemv ukernel to execute, add new gemv ukernel (= ukernel_gemv_last)
-                if (ro * NUM_WORD_PER_ROW / 8 + co_o >= ukernel_count_per_pim_ - 1) {
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        for (int co = 0; co < 4; co++) {
-                            Address addr(ch, 0, 0, 0, MAP_CRF, co);
+                // store ACC of every vector, one read per ST at its place in y
+                for (int s = 0; s < batch; s++) {
+                    uint64_t t = (first + s) * num_tiles_ + k;
+                    row = (base_row_y_ >> row_shift) + t / NUM_WORD_PER_ROW;
+                    // read the banks the ST writes
+                    for (int ba = 0; ba < 2; ba++) {
+                        for (int ch = ch_first_; ch < ch_end_; ch++) {
+                            Address addr(ch, 0, 0, ba, row, t % NUM_WORD_PER_ROW);
                             uint64_t hex_addr = ReverseAddressMapping(addr);
-                            TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_gemv_last_[co * 8]);
+                            TryAddTransaction(hex_addr, false, data_temp_);
                         }
+                        reads++;
                     }
-                    Barrier();
                 }
+            }
 
-                // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-                std::cout << "\nHOST:\t[2] AB -> PIM \n";
-#endif
-                * data_temp_ |= 1;
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
+            // drain out the results of the last tile, after its stores
+            WaitPimCommands(reads);
+            for (int i = 0; i < 2; i++) {
+                for (int ch = ch_first_; ch < ch_end_; ch++) {
+                    Address addr(ch, 0, 0, 0, row, i); // at this time, col does not matter
                     uint64_t hex_addr = ReverseAddressMapping(addr);
                     TryAddTransaction(hex_addr, true, data_temp_);
                 }
-                Barrier();
+            }
+            Barrier();
 
-                // Execute ukernel 0-1 + AB-PIM -> AB
-#ifdef debug_mode
-                std::cout << "\nHOST:\tExecute μkernel 0-1 + [3] PIM -> AB \n";
-#endif
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, bank, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(hex_addr, false, data_temp_);
-                    }
-                }
-                Barrier();
-
-                // for the last gemv ukernel, move result to bank
-                if (ro * NUM_WORD_PER_ROW / 8 + co_o >= ukernel_count_per_pim_ - 1) {
-                    for (int uker = 0; uker < 1; uker++) {
-                        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                            Address addr(ch, 0, 0, bank, 0, 0);
-                            uint64_t hex_addr = ReverseAddressMapping(addr);
-                            TryAddTransaction(addr_y_ + hex_addr, true, data_temp_);
-                        }
-                        Barrier();
-                    }
-                    break;
-                }
-            }
-        }
-
-        // reset GRF_B
-#ifdef debug_mode
-        std::cout << "\nHOST:\tReset GRF_B\n";
-#endif
-        uint8_t* zero = (uint8_t*)malloc(WORD_SIZE);
-        for (int i = 0; i < WORD_SIZE; i++) zero[i] = 0;
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 8; co < 16; co++) {
-                Address addr(ch, 0, 0, 0, MAP_GRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, zero);
-            }
+            // set mode to 2, EXIT command will do the role
+            SetMode(2);
         }
-        Barrier();
+        SetWriteBufferThreshold(-1);
     }
 
-    // Read PIM computation result from physical memory
-    void GemvTransactionGenerator::GetResult() {
-        // Mode transition: AB -> SB
+    void GemmSmallBatchTransactionGenerator::GetResult() {
+    	// Mode transition: ABG -> SB
 #ifdef debug_mode
-        std::cout << "HOST:\t[4] AB -> SB \n";
+        std::cout << "HOST:\t[4] ABG -> SB \n";
 #endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-
-        uint64_t strided_size = Ceiling(m_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data z
-#ifdef debug_mode
-        std::cout << "\nHOST:\tRead output data z\n";
-#endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_y_ + offset, false, y_ + offset);
+        SetMode(0);
+        readback_ = Mark();
+
+        uint64_t tile_size = tile_m_ * UNIT_SIZE;
+        for (uint64_t t = 0; t < b_ * num_tiles_; t++) {
+            for (uint64_t offset = 0; offset < tile_size; offset += SIZE_WORD) {
+                uint64_t address = allocator_->Address(buf_y_, 2 * t * tile_size + offset);
+                TryAddTransaction(address, false, y_pad_ + t * tile_size + offset);
+            }
+        }
         Barrier();
+        for (uint64_t s = 0; s < b_; s++)
+            std::memcpy(y_ + s * m_ * UNIT_SIZE, y_pad_ + s * m_pad_ * UNIT_SIZE, m_ * UNIT_SIZE);
     }
 
-    // Calculate error between the result of PIM computation and actual answer
-    void GemvTransactionGenerator::CheckResult() {
-        float h_err = 0.;
-        uint8_t* answer = (uint8_t*)malloc(sizeof(uint16_t) * m_);
-
-        for (int m = 0; m < m_; m++) {
-            half h_answer(0);
-            for (int n = 0; n < n_; n++) {
-                half h_A(*reinterpret_cast<half*>(&((uint16_t*)A_)[m * n_ + n]));
-                half h_x(*reinterpret_cast<half*>(&((uint16_t*)x_)[n]));
-                h_answer = fma(h_A, h_x, h_answer);
+    void GemmSmallBatchTransactionGenerator::CheckResult() {
+        int err = 0;
+        uint16_t inner_product;
+        for(int s=0; s<b_; s++){
+            for(int m=0; m<m_; m++){
+                inner_product = 0;
+                for(int n=0; n<n_; n++){
+                    inner_product += ((uint16_t*)A_)[m*n_+n] * ((uint16_t*)x_)[s*n_+n];
+                }
+                err += ABS(((uint16_t*)y_)[s*m_+m] - inner_product);
             }
-            ((uint16_t*)answer)[m] = *reinterpret_cast<uint16_t*>(&h_answer);
-        }
-
-        // Calculate error
-        for (int m = 0; m < m_; m++) {
-            half h_answer(*reinterpret_cast<half*>(&((uint16_t*)answer)[m]));
-            half h_y(*reinterpret_cast<half*>(&((uint16_t*)y_)[m]));
-            h_err += fabs(h_answer - h_y);  // fabs stands for float absolute value
         }
-        std::cout << "ERROR : " << h_err << std::endl;
-    }
-
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////////////////////////////////////////////////////////////////////////////
-
-    // Initialize variables and ukernel
-    void BatchNormTransactionGenerator::Initialize() {
-        // base address of operands
-        addr_x_ = 0;
-        addr_w_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_y_ = addr_w_ + Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = addr_y_ + Ceiling(f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-
-        // total access size of one operand in one ukernel cycle
-        ukernel_access_size_ = SIZE_WORD * 8 * NUM_BANK;
-
-        // number of total ukernel cycles to run the whole computation
-        ukernel_count_per_pim_ = Ceiling(l_ * f_ * UNIT_SIZE, ukernel_access_size_)
-            / ukernel_access_size_;
-
-        // Define ukernel
-        ukernel_bn_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-
-        ukernel_bn_[0] = 0b01000010000000001000000000000000;  // MOV(AAM) GRF_A BANK
-        ukernel_bn_[1] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[2] = 0b10010010000010001000000000000000;  // MUL(AAM) GRF_A BANK GRF_A
-        ukernel_bn_[3] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[4] = 0b10000010000010001000000000000000;  // ADD(AAM) GRF_A BANK GRF_A
-        ukernel_bn_[5] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[6] = 0b01000000010000001000000000000000;  // MOV BANK GRF_A
-        ukernel_bn_[7] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[8] = 0b01000010000000001000000000000000;  // MOV(AAM) GRF_A BANK
-        ukernel_bn_[9] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[10] = 0b10010010000010001000000000000000;  // MUL(AAM) GRF_A BANK GRF_A
-        ukernel_bn_[11] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[12] = 0b10000010000010001000000000000000;  // ADD(AAM) GRF_A BANK GRF_A
-        ukernel_bn_[13] = 0b00010000000001000000100000000111;  // JUMP -1 7 
-        ukernel_bn_[14] = 0b01000000010000001000000000000000;  // MOV BANK GRF_A
-        ukernel_bn_[15] = 0b00010000000001000000100000000111;  // JUMP -1 7
-        ukernel_bn_[16] = 0b00100000000000000000000000000000;  // EXIT
+        std::cout << "ERROR: " << err << std::endl;
     }
 
-    // Write operand data and μkernel to physical memory and PIM registers
-    void BatchNormTransactionGenerator::SetData() {
-        // strided size of one operand with one computation part(minimum)
-        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        uint64_t strided_size_ = Ceiling(4096 * 8 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-
-#ifdef debug_mode
-        std::cout << "HOST:\tSet input data\n";
-#endif
-        // Write input data x to physical memory
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_x_ + offset, true, x_ + offset);
-
-        // Write input data y to physical memory
-        for (int offset = 0; offset < strided_size_; offset += SIZE_WORD) {
-            TryAddTransaction(addr_y_ + offset, true, y_ + offset);
-        }
-
-        // Write input data z to physical memory
-        for (int offset = 0; offset < strided_size_; offset += SIZE_WORD) {
-            TryAddTransaction(addr_z_ + offset, true, z_ + offset);
-        }
-        Barrier();
-
-        // Mode transition: SB -> AB
-#ifdef debug_mode
-        std::cout << "\nHOST:\t[1] SB -> AB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_ABMR, 0);
-            uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(hex_addr, false, data_temp_);
-        }
-        Barrier();
-
-        // Program μkernel into CRF register
-#ifdef debug_mode
-        std::cout << "\nHOST:\tProgram μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_bn_[co * 8]);
+    // Elementwise expression in one μkernel (see transaction_generator.h)
+    void FusedTransactionGenerator::Parse() {
+        std::vector<std::string> tokens;
+        for (size_t i = 0; i < expr_.size();) {
+            char c = expr_[i];
+            if (isspace(c)) {
+                i++;
+            }
+            else if (isalnum(c) || c == '_' ||
+                     (c == '-' && i + 1 < expr_.size() && isdigit(expr_[i + 1]))) {
+                size_t j = i + 1;
+                while (j < expr_.size() && (isalnum(expr_[j]) || expr_[j] == '_')) j++;
+                tokens.push_back(expr_.substr(i, j - i));
+                i = j;
+            }
+            else if (c == '=' || c == '+' || c == '*' || c == '(' || c == ')' || c == ',') {
+                tokens.push_back(std::string(1, c));
+                i++;
+            }
+            else {
+                std::cerr << "fused: unexpected '" << c << "' in " << expr_ << std::endl;
+                exit(1);
             }
         }
-        Barrier();
-    }
-
-    // Execute PIM computation
-    void BatchNormTransactionGenerator::Execute() {
-        // ro : row index in bank
-        // co_o(column_out) : column index counting by 8 words in bank
-        // co_i(column_in) : column index counting by word in co_o(column_out)
-        for (int ro = 0; ro * NUM_WORD_PER_ROW / 8 < ukernel_count_per_pim_; ro++) {
-            for (int co_o = 0; co_o < NUM_WORD_PER_ROW / 8; co_o++) {
-                // Check that all data operations have been completed
-                if (ro * NUM_WORD_PER_ROW / 8 + co_o > ukernel_count_per_pim_)
-                    break;
-
-                // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-                std::cout << "HOST:\t[2] AB -> PIM \n";
-#endif
-                * data_temp_ |= 1;
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
+        if (tokens.size() < 3 || tokens[1] != "=" || vectors_.count(tokens[0]) == 0) {
+            std::cerr << "fused: " << expr_ << " is not <output vector> = <expression>" << std::endl;
+            exit(1);
+        }
+        out_ = tokens[0];
+
+        // activation around the whole sum
+        static const std::map<std::string, PimActivation> luts = {
+            {"gelu", PimActivation::GELU}, {"silu", PimActivation::SILU},
+            {"sigmoid", PimActivation::SIGMOID}, {"tanh", PimActivation::TANH},
+            {"exp", PimActivation::EXP}};
+        std::vector<std::string> sum(tokens.begin() + 2, tokens.end());
+        if (sum.size() > 3 && sum[1] == "(" && sum.back() == ")") {
+            act_ = sum[0];
+            sum = std::vector<std::string>(sum.begin() + 2, sum.end() - 1);
+            if (act_ == "clamp") {
+                size_t k = sum.size();
+                if (k < 5 || sum[k - 4] != "," || sum[k - 2] != ",") {
+                    std::cerr << "fused: " << expr_ << " is not clamp(<sum>, lo, hi)" << std::endl;
+                    exit(1);
                 }
-                Barrier();
-
-#ifdef debug_mode
-                std::cout << "\nHOST:\tExecute μkernel 0-15\n";
-#endif
-                // Execute ukernel 0-1
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, EVEN_BANK, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_x_ + hex_addr, false, data_temp_);
-                    }
-                }
-                Barrier();
-
-                // Execute ukernel 2-3
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, EVEN_BANK, ro, co_i);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_y_ + hex_addr, false, data_temp_);
-                    }
-                }
-                Barrier();
-
-                // Execute ukernel 4-5
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, EVEN_BANK, ro, co_i);
-                        //std::cout << co << " " << co_o << "\n";
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_z_ + hex_addr, false, data_temp_);
-                    }
-                }
-                Barrier();
+                lo_ = sum[k - 3];
+                hi_ = sum[k - 1];
+                sum.resize(k - 4);
+            }
+            else if (luts.count(act_) != 0) {
+                lut_.resize(2 * LUT_SEGMENTS);
+                PimActivationLut(luts.at(act_), lut_.data());
+            }
+            else if (act_ != "relu") {
+                std::cerr << "fused: unknown activation " << act_ << " in " << expr_ << std::endl;
+                exit(1);
+            }
+        }
 
-                // Execute ukernel 6-7
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, EVEN_BANK, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_w_ + hex_addr, true, data_temp_);
-                    }
+        terms_.assign(1, FusedTerm());
+        bool want_operand = true;
+        for (size_t i = 0; i < sum.size(); i++) {
+            const std::string& t = sum[i];
+            bool is_op = t == "+" || t == "*" || t == "=" || t == "(" || t == ")" || t == ",";
+            if (want_operand == is_op) {
+                std::cerr << "fused: unexpected " << t << " in " << expr_ << std::endl;
+                exit(1);
+            }
+            if (is_op) {
+                if (t != "+" && t != "*") {
+                    std::cerr << "fused: unexpected " << t << " in " << expr_ << std::endl;
+                    exit(1);
                 }
-                Barrier();
-
-                // Execute ukernel 8-9
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ODD_BANK, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_x_ + hex_addr, false, data_temp_);
-                    }
+                if (t == "+") terms_.push_back(FusedTerm());
+            }
+            else {
+                // numbers are scalars named by themselves
+                if (isdigit(t[0]) || t[0] == '-')
+                    scalars_[t] = (unit_t)std::stol(t, NULL, 0);
+                if (vectors_.count(t) == 0 && scalars_.count(t) == 0) {
+                    std::cerr << "fused: " << t << " is neither a vector nor a scalar" << std::endl;
+                    exit(1);
                 }
-                Barrier();
-
-                // Execute ukernel 10-11
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ODD_BANK, ro, co_i);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_y_ + hex_addr, false, data_temp_);
-                    }
+                if (t == out_) {
+                    std::cerr << "fused: output " << out_ << " is an input as well" << std::endl;
+                    exit(1);
                 }
-                Barrier();
+                terms_.back().push_back(t);
+            }
+            want_operand = is_op;
+        }
+        if (want_operand) {
+            std::cerr << "fused: " << expr_ << " ends in an operator" << std::endl;
+            exit(1);
+        }
 
-                // Execute ukernel 12-13
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ODD_BANK, ro, co_i);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_z_ + hex_addr, false, data_temp_);
-                    }
+        // a vector leads every product, it is the src0 of the instruction
+        for (auto& term : terms_) {
+            std::stable_partition(term.begin(), term.end(),
+                [&](const std::string& f) { return vectors_.count(f) != 0; });
+            for (auto& f : term) {
+                if (vectors_.count(f) != 0) {
+                    if (std::find(operands_.begin(), operands_.end(), f) == operands_.end())
+                        operands_.push_back(f);
                 }
-                Barrier();
-
-                // Execute ukernel 14-15 + AB-PIM -> AB
-                // AB-PIM -> AB occurs automatically at the end of the kernel(EXIT)
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, ODD_BANK, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_w_ + hex_addr, true, data_temp_);
-                    }
+                else if (srf_index_.count(f) == 0) {
+                    int k = (int)srf_index_.size();
+                    srf_index_[f] = k;
                 }
-                Barrier();
             }
         }
-        Barrier();
-    }
-
-    // Read PIM computation result from physical memory
-    void BatchNormTransactionGenerator::GetResult() {
-        // Mode transition: AB -> SB
-#ifdef debug_mode
-        std::cout << "HOST:\t[4] AB -> SB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
-            uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(hex_addr, false, data_temp_);
+        for (auto& f : {lo_, hi_}) {
+            if (f.empty()) continue;
+            if (isdigit(f[0]) || f[0] == '-')
+                scalars_[f] = (unit_t)std::stol(f, NULL, 0);
+            if (scalars_.count(f) == 0) {
+                std::cerr << "fused: clamp bound " << f << " is not a scalar" << std::endl;
+                exit(1);
+            }
+            if (srf_index_.count(f) == 0) {
+                int k = (int)srf_index_.size();
+                srf_index_[f] = k;
+            }
         }
-        Barrier();
-
-        uint64_t strided_size = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data w
-#ifdef debug_mode
-        std::cout << "\nHOST:\tRead output data w\n";
-#endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_w_ + offset, false, w_ + offset);
-        Barrier();
+        if (operands_.empty() || operands_.size() > 3 || srf_index_.size() > 2 * SRF_ENTRIES) {
+            std::cerr << "fused: " << expr_ << " needs 1 ~ 3 input vectors and up to "
+                      << 2 * SRF_ENTRIES << " scalars" << std::endl;
+            exit(1);
+        }
+        operands_.push_back(out_);
     }
 
-    // Calculate error between the result of PIM computation and actual answer
-    void BatchNormTransactionGenerator::CheckResult() {
-        int err = 0;
-        float h_err = 0.;
-        uint8_t* answer = (uint8_t*)malloc(sizeof(uint16_t) * l_ * f_);
+    // register operand of name in pass ba, "acc" is the partial result
+    std::string FusedTransactionGenerator::OperandName(const std::string& name, int ba) {
+        if (name == "acc")
+            return "GRF_A0";
+        auto it = std::find(operands_.begin(), operands_.end(), name);
+        if (it != operands_.end())
+            return "BANK" + std::to_string(ba ^ (int)(it - operands_.begin()));
+        int k = srf_index_[name];
+        return k < SRF_ENTRIES ? "SRF_M" + std::to_string(k)
+                               : "SRF_A" + std::to_string(k - SRF_ENTRIES);
+    }
 
-        // Calculate actual answer of BN
-        for (int li = 0; li < l_; li++) {
-            for (int fi = 0; fi < f_; fi++) {
-                half h_x(*reinterpret_cast<half*>(&((uint16_t*)x_)[f_ * li + fi]));
-                half h_y(*reinterpret_cast<half*>(&((uint16_t*)y_)[fi]));
-                half h_z(*reinterpret_cast<half*>(&((uint16_t*)z_)[fi]));
-                half h_answer = (h_x * h_y) + h_z;
-                ((uint16_t*)answer)[f_ * li + fi] = *reinterpret_cast<uint16_t*>(&h_answer);
+    // μkernel lines of pass ba: the first two terms go in one ADD, MAD or
+    // MUL where possible, every further term adds to GRF_A0 with ADD or MAD,
+    // the activation comes last
+    std::string FusedTransactionGenerator::Compile(int ba) {
+        // op, dst, sources
+        std::vector<std::vector<std::string>> insts;
+        auto is_vector = [&](const std::string& f) { return vectors_.count(f) != 0; };
+        const FusedTerm& t0 = terms_[0];
+        size_t t = 1;
+        if (terms_.size() > 1 && t0.size() + terms_[1].size() <= 3) {
+            const FusedTerm& t1 = terms_[1];
+            if (t0.size() == 1 && t1.size() == 1) {
+                // the vector is src0
+                if (is_vector(t0[0])) insts.push_back({"ADD", "acc", t0[0], t1[0]});
+                else insts.push_back({"ADD", "acc", t1[0], t0[0]});
+            }
+            else if (t0.size() == 2) {
+                insts.push_back({"MAD", "acc", t0[0], t0[1], t1[0]});
+            }
+            else {
+                insts.push_back({"MAD", "acc", t1[0], t1[1], t0[0]});
             }
+            t = 2;
         }
-
-        // Calculate error
-        for (int li = 0; li < l_; li++) {
-            for (int fi = 0; fi < f_; fi++) {
-                half h_answer(*reinterpret_cast<half*>(&((uint16_t*)answer)[f_ * li + fi]));
-                half h_w(*reinterpret_cast<half*>(&((uint16_t*)w_)[f_ * li + fi]));
-                //std::cout << li << " " << fi << " " << h_answer << " " << h_w << std::endl;
-                h_err += fabs(h_answer - h_w);  // fabs stands for float absolute value
+        else if (t0.size() == 1) {
+            insts.push_back({"MOV", "acc", t0[0]});
+        }
+        else {
+            insts.push_back({"MUL", "acc", t0[0], t0[1]});
+            for (size_t k = 2; k < t0.size(); k++)
+                insts.push_back({"MUL", "acc", "acc", t0[k]});
+        }
+        for (; t < terms_.size(); t++) {
+            const FusedTerm& term = terms_[t];
+            if (term.size() == 1) {
+                insts.push_back({"ADD", "acc", "acc", term[0]});
+            }
+            else if (term.size() == 2) {
+                insts.push_back({"MAD", "acc", term[0], term[1], "acc"});
+            }
+            else {
+                std::cerr << "fused: only the first term of " << expr_
+                          << " may have more than 2 factors" << std::endl;
+                exit(1);
             }
         }
-        std::cout << "ERROR : " << h_err << std::endl;
-    }
-
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////////////////////////////////////////////////////////////////////////////
-
-    // Initialize variables and ukernel
-    void LstmTransactionGenerator::Initialize() {
-        // TODO(bepo): currently only support m=4096
-
-        addr_x_ = 0;
-        addr_y_ = Ceiling(i_f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_h_ = addr_y_ + Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_b_ = addr_h_ + Ceiling(i_f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_Wx_ = addr_b_ + Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_Wh_ = addr_Wx_ + Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        for (auto& inst : insts) {
+            if (inst[2] != "acc" && !is_vector(inst[2])) {
+                std::cerr << "fused: a product of scalars in " << expr_ << std::endl;
+                exit(1);
+            }
+        }
+        if (!act_.empty()) {
+            std::vector<std::string> act = {act_ == "relu" ? "RELU" : act_ == "clamp" ? "CLAMP" : "LUT",
+                                            "acc", "acc"};
+            if (act_ == "clamp") {
+                act.push_back(lo_);
+                act.push_back(hi_);
+            }
+            // a lone vector goes to the activation right away
+            if (insts.size() == 1 && insts[0][0] == "MOV") {
+                act[2] = insts[0][2];
+                insts.clear();
+            }
+            insts.push_back(act);
+        }
+        // the last instruction writes the output
+        insts.back()[1] = out_;
+        chain_ = (int)insts.size();
 
-        ukernel_access_size_ = SIZE_WORD * 8 * NUM_BANK;
-        ukernel_count_per_pim_ = Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, ukernel_access_size_)
-            / ukernel_access_size_;
+        std::string lines;
+        for (auto& inst : insts) {
+            lines += inst[0];
+            for (size_t k = 1; k < inst.size(); k++)
+                lines += "  " + OperandName(inst[k], ba);
+            lines += "\n";
+        }
+        return lines;
+    }
 
-        // Define ukernel for gemv
-        ukernel_lstm_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_lstm_[i] = 0b00000000000000000000000000000000; // initialize
+    unit_t FusedTransactionGenerator::Evaluate(uint64_t i) {
+        unit_t sum = 0;
+        for (auto& term : terms_) {
+            unit_t prod = 1;
+            for (auto& f : term)
+                prod *= vectors_.count(f) ? ((unit_t*)vectors_[f])[i] : scalars_[f];
+            sum += prod;
+        }
+        if (act_ == "relu")
+            return (int16_t)sum < 0 ? 0 : sum;
+        if (act_ == "clamp") {
+            int16_t v = std::max((int16_t)sum, (int16_t)scalars_[lo_]);
+            return (unit_t)std::min(v, (int16_t)scalars_[hi_]);
+        }
+        if (!act_.empty())
+            return PimLutLookup(lut_.data(), sum);
+        return sum;
+    }
 
-        ukernel_lstm_[0] = 0b10100100001000001000100000000000; // MAC(AAM)   GRF_B[0]  BANK  SRF_M
-        ukernel_lstm_[1] = 0b00010000000001000000100000000111; // JUMP       -1        7
-        ukernel_lstm_[2] = 0b00100000000000000000000000000000; // EXIT
+    void FusedTransactionGenerator::Initialize() {
+        static const PimInterleave interleave[4] = {PimInterleave::CONV0,
+            PimInterleave::CONV1, PimInterleave::CONV2, PimInterleave::CONV3};
+        Parse();
 
-        // Define ukernel for reducing output data from ukernel_gemv + write to
-        // physical memory
-        ukernel_wr_result_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_wr_result_[i] = 0b00000000000000000000000000000000; // initialize
+        // operand j of pass ba is in bank ba^j
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
+        for (size_t j = 0; j < operands_.size(); j++) {
+            bufs_.push_back(Alloc(n_ * UNIT_SIZE, interleave[j]));
+            uint8_t* pad = (uint8_t*)calloc(strided_size, 1);
+            if (j + 1 < operands_.size())
+                std::memcpy(pad, vectors_[operands_[j]], n_ * UNIT_SIZE);
+            pads_.push_back(pad);
+        }
+        base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
+        op_count_ = strided_size / (SIZE_WORD * num_bank_);
 
-        ukernel_wr_result_[0] = 0b10000010100000000000100010000000; // ADD     GRF_A[0]  GRF_B[0]  BANK
-        ukernel_wr_result_[1] = 0b01000000100000000000000000000000; // MOV     BANK      GRF_A[0]
-        ukernel_wr_result_[2] = 0b00100000000000000000000000000000; // EXIT
+        std::string source;
+        for (int ba = 0; ba < 4; ba++) {
+            source += Compile(ba);
+            if (op_count_ > 1)
+                source += "JUMP  -" + std::to_string(chain_) + "  " + std::to_string(op_count_ - 1) + "\n";
+        }
+        source += "EXIT\n";
+        ukernel_fused_ = assembler_.Assemble(source, "fused");
     }
 
-    // Write operand data and μkernel to physical memory and PIM registers
-    void LstmTransactionGenerator::SetData() {
-        uint64_t strided_size_W = Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        uint64_t strided_size_b = Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-
-        // Transpose input data Wx, Wh
-        Wx_T_ = (uint8_t*)malloc(sizeof(uint16_t) * i_f_ * o_f_ * 4);
-        Wh_T_ = (uint8_t*)malloc(sizeof(uint16_t) * i_f_ * o_f_ * 4);
-
-        for (int i_fi = 0; i_fi < i_f_; i_fi++) {
-            for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++) {
-                ((uint16_t*)Wx_T_)[o_f_ * 4 * i_fi + o_fi] = ((uint16_t*)Wx_)[i_f_ * o_fi + i_fi];
-                ((uint16_t*)Wh_T_)[o_f_ * 4 * i_fi + o_fi] = ((uint16_t*)Wh_)[i_f_ * o_fi + i_fi];
+    void FusedTransactionGenerator::SetData() {
+        uint64_t strided_size = op_count_ * SIZE_WORD * num_bank_;
+        for (size_t j = 0; j + 1 < operands_.size(); j++) {
+            for (uint64_t offset = 0; offset < strided_size; offset += SIZE_WORD) {
+                TryAddTransaction(allocator_->Address(bufs_[j], offset), true, pads_[j] + offset);
             }
         }
+        Barrier();
 
-#ifdef debug_mode
-        std::cout << "HOST:\tSet input data\n";
-#endif
-        // Write input data Wx, Wh
-        for (int offset = 0; offset < strided_size_W; offset += SIZE_WORD) {
-            TryAddTransaction(addr_Wx_ + offset, true, Wx_T_ + offset);
-            TryAddTransaction(addr_Wh_ + offset, true, Wh_T_ + offset);
-        }
+        launch_ = Mark();
 
-        // Write input data b
-        for (int offset = 0; offset < strided_size_b; offset += SIZE_WORD) {
-            TryAddTransaction(addr_b_ + offset, true, b_ + offset);
+        // Mode transition: SB -> ABG
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
+        SetMode(2);
+        ProgramCRF(ukernel_fused_);
+        if (!lut_.empty())
+            LoadLut(lut_.data());
+
+        // scalars: SRF_M0-7 are units 0-7 and SRF_A0-7 units 8-15 of the
+        // first SRF word
+        if (!srf_index_.empty()) {
+            unit_t srf[UNITS_PER_WORD] = {0};
+            for (auto& s : srf_index_)
+                srf[s.second] = scalars_[s.first];
+            for (int ch = ch_first_; ch < ch_end_; ch++) {
+                Address addr(ch, 0, 0, 0, MAP_SRF, 0);
+                uint64_t hex_addr = ReverseAddressMapping(addr);
+                TryAddTransaction(hex_addr, true, (uint8_t*)srf);
+            }
+            Barrier();
+        }
+    }
 
-        // Mode transition: SB -> AB
-#ifdef debug_mode
-        std::cout << "\nHOST:\t[1] SB -> AB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_ABMR, 0);
+    void FusedTransactionGenerator::Execute() {
+        // Mode transition: ABG -> BG
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-    }
+        SetMode(1);
+        SetWriteBufferThreshold(1);
 
-    // Execute PIM computation
-    void LstmTransactionGenerator::Execute() {
-        ExecuteBank(EVEN_BANK, 0);
-        ExecuteBank(EVEN_BANK, 1);
-        ExecuteBank(ODD_BANK, 0);
-        ExecuteBank(ODD_BANK, 1);
-        //Barrier();
+        for (int ba = 0; ba < 4; ba++) {
+            uint64_t base_rows[4];
+            for (int b = 0; b < 4; b++) {
+                size_t j = (size_t)(b ^ ba);
+                base_rows[b] = j < operands_.size() ? allocator_->GetBaseRow(bufs_[j]) : base_row_idle_;
+            }
+            SetBaseRow(BaseRow(base_rows[0], base_rows[1], base_rows[2], base_rows[3]));
+            RowSweep(ba, op_count_, chain_);
+            Barrier();
+        }
+        // EXIT took the units back to ABG mode
+        SetMode(2);
+        SetWriteBufferThreshold(-1);
     }
 
-    // Execute PIM computation of EVEN_BANK or ODD_BANK
-    void LstmTransactionGenerator::ExecuteBank(int bank, bool calc_h) {
-        // Program lstm μkernel
-#ifdef debug_mode
-        std::cout << "HOST:\tProgram lstm μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_lstm_[co * 8]);
-            }
+    void FusedTransactionGenerator::GetResult() {
+        // Mode transition: ABG -> SB
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
+        SetMode(0);
+        readback_ = Mark();
 
-        // Execute for EVEN_BANK or ODD_BANK
-        for (int ro = 0; ro * NUM_WORD_PER_ROW / 8 < ukernel_count_per_pim_; ro++) {
-            for (int co_o = 0; co_o < NUM_WORD_PER_ROW / 8; co_o++) {
-#ifdef debug_mode
-                std::cout << "\nHOST:\tSet Srf\n";
-#endif
-                // SRF_M modify
-                if (!calc_h) {
-                    std::memcpy(data_temp_ + 16,
-                        ((uint16_t*)x_) + (ro * NUM_WORD_PER_ROW + co_o * 8),
-                        16);
-                }
-                else {
-                    std::memcpy(data_temp_ + 16,
-                        ((uint16_t*)h_) + (ro * NUM_WORD_PER_ROW + co_o * 8),
-                        16);
-                }
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, bank, MAP_SRF, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
-                }
-                Barrier();
-
-                // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-                std::cout << "\nHOST:\t[2] AB -> PIM \n";
-#endif
-                * data_temp_ |= 1;
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
-                }
-                Barrier();
-
-                // Execute ukernel 0-1 + AB-PIM -> AB
-#ifdef debug_mode
-                std::cout << "\nHOST:\tExecute μkernel 0-1 + [3] PIM -> AB \n";
-#endif
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, bank, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        if (!calc_h) {
-                            TryAddTransaction(addr_Wx_ + hex_addr, false, data_temp_);
-                        }
-                        else {
-                            TryAddTransaction(addr_Wh_ + hex_addr, false, data_temp_);
-                        }
-                    }
-                }
-                Barrier();
+        uint64_t strided_size = op_count_ * SIZE_WORD * num_bank_;
+        for (uint64_t offset = 0; offset < strided_size; offset += SIZE_WORD) {
+            TryAddTransaction(allocator_->Address(bufs_.back(), offset), false, pads_.back() + offset);
+        }
+        Barrier();
+        std::memcpy(vectors_[out_], pads_.back(), n_ * UNIT_SIZE);
+    }
 
-                // for the last gemv ukernel, move result to bank
-                if (ro * NUM_WORD_PER_ROW / 8 + co_o >= ukernel_count_per_pim_)
-                    break;
-            }
+    void FusedTransactionGenerator::CheckResult() {
+        int err = 0;
+        for (uint64_t i = 0; i < n_; i++) {
+            err += ABS(((unit_t*)vectors_[out_])[i] - Evaluate(i));
         }
+        std::cout << "ERROR : " << err << std::endl;
+    }
 
-        if (calc_h) {
-            // Program wr_result ukernel
-#ifdef debug_mode
-            std::cout << "\nHOST:\tProgram wr_result μkernel \n";
-#endif
-            for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                for (int co = 0; co < 4; co++) {
-                    Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_wr_result_[co * 8]);
-                }
-            }
-            Barrier();
 
-            // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-            std::cout << "\nHOST:\t[4] AB -> PIM \n";
-#endif
-            * data_temp_ |= 1;
-            for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, data_temp_);
-            }
-            Barrier();
+    // Reduction of x, see transaction_generator.h
+    void ReduceTransactionGenerator::Initialize() {
+        static const char* names[3] = {"reduce_sum", "reduce_max", "reduce_argmax"};
+        uint64_t strided_size = Ceiling(n_ * UNIT_SIZE, SIZE_WORD * num_bank_);
+        op_count_ = strided_size / (SIZE_WORD * num_bank_);
+        // position of ARGMAX is (word * 4 + bank) in 16 bits
+        if (op_ == PimReduce::ARGMAX && op_count_ * 4 >= PIM_NO_POSITION) {
+            std::cerr << "reduce: argmax of " << n_ << " units exceeds the 16 bit position" << std::endl;
+            exit(1);
+        }
+        buf_x_ = Alloc(n_ * UNIT_SIZE, PimInterleave::CONV0);
+        buf_out_ = Alloc(SIZE_WORD, PimInterleave::CONV0);
+        base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
 
-            // Execute ukernel 0~1 + AB-PIM -> AB
-#ifdef debug_mode
-            std::cout << "\nHOST:\tExecute μkernel 0-1 + [5] PIM -> AB \n";
-#endif
+        // padding does not change the result
+        x_pad_ = (uint8_t*)malloc(strided_size);
+        unit_t identity = op_ == PimReduce::SUM ? 0 : (unit_t)INT16_MIN;
+        for (uint64_t i = 0; i < strided_size / UNIT_SIZE; i++)
+            ((unit_t*)x_pad_)[i] = i < n_ ? ((unit_t*)x_)[i] : identity;
+        out_ = (uint8_t*)calloc(NUM_CHANNEL * 2, SIZE_WORD);
+        if (op_ == PimReduce::ARGMAX) {
+            for (uint64_t offset = 0; offset < strided_size; offset += SIZE_WORD)
+                index_of_[allocator_->Address(buf_x_, offset)] = offset / UNIT_SIZE;
+        }
+
+        // GRF_A0 (GRF_B0) starts from the identity in SRF_M0 (SRF_A0)
+        std::string source = "MOV  GRF_A0  SRF_M0\n";
+        if (op_ == PimReduce::ARGMAX)
+            source += "MOV  GRF_B0  SRF_A0\n";
+        prologue_ = op_ == PimReduce::ARGMAX ? 2 : 1;
+        for (int ba = 0; ba < 4; ba++) {
+            std::string bank = "BANK" + std::to_string(ba);
+            if (op_ == PimReduce::SUM)
+                source += "ADD  GRF_A0  " + bank + "  GRF_A0\n";
+            else if (op_ == PimReduce::MAX)
+                source += "MAX  GRF_A0  " + bank + "  GRF_A0\n";
+            else
+                source += "ARGMAX  GRF_A0  " + bank + "\n";
+            if (op_count_ > 1)
+                source += "JUMP  -1  " + std::to_string(op_count_ - 1) + "\n";
+        }
+        // lanes and bankgroups, then the result goes to bank 0 (positions to
+        // bank 1) of buf_out_
+        static const char* reduce[3] = {"RSUM", "RMAX", "RARGMAX"};
+        source += std::string(reduce[(int)op_]) + "  GRF_A0  GRF_A0\n";
+        source += "MOV  BANK0  GRF_A0\n";
+        if (op_ == PimReduce::ARGMAX)
+            source += "MOV  BANK1  GRF_B0\n";
+        tail_ = op_ == PimReduce::ARGMAX ? 3 : 2;
+        source += "EXIT\n";
+        ukernel_reduce_ = assembler_.Assemble(source, names[(int)op_]);
+    }
 
-            for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                Address addr(ch, 0, 0, bank, 0, 0);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(addr_b_ + hex_addr, false, data_temp_);
-            }
-            Barrier();
+    void ReduceTransactionGenerator::SetData() {
+        uint64_t strided_size = op_count_ * SIZE_WORD * num_bank_;
+        for (uint64_t offset = 0; offset < strided_size; offset += SIZE_WORD) {
+            TryAddTransaction(allocator_->Address(buf_x_, offset), true, x_pad_ + offset);
+        }
+        Barrier();
 
-            for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                Address addr(ch, 0, 0, bank, 0, 0);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(addr_y_ + hex_addr, true, data_temp_);
-            }
-            Barrier();
+        launch_ = Mark();
 
-            // reset GRF_B
-#ifdef debug_mode
-            std::cout << "\nHOST:\tReset GRF_B\n";
-#endif
-            uint8_t* zero = (uint8_t*)malloc(WORD_SIZE);
-            for (int i = 0; i < WORD_SIZE; i++) zero[i] = 0;
-            for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                for (int co = 8; co < 16; co++) {
-                    Address addr(ch, 0, 0, 0, MAP_GRF, co);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, zero);
-                }
-            }
-            Barrier();
+        // Mode transition: SB -> ABG
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
+        }
+        Barrier();
+        SetMode(2);
+        ProgramCRF(ukernel_reduce_);
+
+        unit_t srf[UNITS_PER_WORD] = {0};
+        srf[0] = op_ == PimReduce::SUM ? 0 : (unit_t)INT16_MIN;
+        srf[SRF_ENTRIES] = PIM_NO_POSITION;
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_SRF, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, true, (uint8_t*)srf);
         }
+        Barrier();
     }
 
-    // Read PIM computation result from physical memory
-    void LstmTransactionGenerator::GetResult() {
-        // Mode transition: AB -> SB
-#ifdef debug_mode
-        std::cout << "HOST:\t[4] AB -> SB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
+    void ReduceTransactionGenerator::Execute() {
+        // Mode transition: ABG -> BG
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-
-        uint64_t strided_size = Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data y
-#ifdef debug_mode
-        std::cout << "\nHOST:\tRead output data y\n";
-#endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_y_ + offset, false, y_ + offset);
+        SetMode(1);
+        SetWriteBufferThreshold(1);
+
+        // the prologue and the tail read no bank, only the MOVs of the tail
+        // write bank 0 and 1 of buf_out_
+        uint64_t base_row_x = allocator_->GetBaseRow(buf_x_);
+        uint64_t base_row_out = allocator_->GetBaseRow(buf_out_);
+        SetBaseRow(BaseRow(base_row_idle_, base_row_idle_, base_row_idle_, base_row_idle_));
+        RowSweep(0, 1, prologue_);
+        Barrier();
+        for (int ba = 0; ba < 4; ba++) {
+            uint64_t base_rows[4];
+            for (int b = 0; b < 4; b++)
+                base_rows[b] = b == ba ? base_row_x : base_row_idle_;
+            SetBaseRow(BaseRow(base_rows[0], base_rows[1], base_rows[2], base_rows[3]));
+            RowSweep(ba, op_count_);
+            Barrier();
+        }
+        SetBaseRow(BaseRow(base_row_out, base_row_out, base_row_idle_, base_row_idle_));
+        RowSweep(0, 1, tail_);
         Barrier();
+        // EXIT took the units back to ABG mode
+        SetMode(2);
+        SetWriteBufferThreshold(-1);
     }
 
-    // Calculate error between the result of PIM computation and actual answer
-    void LstmTransactionGenerator::CheckResult() {
-        float h_err = 0.;
-        uint8_t* answer = (uint8_t*)malloc(sizeof(uint16_t) * o_f_ * 4);
-
-        for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++) {
-            half h_answer(0);
-            half h_b(*reinterpret_cast<half*>(&((uint16_t*)b_)[o_fi]));
-            for (int i_fi = 0; i_fi < i_f_; i_fi++) {
-                half h_Wx(*reinterpret_cast<half*>(&((uint16_t*)Wx_)[i_f_ * o_fi + i_fi]));
-                half h_x(*reinterpret_cast<half*>(&((uint16_t*)x_)[i_fi]));
-                h_answer = fma(h_Wx, h_x, h_answer);
+    void ReduceTransactionGenerator::GetResult() {
+        // Mode transition: ABG -> SB
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
+            uint64_t hex_addr = ReverseAddressMapping(addr);
+            TryAddTransaction(hex_addr, false, data_temp_);
+        }
+        Barrier();
+        SetMode(0);
+        readback_ = Mark();
+
+        // bankgroup 0 of every channel has the result of the channel
+        int words = op_ == PimReduce::ARGMAX ? 2 : 1;
+        uint64_t base_row_out = allocator_->GetBaseRow(buf_out_);
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            for (int w = 0; w < words; w++) {
+                Address addr(ch, 0, 0, w, 0, 0);
+                uint64_t hex_addr = ReverseAddressMapping(addr) + base_row_out;
+                TryAddTransaction(hex_addr, false, out_ + (ch * 2 + w) * SIZE_WORD);
+            }
+        }
+        Barrier();
+        read_bytes_ = (uint64_t)(ch_end_ - ch_first_) * words * SIZE_WORD;
+
+        // the host reduces over the channels, ARGMAX takes the lowest index
+        // on a tie
+        value_ = op_ == PimReduce::SUM ? 0 : (unit_t)INT16_MIN;
+        index_ = n_;
+        uint64_t base_row_x = allocator_->GetBaseRow(buf_x_);
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            unit_t v = ((unit_t*)(out_ + ch * 2 * SIZE_WORD))[0];
+            if (op_ == PimReduce::SUM) {
+                value_ += v;
             }
-            for (int i_fi = 0; i_fi < i_f_; i_fi++) {
-                half h_Wh(*reinterpret_cast<half*>(&((uint16_t*)Wh_)[i_f_ * o_fi + i_fi]));
-                half h_h(*reinterpret_cast<half*>(&((uint16_t*)h_)[i_fi]));
-                h_answer = fma(h_Wh, h_h, h_answer);
+            else if (op_ == PimReduce::MAX) {
+                if ((int16_t)v > (int16_t)value_) value_ = v;
+            }
+            else {
+                unit_t* pos = (unit_t*)(out_ + (ch * 2 + 1) * SIZE_WORD);
+                if (pos[0] == PIM_NO_POSITION)
+                    continue;
+                uint64_t word = pos[0] / 4;
+                Address addr(ch, 0, pos[2], pos[0] % 4, (int)(word / NUM_WORD_PER_ROW),
+                             (int)(word % NUM_WORD_PER_ROW));
+                uint64_t index = index_of_[ReverseAddressMapping(addr) + base_row_x] + pos[1];
+                if (index_ == n_ || (int16_t)v > (int16_t)value_ ||
+                    (v == value_ && index < index_)) {
+                    value_ = v;
+                    index_ = index;
+                }
             }
-            h_answer = h_answer + h_b;
-
-            ((uint16_t*)answer)[o_fi] = *reinterpret_cast<uint16_t*>(&h_answer);
         }
+    }
 
-        // Calculate error
-        for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++) {
-            half h_answer(*reinterpret_cast<half*>(&((uint16_t*)answer)[o_fi]));
-            half h_y(*reinterpret_cast<half*>(&((uint16_t*)y_)[o_fi]));
-            //std::cout << o_fi << " " << h_answer << " " << h_y << std::endl;
-            h_err += fabs(h_answer - h_y);  // fabs stands for float absolute value
+    void ReduceTransactionGenerator::CheckResult() {
+        unit_t* x = (unit_t*)x_;
+        unit_t value = op_ == PimReduce::SUM ? 0 : x[0];
+        uint64_t index = 0;
+        for (uint64_t i = 0; i < n_; i++) {
+            if (op_ == PimReduce::SUM) {
+                value += x[i];
+            }
+            else if ((int16_t)x[i] > (int16_t)value) {
+                value = x[i];
+                index = i;
+            }
         }
-        std::cout << "ERROR : " << h_err << std::endl;
+        int err = ABS((int)value - (int)value_);
+        if (op_ == PimReduce::ARGMAX && index != index_)
+            err += 1;
+        std::cout << "ERROR : " << err << std::endl;
     }
 
-    ///////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////////////////////////////////////////////////////////////////////////////
-
-    // Initialize variables and ukernel
-    void LstmPreTransactionGenerator::Initialize() {
-        // TODO(bepo): currently only support m=4096
-        addr_x_ = 0;
-        addr_y_ = Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_h_ = addr_y_ + Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_b_ = addr_h_ + Ceiling(i_f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_Wh_ = addr_b_ + Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-
-        ukernel_access_size_ = SIZE_WORD * 8 * NUM_BANK;
-        ukernel_count_per_pim_ = Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, ukernel_access_size_)
-            / ukernel_access_size_;
-
-        // Define ukernel for gemv
-        ukernel_lstm_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_lstm_[i] = 0b00000000000000000000000000000000; // initialize
-
-        ukernel_lstm_[0] = 0b10100100001000001000100000000000; // MAC(AAM)   GRF_B[0]  BANK  SRF_M
-        ukernel_lstm_[1] = 0b00010000000001000000100000000111; // JUMP       -1        7
-        ukernel_lstm_[2] = 0b00100000000000000000000000000000; // EXIT
-
-        // Define ukernel for reducing output data from ukernel_gemv + write to
-        // physical memory
-        ukernel_wr_result_ = (uint32_t*)malloc(sizeof(uint32_t) * 32);
-        for (int i = 0; i < 32; i++)
-            ukernel_wr_result_[i] = 0b00000000000000000000000000000000; // initialize
-
-        ukernel_wr_result_[0] = 0b10000010100000000000100010000000; // ADD     GRF_A[0]  GRF_B[0]  BANK
-        ukernel_wr_result_[1] = 0b10000100010000000000100110000000; // ADD     GRF_B[1]  GRF_A[0]  BANK
-        ukernel_wr_result_[2] = 0b01000000100000000000000000010000; // MOV     BANK      GRF_B[1]
-        ukernel_wr_result_[3] = 0b00100000000000000000000000000000; // EXIT
+    // LayerNorm / RMSNorm, see transaction_generator.h
+    uint64_t NormTransactionGenerator::WordAddress(uint64_t base_row, int ch, uint64_t w, int k, int j) {
+        Address addr(ch, 0, k / 4, (k % 4) ^ j, (int)(w / NUM_WORD_PER_ROW), (int)(w % NUM_WORD_PER_ROW));
+        return ReverseAddressMapping(addr) + base_row;
     }
 
-    // Write operand data and μkernel to physical memory and PIM registers
-    void LstmPreTransactionGenerator::SetData() {
-        uint64_t strided_size_W = Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        uint64_t strided_size_b = Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-
-        // Transpose input data Wh
-        Wh_T_ = (uint8_t*)malloc(sizeof(uint16_t) * i_f_ * o_f_ * 4);
-
-        for (int i_fi = 0; i_fi < i_f_; i_fi++)
-            for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++)
-                ((uint16_t*)Wh_T_)[o_f_ * 4 * i_fi + o_fi] = ((uint16_t*)Wh_)[i_f_ * o_fi + i_fi];
-
-#ifdef debug_mode
-        std::cout << "HOST:\tSet input data\n";
-#endif
-        ukernel_wr_result_[0] = 0b10000010100000000000100010000000; // ADD     GRF_A[0]  GRF_B[0]  BANK
-        // Write input data Wx, Wh
-        for (int offset = 0; offset < strided_size_W; offset += SIZE_WORD) {
-            TryAddTransaction(addr_Wh_ + offset, true, Wh_T_ + offset);
-        }
-
-        // Write input data b, result data x
-        for (int offset = 0; offset < strided_size_b; offset += SIZE_WORD) {
-            TryAddTransaction(addr_b_ + offset, true, b_ + offset);
-            TryAddTransaction(addr_x_ + offset, true, x_ + offset);
-        }
-        Barrier();
-
-        // Mode transition: SB -> AB
-#ifdef debug_mode
-        std::cout << "\nHOST:\t[1] SB -> AB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_ABMR, 0);
+    void NormTransactionGenerator::EnterBg() {
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_BGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
+        SetMode(1);
+        SetWriteBufferThreshold(1);
     }
 
-    // Execute PIM computation
-    void LstmPreTransactionGenerator::Execute() {
-        ExecuteBank(EVEN_BANK);
-        ExecuteBank(ODD_BANK);
-        //Barrier();
+    void NormTransactionGenerator::ExitBg() {
+        // EXIT took the units back to ABG mode
+        SetMode(2);
+        SetWriteBufferThreshold(-1);
     }
 
-    // Execute PIM computation of EVEN_BANK or ODD_BANK
-    void LstmPreTransactionGenerator::ExecuteBank(int bank) {
-        // Program lstm μkernel
-#ifdef debug_mode
-        std::cout << "HOST:\tProgram lstm μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_lstm_[co * 8]);
-            }
-        }
-        Barrier();
+    void NormTransactionGenerator::Scale(int64_t sum, int64_t sum_sq, unit_t* rstd, unit_t* shift) {
+        double one = 1 << PIM_FRAC_BITS;
+        double mean = (double)sum / f_ / one;
+        double msq = (double)sum_sq / f_ / one;
+        double var = norm_ == PimNorm::LAYER ? std::max(msq - mean * mean, 0.0) : msq;
+        double r = std::round(one / std::sqrt(var + eps_));
+        *rstd = (unit_t)(int16_t)std::min(r, (double)INT16_MAX);
+        double m = norm_ == PimNorm::LAYER ? -std::round(mean * one) : 0.0;
+        *shift = (unit_t)(int16_t)std::max((double)INT16_MIN, std::min((double)INT16_MAX, m));
+    }
 
-        // Execute for EVEN_BANK or ODD_BANK
-        for (int ro = 0; ro * NUM_WORD_PER_ROW / 8 < ukernel_count_per_pim_; ro++) {
-            for (int co_o = 0; co_o < NUM_WORD_PER_ROW / 8; co_o++) {
-#ifdef debug_mode
-                std::cout << "\nHOST:\tSet Srf\n";
-#endif
-                // SRF_M modify
-                std::memcpy(data_temp_ + 16,
-                    ((uint16_t*)h_) + (ro * NUM_WORD_PER_ROW + co_o * 8),
-                    16);
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, bank, MAP_SRF, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
-                }
-                Barrier();
+    // y of feature i of token t the way the apply kernel computes it
+    unit_t NormTransactionGenerator::Apply(uint64_t t, uint64_t i, unit_t rstd, unit_t shift) {
+        unit_t v = ((unit_t*)x_)[t * f_ + i];
+        if (norm_ == PimNorm::LAYER)
+            v += shift;
+        v = PimMulQ(v, rstd);
+        if (gamma_ != NULL)
+            v = PimMulQ(v, ((unit_t*)gamma_)[i]);
+        if (beta_ != NULL)
+            v += ((unit_t*)beta_)[i];
+        return v;
+    }
 
-                // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-                std::cout << "\nHOST:\t[2] AB -> PIM \n";
-#endif
-                * data_temp_ |= 1;
-                for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                    Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
-                    uint64_t hex_addr = ReverseAddressMapping(addr);
-                    TryAddTransaction(hex_addr, true, data_temp_);
-                }
-                Barrier();
+    void NormTransactionGenerator::Initialize() {
+        num_ch_ = ch_end_ - ch_first_;
+        uint64_t units = NUM_BANK_PER_CHANNEL * NUM_UNIT_PER_WORD;
+        fw_ = (f_ + units - 1) / units;
+        f_pad_ = fw_ * units;
+        group_rows_ = (fw_ + NUM_WORD_PER_ROW - 1) / NUM_WORD_PER_ROW;
+        num_groups_ = (l_ + num_ch_ - 1) / num_ch_;
+        uint64_t slab_bytes = SIZE_ROW * num_bank_;
+        buf_x_ = Alloc(num_groups_ * group_rows_ * slab_bytes, PimInterleave::CONV0);
+        buf_y_ = Alloc(num_groups_ * group_rows_ * slab_bytes, PimInterleave::CONV0);
+        if (gamma_ != NULL)
+            buf_gamma_ = Alloc(group_rows_ * slab_bytes, PimInterleave::CONV0);
+        if (beta_ != NULL)
+            buf_beta_ = Alloc(group_rows_ * slab_bytes, PimInterleave::CONV0);
+        buf_stat_ = Alloc(num_groups_ * slab_bytes, PimInterleave::CONV0);
+        base_row_idle_ = IDLE_ROW << (config_->ro_pos + config_->shift_bits);
 
-                // Execute ukernel 0-1 + AB-PIM -> AB
-#ifdef debug_mode
-                std::cout << "\nHOST:\tExecute μkernel 0-1 + [3] PIM -> AB \n";
-#endif
-                for (int co_i = 0; co_i < 8; co_i++) {
-                    uint64_t co = co_o * 8 + co_i;
-                    for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-                        Address addr(ch, 0, 0, bank, ro, co);
-                        uint64_t hex_addr = ReverseAddressMapping(addr);
-                        TryAddTransaction(addr_Wh_ + hex_addr, false, data_temp_);
+        // padding adds nothing to the sums
+        uint64_t tokens = num_groups_ * num_ch_;
+        x_pad_ = (uint8_t*)calloc(tokens * f_pad_, UNIT_SIZE);
+        y_pad_ = (uint8_t*)calloc(tokens * f_pad_, UNIT_SIZE);
+        for (uint64_t t = 0; t < l_; t++)
+            std::memcpy(x_pad_ + t * f_pad_ * UNIT_SIZE, x_ + t * f_ * UNIT_SIZE, f_ * UNIT_SIZE);
+        gamma_pad_ = (uint8_t*)calloc(f_pad_, UNIT_SIZE);
+        beta_pad_ = (uint8_t*)calloc(f_pad_, UNIT_SIZE);
+        if (gamma_ != NULL)
+            std::memcpy(gamma_pad_, gamma_, f_ * UNIT_SIZE);
+        if (beta_ != NULL)
+            std::memcpy(beta_pad_, beta_, f_ * UNIT_SIZE);
+        stat_ = (uint8_t*)calloc(tokens * 4 * 2, SIZE_WORD);
+        rstd_.assign(tokens, 0);
+        shift_.assign(tokens, 0);
+        saturated_ = 0;
+
+        // statistics: lane partials of x (GRF_A0, QMAC by 1.0 saturates where
+        // ADD would wrap) and x*x (GRF_B0) over the 4 banks, stored to bank 0
+        // and 1 of buf_stat_
+        std::string loop = fw_ > 1 ? std::to_string(fw_ - 1) : "";
+        std::string source;
+        if (norm_ == PimNorm::LAYER) {
+            source += "MOV  GRF_A0  SRF_M0\n";
+            stat_chain_ = 2;
+        }
+        else {
+            stat_chain_ = 1;
+        }
+        source += "MOV  GRF_B0  SRF_M0\n";
+        prologue_ = stat_chain_;
+        for (int ba = 0; ba < 4; ba++) {
+            std::string bank = "BANK" + std::to_string(ba);
+            if (norm_ == PimNorm::LAYER)
+                source += "QMAC  GRF_A0  " + bank + "  SRF_M1\n";
+            source += "QMAC  GRF_B0  " + bank + "  " + bank + "\n";
+            if (fw_ > 1)
+                source += "JUMP  -" + std::to_string(stat_chain_) + "  " + loop + "\n";
+        }
+        if (norm_ == PimNorm::LAYER)
+            source += "MOV  BANK0  GRF_A0\n";
+        source += "MOV  BANK1  GRF_B0\n";
+        tail_ = stat_chain_;
+        source += "EXIT\n";
+        ukernel_stat_ = assembler_.Assemble(source, norm_ == PimNorm::LAYER ? "layernorm_stat" : "rmsnorm_stat");
+
+        // apply: operand j of pass ba is in bank ba^j, x then gamma and beta
+        // if given, then y. GRF_A0 holds the partial result
+        j_gamma_ = 1;
+        j_beta_ = gamma_ != NULL ? 2 : 1;
+        j_y_ = j_beta_ + (beta_ != NULL ? 1 : 0);
+        source.clear();
+        for (int ba = 0; ba < 4; ba++) {
+            std::vector<std::string> insts;
+            std::string x = "BANK" + std::to_string(ba);
+            if (norm_ == PimNorm::LAYER) {
+                insts.push_back("ADD  GRF_A0  " + x + "  SRF_A0");
+                insts.push_back("QMUL  GRF_A0  GRF_A0  SRF_M0");
+            }
+            else {
+                insts.push_back("QMUL  GRF_A0  " + x + "  SRF_M0");
+            }
+            if (gamma_ != NULL)
+                insts.push_back("QMUL  GRF_A0  GRF_A0  BANK" + std::to_string(ba ^ j_gamma_));
+            if (beta_ != NULL)
+                insts.push_back("ADD  GRF_A0  GRF_A0  BANK" + std::to_string(ba ^ j_beta_));
+            // the last instruction writes y
+            std::string& last = insts.back();
+            size_t dst = last.find("GRF_A0");
+            last.replace(dst, 6, "BANK" + std::to_string(ba ^ j_y_));
+            for (auto& inst : insts)
+                source += inst + "\n";
+            chain_ = (int)insts.size();
+            if (fw_ > 1)
+                source += "JUMP  -" + std::to_string(chain_) + "  " + loop + "\n";
+        }
+        source += "EXIT\n";
+        ukernel_apply_ = assembler_.Assemble(source, norm_ == PimNorm::LAYER ? "layernorm" : "rmsnorm");
+    }
+
+    void NormTransactionGenerator::SetData() {
+        uint64_t slab = SIZE_ROW * NUM_BANK;
+        for (uint64_t g = 0; g < num_groups_; g++) {
+            uint64_t base_row = allocator_->GetBaseRow(buf_x_) + g * group_rows_ * slab;
+            for (uint64_t c = 0; c < num_ch_; c++) {
+                uint8_t* token = x_pad_ + (g * num_ch_ + c) * f_pad_ * UNIT_SIZE;
+                for (uint64_t w = 0; w < fw_; w++) {
+                    for (int k = 0; k < NUM_BANK_PER_CHANNEL; k++) {
+                        uint64_t unit = w * NUM_BANK_PER_CHANNEL * NUM_UNIT_PER_WORD + k * NUM_UNIT_PER_WORD;
+                        TryAddTransaction(WordAddress(base_row, ch_first_ + (int)c, w, k), true,
+                                          token + unit * UNIT_SIZE);
                     }
                 }
-                Barrier();
-
-                // for the last gemv ukernel, move result to bank
-                if (ro * NUM_WORD_PER_ROW / 8 + co_o >= ukernel_count_per_pim_)
-                    break;
             }
         }
-
-        // Program wr_result ukernel
-#ifdef debug_mode
-        std::cout << "\nHOST:\tProgram wr_result μkernel \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 0; co < 4; co++) {
-                Address addr(ch, 0, 0, 0, MAP_CRF, co);
-                uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, (uint8_t*)&ukernel_wr_result_[co * 8]);
+        // gamma and beta are the same for every token, one copy per channel
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            for (uint64_t w = 0; w < fw_; w++) {
+                for (int k = 0; k < NUM_BANK_PER_CHANNEL; k++) {
+                    uint64_t unit = w * NUM_BANK_PER_CHANNEL * NUM_UNIT_PER_WORD + k * NUM_UNIT_PER_WORD;
+                    if (gamma_ != NULL)
+                        TryAddTransaction(WordAddress(allocator_->GetBaseRow(buf_gamma_), ch, w, k, j_gamma_),
+                                          true, gamma_pad_ + unit * UNIT_SIZE);
+                    if (beta_ != NULL)
+                        TryAddTransaction(WordAddress(allocator_->GetBaseRow(buf_beta_), ch, w, k, j_beta_),
+                                          true, beta_pad_ + unit * UNIT_SIZE);
+                }
             }
         }
         Barrier();
 
-        // Mode transition: AB -> AB-PIM
-#ifdef debug_mode
-        std::cout << "\nHOST:\t[4] AB -> PIM \n";
-#endif
-        * data_temp_ |= 1;
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, 0, MAP_PIM_OP_MODE, 0);
+        launch_ = Mark();
+
+        // Mode transition: SB -> ABG
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(hex_addr, true, data_temp_);
+            TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-
-        // Execute ukernel 0~2 + AB-PIM -> AB
-#ifdef debug_mode
-        std::cout << "\nHOST:\tExecute μkernel 0-2 + [5] PIM -> AB \n";
-#endif
-
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, bank, 0, 0);
+        SetMode(2);
+        ProgramCRF(ukernel_stat_);
+
+        // SRF_M0 = 0 to clear the partials, SRF_M1 = 1.0
+        unit_t srf[UNITS_PER_WORD] = {0};
+        srf[1] = 1 << PIM_FRAC_BITS;
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_SRF, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(addr_b_ + hex_addr, false, data_temp_);
+            TryAddTransaction(hex_addr, true, (uint8_t*)srf);
         }
         Barrier();
+    }
+
+    void NormTransactionGenerator::Execute() {
+        uint64_t slab = SIZE_ROW * NUM_BANK;
+        uint64_t base_row_x = allocator_->GetBaseRow(buf_x_);
+        uint64_t base_row_y = allocator_->GetBaseRow(buf_y_);
+        uint64_t base_row_stat = allocator_->GetBaseRow(buf_stat_);
+
+        // pass 1: lane partials of every group, the prologue and the tail
+        // read no bank
+        for (uint64_t g = 0; g < num_groups_; g++) {
+            EnterBg();
+            SetBaseRow(BaseRow(base_row_idle_, base_row_idle_, base_row_idle_, base_row_idle_));
+            RowSweep(0, 1, prologue_);
+            Barrier();
+            for (int ba = 0; ba < 4; ba++) {
+                uint64_t base_rows[4];
+                for (int b = 0; b < 4; b++)
+                    base_rows[b] = b == ba ? base_row_x + g * group_rows_ * slab : base_row_idle_;
+                SetBaseRow(BaseRow(base_rows[0], base_rows[1], base_rows[2], base_rows[3]));
+                RowSweep(ba, fw_, stat_chain_);
+                Barrier();
+            }
+            uint64_t stat = base_row_stat + g * slab;
+            SetBaseRow(BaseRow(stat, stat, base_row_idle_, base_row_idle_));
+            RowSweep(0, 1, tail_);
+            Barrier();
+            ExitBg();
+        }
 
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, bank, 0, 0);
+        // the host reads the partials of every unit (Mode transition: ABG
+        // -> SB), then computes the statistics of every token
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(addr_x_ + hex_addr, false, data_temp_);
+            TryAddTransaction(hex_addr, false, data_temp_);
+        }
+        Barrier();
+        SetMode(0);
+        int first = norm_ == PimNorm::LAYER ? 0 : 1;
+        for (uint64_t g = 0; g < num_groups_; g++) {
+            for (uint64_t c = 0; c < num_ch_; c++) {
+                for (int bg = 0; bg < 4; bg++) {
+                    for (int w = first; w < 2; w++) {
+                        uint8_t* word = stat_ + (((g * num_ch_ + c) * 4 + bg) * 2 + w) * SIZE_WORD;
+                        TryAddTransaction(WordAddress(base_row_stat + g * slab, ch_first_ + (int)c, 0, bg * 4 + w),
+                                          false, word);
+                    }
+                }
+            }
         }
         Barrier();
+        stat_bytes_ = num_groups_ * num_ch_ * 4 * (2 - first) * SIZE_WORD;
+        for (uint64_t t = 0; t < l_; t++) {
+            int64_t sum = 0, sum_sq = 0;
+            bool saturated = false;
+            for (int bg = 0; bg < 4; bg++) {
+                unit_t* part = (unit_t*)(stat_ + (t * 4 + bg) * 2 * SIZE_WORD);
+                for (int i = 0; i < UNITS_PER_WORD; i++) {
+                    int16_t s = (int16_t)part[i];
+                    int16_t sq = (int16_t)part[UNITS_PER_WORD + i];
+                    if ((first == 0 && (s == INT16_MAX || s == INT16_MIN)) || sq == INT16_MAX)
+                        saturated = true;
+                    sum += s;
+                    sum_sq += sq;
+                }
+            }
+            saturated_ += saturated;
+            Scale(sum, sum_sq, &rstd_[t], &shift_[t]);
+        }
 
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            Address addr(ch, 0, 0, bank, 0, 0);
+        // pass 2: Mode transition: SB -> ABG, every group runs with rstd and
+        // -mean of its tokens in the SRF of their channels
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
+            Address addr(ch, 0, 0, 0, MAP_ABGMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
-            TryAddTransaction(addr_y_ + hex_addr, true, data_temp_);
+            TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-
-        // reset GRF_B
-#ifdef debug_mode
-        std::cout << "\nHOST:\tReset GRF_B\n";
-#endif
-        uint8_t* zero = (uint8_t*)malloc(WORD_SIZE);
-        for (int i = 0; i < WORD_SIZE; i++) zero[i] = 0;
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
-            for (int co = 8; co < 16; co++) {
-                Address addr(ch, 0, 0, 0, MAP_GRF, co);
+        SetMode(2);
+        ProgramCRF(ukernel_apply_);
+        for (uint64_t g = 0; g < num_groups_; g++) {
+            for (uint64_t c = 0; c < num_ch_; c++) {
+                unit_t srf[UNITS_PER_WORD] = {0};
+                srf[0] = rstd_[g * num_ch_ + c];
+                srf[SRF_ENTRIES] = shift_[g * num_ch_ + c];
+                Address addr(ch_first_ + (int)c, 0, 0, 0, MAP_SRF, 0);
                 uint64_t hex_addr = ReverseAddressMapping(addr);
-                TryAddTransaction(hex_addr, true, zero);
+                TryAddTransaction(hex_addr, true, (uint8_t*)srf);
+            }
+            Barrier();
+            EnterBg();
+            for (int ba = 0; ba < 4; ba++) {
+                uint64_t base_rows[4];
+                for (int b = 0; b < 4; b++) {
+                    int j = b ^ ba;
+                    if (j == 0)
+                        base_rows[b] = base_row_x + g * group_rows_ * slab;
+                    else if (j == j_y_)
+                        base_rows[b] = base_row_y + g * group_rows_ * slab;
+                    else if (gamma_ != NULL && j == j_gamma_)
+                        base_rows[b] = allocator_->GetBaseRow(buf_gamma_);
+                    else if (beta_ != NULL && j == j_beta_)
+                        base_rows[b] = allocator_->GetBaseRow(buf_beta_);
+                    else
+                        base_rows[b] = base_row_idle_;
+                }
+                SetBaseRow(BaseRow(base_rows[0], base_rows[1], base_rows[2], base_rows[3]));
+                RowSweep(ba, fw_, chain_);
+                Barrier();
             }
+            ExitBg();
         }
-        Barrier();
     }
 
-    // Read PIM computation result from physical memory
-    void LstmPreTransactionGenerator::GetResult() {
-        // Mode transition: AB -> SB
-#ifdef debug_mode
-        std::cout << "HOST:\t[4] AB -> SB \n";
-#endif
-        for (int ch = 0; ch < NUM_CHANNEL; ch++) {
+    void NormTransactionGenerator::GetResult() {
+        // Mode transition: ABG -> SB
+        for (int ch = ch_first_; ch < ch_end_; ch++) {
             Address addr(ch, 0, 0, 0, MAP_SBMR, 0);
             uint64_t hex_addr = ReverseAddressMapping(addr);
             TryAddTransaction(hex_addr, false, data_temp_);
         }
         Barrier();
-
-        uint64_t strided_size = Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_WORD * NUM_BANK);
-        // Read output data y
-#ifdef debug_mode
-        std::cout << "\nHOST:\tRead output data y\n";
-#endif
-        for (int offset = 0; offset < strided_size; offset += SIZE_WORD)
-            TryAddTransaction(addr_y_ + offset, false, y_ + offset);
+        SetMode(0);
+        readback_ = Mark();
+
+        uint64_t slab = SIZE_ROW * NUM_BANK;
+        for (uint64_t g = 0; g < num_groups_; g++) {
+            uint64_t base_row = allocator_->GetBaseRow(buf_y_) + g * group_rows_ * slab;
+            for (uint64_t c = 0; c < num_ch_; c++) {
+                if (g * num_ch_ + c >= l_)
+                    break;
+                uint8_t* token = y_pad_ + (g * num_ch_ + c) * f_pad_ * UNIT_SIZE;
+                for (uint64_t w = 0; w < fw_; w++) {
+                    for (int k = 0; k < NUM_BANK_PER_CHANNEL; k++) {
+                        uint64_t unit = w * NUM_BANK_PER_CHANNEL * NUM_UNIT_PER_WORD + k * NUM_UNIT_PER_WORD;
+                        TryAddTransaction(WordAddress(base_row, ch_first_ + (int)c, w, k, j_y_), false,
+                                          token + unit * UNIT_SIZE);
+                    }
+                }
+            }
+        }
         Barrier();
+        for (uint64_t t = 0; t < l_; t++)
+            std::memcpy(y_ + t * f_ * UNIT_SIZE, y_pad_ + t * f_pad_ * UNIT_SIZE, f_ * UNIT_SIZE);
     }
 
-    // Calculate error between the result of PIM computation and actual answer
-    void LstmPreTransactionGenerator::CheckResult() {
-        float h_err = 0.;
-        uint8_t* answer = (uint8_t*)malloc(sizeof(uint16_t) * o_f_ * 4);
-
-        for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++) {
-            half h_answer(0);
-            half h_b(*reinterpret_cast<half*>(&((uint16_t*)b_)[o_fi]));
-            half h_x(*reinterpret_cast<half*>(&((uint16_t*)x_)[o_fi]));
-
-            for (int i_fi = 0; i_fi < i_f_; i_fi++) {
-                half h_Wh(*reinterpret_cast<half*>(&((uint16_t*)Wh_)[i_f_ * o_fi + i_fi]));
-                half h_h(*reinterpret_cast<half*>(&((uint16_t*)h_)[i_fi]));
-                h_answer = fma(h_Wh, h_h, h_answer);
+    // the statistics in 64 bits on the host, exact unless a lane partial
+    // saturated
+    void NormTransactionGenerator::CheckResult() {
+        int err = 0;
+        for (uint64_t t = 0; t < l_; t++) {
+            int64_t sum = 0, sum_sq = 0;
+            for (uint64_t i = 0; i < f_; i++) {
+                int32_t v = (int16_t)((unit_t*)x_)[t * f_ + i];
+                sum += v;
+                sum_sq += (v * v + (1 << (PIM_FRAC_BITS - 1))) >> PIM_FRAC_BITS;
+            }
+            unit_t rstd, shift;
+            Scale(sum, sum_sq, &rstd, &shift);
+            for (uint64_t i = 0; i < f_; i++) {
+                err += ABS(((unit_t*)y_)[t * f_ + i] - Apply(t, i, rstd, shift));
             }
-            h_answer = h_answer + h_b + h_x;
-
-            ((uint16_t*)answer)[o_fi] = *reinterpret_cast<uint16_t*>(&h_answer);
-        }
-
-        // Calculate error
-        for (int o_fi = 0; o_fi < o_f_ * 4; o_fi++) {
-            half h_answer(*reinterpret_cast<half*>(&((uint16_t*)answer)[o_fi]));
-            half h_y(*reinterpret_cast<half*>(&((uint16_t*)y_)[o_fi]));
-            //std::cout << o_fi << " " << h_answer << " " << h_y << std::endl;
-            h_err += fabs(h_answer - h_y);  // fabs stands for float absolute value
         }
-        std::cout << "ERROR : " << h_err << std::endl;
-    }
-
-
-
-    //iESLAB/////////////////////////////////////////////////////////////////////
-    //////////////CCCCCCC/////////PPPPPPPPPPPPP/////////UUU///////////UUU////////
-    //////////CCCCCCCCCCCCCCC/////PPP/////////PPPP//////UUU///////////UUU////////
-    /////////CCC//////////CCC/////PPP//////////PPPP/////UUU///////////UUU////////
-    ////////CCC///////////////////PPP///////////PPP/////UUU///////////UUU////////
-    ////////CCC///////////////////PPP/////////PPPP//////UUU///////////UUU////////
-    ////////CCC///////////////////PPPPPPPPPPPPP/////////UUU///////////UUU////////
-    ////////CCC///////////////////PPP///////////////////UUU///////////UUU////////
-    /////////CCC/////////CCCCC////PPP////////////////////UUU/////////UUU/////////
-    //////////CCCCCCCCCCCCC///////PPP//////////////////////UUUU///UUUU///////////
-    /////////////CCCCCCC//////////PPP/////////////////////////UUUUU//////////////
-    ///////////////////////////////////////////////////////////////////KKM//LHY//
-
-
-    // Initialize variables and ukernel
-    void CPUAddTransactionGenerator::Initialize() {
-        // base address of operands
-        addr_x_ = 0;
-        addr_y_ = Ceiling(b_ * n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = 2 * addr_y_;
+        if (saturated_ > 0)
+            std::cout << "saturated tokens : " << saturated_ << std::endl;
+        std::cout << "ERROR : " << err << std::endl;
     }
 
-    // Execute PIM computation
-    void CPUAddTransactionGenerator::Execute() {
-        int cnt = 0;
-        std::cout << UNIT_SIZE << " " << n_ << " " << UNITS_PER_WORD << std::endl;
-        for (int i = 0; i < UNIT_SIZE * b_ * n_; i += WORD_SIZE) {
-            TryAddTransaction(addr_x_ + i, false, data_temp_);
-            cnt++;
+    // Host traffic in SB mode, no PIM mode change at all
+    void HostTransactionGenerator::Initialize() {
+        num_words_ = Ceiling(n_ * UNIT_SIZE, SIZE_WORD) / SIZE_WORD;
+        buf_x_ = Alloc(n_ * UNIT_SIZE, PimInterleave::CONV0);
+        if (pattern_ == HostPattern::STREAM) {
+            buf_y_ = Alloc(n_ * UNIT_SIZE, PimInterleave::CONV0);
+            buf_z_ = Alloc(n_ * UNIT_SIZE, PimInterleave::CONV0);
         }
+        else {
+            // what the host last wrote to every word of x
+            shadow_ = (uint8_t*)calloc(num_words_, SIZE_WORD);
+            std::memcpy(shadow_, x_, n_ * UNIT_SIZE);
+        }
+        word_temp_ = (uint8_t*)calloc(1, SIZE_WORD);
+        num_reads_ = num_writes_ = 0;
+        read_latency_sum_ = read_latency_max_ = num_reads_done_ = 0;
+        exec_clk_ = 0;
+        errors_ = 0;
+    }
 
-        std::cout << cnt << std::endl;
-        cnt = 0;
-        for (int i = 0; i < UNIT_SIZE * b_ * n_; i += WORD_SIZE) {
-            TryAddTransaction(addr_y_ + i, false, data_temp_);
-            cnt++;
+    void HostTransactionGenerator::SetData() {
+        uint8_t* pad = (uint8_t*)calloc(num_words_, SIZE_WORD);
+        std::memcpy(pad, x_, n_ * UNIT_SIZE);
+        for (uint64_t offset = 0; offset < num_words_ * SIZE_WORD; offset += SIZE_WORD) {
+            TryAddTransaction(allocator_->Address(buf_x_, offset), true, pad + offset);
         }
-
-        //Barrier();
-        std::cout << cnt << std::endl;
-        cnt = 0;
-        for (int i = 0; i < UNIT_SIZE * b_ * n_; i += WORD_SIZE) {
-            TryAddTransaction(addr_z_ + i, true, data_temp_);
-            cnt++;
+        if (pattern_ == HostPattern::STREAM) {
+            std::memcpy(pad, y_, n_ * UNIT_SIZE);
+            for (uint64_t offset = 0; offset < num_words_ * SIZE_WORD; offset += SIZE_WORD) {
+                TryAddTransaction(allocator_->Address(buf_y_, offset), true, pad + offset);
+            }
         }
         Barrier();
-        std::cout << cnt << std::endl;
-    }
-
-
-    // Initialize variables and ukernel
-    void CPUGemvTransactionGenerator::Initialize() {
-        // TODO(bepo): currently only support m=4096
-        addr_A_ = 0;
-        addr_y_ = Ceiling(m_ * n_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_x_ = addr_y_ + Ceiling(b_ * m_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+        free(pad);
     }
 
-    // Execute PIM computation
-    void CPUGemvTransactionGenerator::Execute() {
-        for (int b = 0; b < b_; b++) {
-            for (int m = 0; m < m_; m++) {
-                for (int n_offset = 0; n_offset < UNIT_SIZE * n_; n_offset += WORD_SIZE) {
-                    // AddTransaction A (read)
-                    TryAddTransaction(addr_A_ + m * n_ * UNIT_SIZE + n_offset, false, data_temp_);
-                }
+    // Issue the host requests, reads are timed from issue to ReadCallBack
+    void HostTransactionGenerator::Execute() {
+        uint64_t start = clk_;
+        if (pattern_ == HostPattern::STREAM) {
+            // z = x + y word by word, the host adds what it read
+            uint8_t* word_y = (uint8_t*)malloc(SIZE_WORD);
+            for (uint64_t offset = 0; offset < num_words_ * SIZE_WORD; offset += SIZE_WORD) {
+                IssueRead(allocator_->Address(buf_x_, offset), word_temp_);
+                IssueRead(allocator_->Address(buf_y_, offset), word_y);
+                for (int u = 0; u < UNITS_PER_WORD; u++)
+                    ((uint16_t*)word_temp_)[u] += ((uint16_t*)word_y)[u];
+                TryAddTransaction(allocator_->Address(buf_z_, offset), true, word_temp_);
+                num_writes_++;
             }
-            Barrier();
-
-            for (int m = 0; m < uint64_t(m_ * miss_ratio_); m++) {
-                for (int n_offset = 0; n_offset < UNIT_SIZE * n_; n_offset += WORD_SIZE) {
-                    // AddTransaction x (read)
-                    // Need to control reuse factor
-                    TryAddTransaction(addr_x_ + n_offset, false, data_temp_);
+            free(word_y);
+        }
+        else {
+            std::mt19937_64 gen(1);
+            std::uniform_real_distribution<double> coin(0.0, 1.0);
+            for (uint64_t i = 0; i < requests_; i++) {
+                uint64_t offset = (gen() % num_words_) * SIZE_WORD;
+                uint64_t address = allocator_->Address(buf_x_, offset);
+                if (coin(gen) < read_ratio_) {
+                    // data is in place once the read is issued
+                    IssueRead(address, word_temp_);
+                    if (std::memcmp(word_temp_, shadow_ + offset, SIZE_WORD) != 0)
+                        errors_++;
+                }
+                else {
+                    for (int u = 0; u < UNITS_PER_WORD; u++)
+                        ((uint16_t*)word_temp_)[u] = (uint16_t)(i * UNITS_PER_WORD + u);
+                    std::memcpy(shadow_ + offset, word_temp_, SIZE_WORD);
+                    TryAddTransaction(address, true, word_temp_);
+                    num_writes_++;
                 }
-                Barrier();
-            }
-
-            for (int m_offset; m_offset < UNIT_SIZE * m_; m_offset += WORD_SIZE) {
-                // Addtransaction y (write)
-                TryAddTransaction(addr_y_ + m_offset, true, data_temp_);
             }
-            Barrier();
         }
+        Barrier();
+        exec_clk_ = clk_ - start;
     }
 
-
-    // Initialize variables and ukernel
-    void CPUBatchNormTransactionGenerator::Initialize() {
-        addr_x_ = 0;
-        addr_w_ = Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_y_ = addr_w_ + Ceiling(l_ * f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_z_ = addr_y_ + Ceiling(l_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+    void HostTransactionGenerator::IssueRead(uint64_t hex_addr, uint8_t* DataPtr) {
+        TryAddTransaction(hex_addr, false, DataPtr);
+        // issued in this cycle, the callback comes at a later one
+        read_issue_clk_[hex_addr].push_back(clk_);
+        num_reads_++;
     }
 
-    // Execute PIM computation
-    void CPUBatchNormTransactionGenerator::Execute() {
-        for (int b = 0; b < b_; b++) {
-            for (int li = 0; li < l_; li++) {
-                for (int f_offset = 0; f_offset < UNIT_SIZE * f_; f_offset += WORD_SIZE) {
-                    // AddTransaction x (read)
-                    TryAddTransaction(addr_x_ + f_ * li * UNIT_SIZE + f_offset, false, data_temp_);
-                }
-            }
-            Barrier();
-
-            // 1 : cold miss, 0 : can reuse at first
-#if 1
-            for (int f_offset = 0; f_offset < UNIT_SIZE * f_; f_offset += WORD_SIZE) {
-                // AddTransaction y (read)
-                // Need to control reuse factor
-                TryAddTransaction(addr_y_ + f_offset, false, data_temp_);
-            }
-            Barrier();
-#endif
-            for (int li = 0; li < uint64_t(l_ * miss_ratio_); li++) {
-                for (int f_offset = 0; f_offset < UNIT_SIZE * f_; f_offset += WORD_SIZE) {
-                    // AddTransaction y (read)
-                    // Need to control reuse factor
-                    TryAddTransaction(addr_y_ + f_offset, false, data_temp_);
-                }
-                Barrier();
-            }
+    void HostTransactionGenerator::ReadCallBack(uint64_t addr, uint8_t* DataPtr) {
+        auto it = read_issue_clk_.find(addr);
+        if (it == read_issue_clk_.end())
+            return;
+        uint64_t latency = clk_ - it->second.front();
+        read_latency_sum_ += latency;
+        read_latency_max_ = std::max(read_latency_max_, latency);
+        num_reads_done_++;
+        it->second.pop_front();
+        if (it->second.empty())
+            read_issue_clk_.erase(it);
+    }
 
-            for (int li = 0; li < uint64_t(l_ * miss_ratio_); li++) {
-                for (int f_offset = 0; f_offset < UNIT_SIZE * f_; f_offset += WORD_SIZE) {
-                    // AddTransaction z (read)
-                    // Need to control reuse factor
-                    TryAddTransaction(addr_z_ + f_offset, false, data_temp_);
-                }
-                Barrier();
-            }
+    // Read back z (STREAM) or the whole buffer (RANDOM)
+    void HostTransactionGenerator::GetResult() {
+        PimBuffer& buf = pattern_ == HostPattern::STREAM ? buf_z_ : buf_x_;
+        uint8_t* pad = (uint8_t*)calloc(num_words_, SIZE_WORD);
+        for (uint64_t offset = 0; offset < num_words_ * SIZE_WORD; offset += SIZE_WORD) {
+            TryAddTransaction(allocator_->Address(buf, offset), false, pad + offset);
+        }
+        Barrier();
+        if (pattern_ == HostPattern::STREAM) {
+            std::memcpy(z_, pad, n_ * UNIT_SIZE);
+        }
+        else if (std::memcmp(pad, shadow_, num_words_ * SIZE_WORD) != 0) {
+            errors_++;
+        }
+        free(pad);
+    }
 
-            for (int li = 0; li < l_; li++) {
-                for (int f_offset = 0; f_offset < UNIT_SIZE * f_; f_offset += WORD_SIZE) {
-                    // AddTransaction w (write)
-                    TryAddTransaction(addr_w_ + f_ * li * UNIT_SIZE + f_offset, false, data_temp_);
-                }
+    void HostTransactionGenerator::CheckResult() {
+        int err = errors_;
+        if (pattern_ == HostPattern::STREAM) {
+            uint16_t sum;
+            for (int i = 0; i < n_; i++) {
+                sum = ((uint16_t*)x_)[i] + ((uint16_t*)y_)[i];
+                err += ABS(((uint16_t*)z_)[i] - sum);
             }
-            Barrier();
         }
+        std::cout << "ERROR : " << err << std::endl;
+        PrintHostStats();
     }
 
-
-    // Initialize variables and ukernel
-    void CPULstmTransactionGenerator::Initialize() {
-        addr_x_ = 0;
-        addr_y_ = Ceiling(i_f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_h_ = addr_y_ + Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_b_ = addr_h_ + Ceiling(i_f_ * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_Wx_ = addr_b_ + Ceiling(o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
-        addr_Wh_ = addr_Wx_ + Ceiling(i_f_ * o_f_ * 4 * UNIT_SIZE, SIZE_ROW * NUM_BANK);
+    void HostTransactionGenerator::PrintHostStats() {
+        std::cout << "host requests : " << num_reads_ << " reads, " << num_writes_
+                  << " writes in " << exec_clk_ << " cycles ("
+                  << (double)(num_reads_ + num_writes_) * SIZE_WORD / (exec_clk_ ? exec_clk_ : 1)
+                  << " bytes/cycle)" << std::endl;
+        std::cout << "host read latency : avg " << GetAvgReadLatency() << ", max "
+                  << read_latency_max_ << " cycles" << std::endl;
     }
+    ///////////////////////////////////////////////////////////////////////////////////////////
+    ///////////////////////////////////////////////////////////////////////////////////////////
+    //iESLAB/////////////////////////////////////////////////////////////////////
+    //////////////CCCCCCC/////////PPPPPPPPPPPPP/////////UUU///////////UUU////////
+    //////////CCCCCCCCCCCCCCC/////PPP/////////PPPP//////UUU///////////UUU////////
+    /////////CCC//////////CCC/////PPP//////////PPPP/////UUU///////////UUU////////
+    ////////CCC///////////////////PPP///////////PPP/////UUU///////////UUU////////
+    ////////CCC///////////////////PPP/////////PPPP//////UUU///////////UUU////////
+    ////////CCC///////////////////PPPPPPPPPPPPP/////////UUU///////////UUU////////
+    ////////CCC///////////////////PPP///////////////////UUU///////////UUU////////
+    /////////CCC/////////CCCCC////PPP////////////////////UUU/////////UUU/////////
+    //////////CCCCCCCCCCCCC///////PPP//////////////////////UUUU///UUUU///////////
+    /////////////CCCCCCC//////////PPP/////////////////////////UUUUU//////////////
+    ///////////////////////////////////////////////////////////////////KKM//LHY//
 
-    // Execute PIM computation
-    void CPULstmTransactionGenerator::Execute() {
-        for (int b = 0; b < b_; b++) {
-            for (int i_fi = 0; i_fi < i_f_; i_fi++) {
-                for (int o_f_offset = 0; o_f_offset < UNIT_SIZE * o_f_; o_f_offset += WORD_SIZE) {
-                    // AddTransaction Wx, Wh (read)
-                    TryAddTransaction(addr_Wx_ + o_f_ * i_fi * UNIT_SIZE + o_f_offset, false, data_temp_);
-                    TryAddTransaction(addr_Wh_ + o_f_ * i_fi * UNIT_SIZE + o_f_offset, false, data_temp_);
-                }
-            }
 
-            for (int o_f_offset = 0; o_f_offset < UNIT_SIZE * o_f_; o_f_offset += WORD_SIZE) {
-                // AddTransaction A (read)
-                TryAddTransaction(addr_b_ + o_f_offset, false, data_temp_);
-            }
-            Barrier();
+    void CPUTransactionGenerator::AddOperand(uint64_t n, bool is_write, uint64_t reuses) {
+        operands_.push_back(CPUOperand{n * UNIT_SIZE, is_write, reuses, PimBuffer()});
+    }
 
-            // >> cold miss <<
-#if 1
-            for (int o_f_offset = 0; o_f_offset < UNIT_SIZE * o_f_; o_f_offset += WORD_SIZE) {
-                // AddTransaction x, h (read)
-                // Need to control reuse factor
-                TryAddTransaction(addr_x_ + o_f_offset, false, data_temp_);
-                TryAddTransaction(addr_h_ + o_f_offset, false, data_temp_);
-            }
-            Barrier();
-#endif
+    // Place the operands, consecutive words go round the channels as for
+    // any host buffer
+    void CPUTransactionGenerator::Initialize() {
+        for (auto& op : operands_)
+            op.buf = Alloc(op.size, PimInterleave::CONV0);
+    }
 
-            for (int i_fi = 0; i_fi < uint64_t(i_f_ * miss_ratio_); i_fi++) {
-                for (int o_f_offset = 0; o_f_offset < UNIT_SIZE * o_f_; o_f_offset += WORD_SIZE) {
-                    // AddTransaction x, h (read)
-                    // Need to control reuse factor
-                    TryAddTransaction(addr_x_ + o_f_offset, false, data_temp_);
-                    TryAddTransaction(addr_h_ + o_f_offset, false, data_temp_);
-                }
-                Barrier();
-            }
+    void CPUTransactionGenerator::Execute() {
+        uint64_t max_size = 0;
+        for (auto& op : operands_)
+            max_size = std::max(max_size, op.size);
 
-            for (int o_f_offset = 0; o_f_offset < UNIT_SIZE * o_f_; o_f_offset += WORD_SIZE) {
-                // AddTransaction y (write)
-                TryAddTransaction(addr_y_ + o_f_offset, true, data_temp_);
+        // one pass over every operand, word by word as a streaming loop
+        for (uint64_t offset = 0; offset < max_size; offset += SIZE_WORD) {
+            for (auto& op : operands_) {
+                if (offset < op.size)
+                    TryAddTransaction(allocator_->Address(op.buf, offset), op.is_write, data_temp_);
+            }
+        }
+        // reuses that miss in the host cache read the operand again
+        for (auto& op : operands_) {
+            uint64_t misses = (uint64_t)(op.reuses * miss_ratio_);
+            for (uint64_t r = 0; r < misses; r++) {
+                for (uint64_t offset = 0; offset < op.size; offset += SIZE_WORD)
+                    TryAddTransaction(allocator_->Address(op.buf, offset), false, data_temp_);
             }
-            Barrier();
         }
+        Barrier();
     }
-    */
 }  // namespace dramsim3
@@ -6,10 +6,17 @@
 #include <stdlib.h>
 #include <string>
 #include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
 #include "./memory_system.h"
 #include "./configuration.h"
 #include "./common.h"
 #include "./pim_config.h"
+#include "./pim_allocator.h"
+#include "./pim_assembler.h"
 
 #define EVEN_BANK 0
 #define ODD_BANK  1
@@ -22,10 +29,18 @@
 #define SIZE_WORD            32
 #define SIZE_ROW             (SIZE_WORD * NUM_WORD_PER_ROW)
 
+// GEMV tile: output rows covered by all PIM units at once (2 banks per
+// unit, 16 lanes per bank, fewer on a channel group, see tile_m_) and
+// columns of A covered by one SRF write
+#define GEMV_TILE_M          (NUM_UNIT_PER_WORD * NUM_BANK / 2)
+#define GEMV_TILE_N          NUM_UNIT_PER_WORD
+
 #define MAP_SBMR             0x3fff
 #define MAP_BGMR             0x3ffe
 #define MAP_ABGMR	      0x3ffd
 #define MAP_SRF	      0x3ffb
+#define MAP_CRF	      0x3ffa
+#define MAP_LUT	      0x3ff9
 
 #define IDLE_ROW	      0x3ffc
 
@@ -35,47 +50,27 @@
 #define C_YELLOW "\033[033m"
 #define C_BLUE   "\033[034m"
 
-#define ADDR_CONV0(X) (X)
-#define ADDR_CONV1(X) ((X)^0x00000200)
-#define ADDR_CONV2(X) ((X)^0x00000400)
-#define ADDR_CONV3(X) ((X)^0x00000600)
-
-#define ADDR_CONVG(X) (((X)&0xfffffffffffe3ff) | (((X)&0xc00)<<1) | (((X)&0x1000)>>2));
-
 #define ABS(X) ((X) < 0 ? -(X) : (X))
 
 namespace dramsim3 {
 
+    class PimScheduler;
+
+    // Activations the LUT approximates, see LUT_SEGMENTS
+    enum class PimActivation { GELU, SILU, SIGMOID, TANH, EXP };
+
+    double PimActivationValue(PimActivation act, double x);
+    // LUT_SEGMENTS intercepts then slopes of act, Q8.8 (PIM_FRAC_BITS)
+    void PimActivationLut(PimActivation act, unit_t* lut);
+
     class TransactionGenerator {
     public:
+        // scheduler: run on the memory and allocator of scheduler, only
+        // launched there, else on a memory of its own
         TransactionGenerator(const std::string& config_file,
-            const::string& output_dir)
-            : memory_system_(
-                config_file, output_dir,
-                std::bind(&TransactionGenerator::ReadCallBack, this,
-                    std::placeholders::_1, std::placeholders::_2),
-                std::bind(&TransactionGenerator::WriteCallBack, this,
-                    std::placeholders::_1)),
-            config_(new Config(config_file, output_dir)),
-            clk_(0) {
-            pmemAddr_size_ = (uint64_t)4 * 1024 * 1024 * 1024;
-            pmemAddr_ = (uint8_t*)mmap(NULL, pmemAddr_size_,
-                PROT_READ | PROT_WRITE,
-                MAP_ANON | MAP_PRIVATE,
-                -1, 0);
-            if (pmemAddr_ == (uint8_t*)MAP_FAILED)
-                perror("mmap");
-            burstSize_ = 32;
-
-            data_temp_ = (uint8_t*)malloc(burstSize_);
-
-            memory_system_.init(pmemAddr_, pmemAddr_size_, burstSize_);
-
-            is_print_ = false;
-            start_clk_ = 0;
-            cnt_ = 0;
-        }
-        ~TransactionGenerator() { delete(config_); }
+            const std::string& output_dir,
+            PimScheduler* scheduler = NULL);
+        virtual ~TransactionGenerator();
         // virtual void ClockTick() = 0;
         virtual void Initialize() = 0;
         virtual void SetData() = 0;
@@ -83,27 +78,98 @@ namespace dramsim3 {
         virtual void GetResult() = 0;
         virtual void CheckResult() = 0;
 
-        void ReadCallBack(uint64_t addr, uint8_t* DataPtr);
-        void WriteCallBack(uint64_t addr);
-        void PrintStats() { memory_system_.PrintStats(); }
+        // called when a transaction of this generator's channels is done
+        virtual void ReadCallBack(uint64_t addr, uint8_t* DataPtr);
+        virtual void WriteCallBack(uint64_t addr);
+        void PrintStats() { memory_system_->PrintStats(); }
         uint64_t ReverseAddressMapping(Address& addr);
         uint64_t Ceiling(uint64_t num, uint64_t stride);
         void TryAddTransaction(uint64_t hex_addr, bool is_write, uint8_t* DataPtr);
         void Barrier();
+        void WaitPimCommands(uint64_t count);
+        void RowSweep(int ba, uint64_t op_count, int repeat = 1);
+        void ProgramCRF(PimInstruction* kernel);
         uint64_t GetClk() { return clk_; }
+        // energy (pJ) of the memory so far, DRAM and PIM
+        double GetEnergy() { return memory_system_->GetTotalEnergy(); }
+
+        // clk and energy at a point of the run
+        struct RunMark {
+            uint64_t clk;
+            double energy;
+        };
+        RunMark Mark() { return {clk_, GetEnergy()}; }
+        // SetData marks launch_ once the operands are written, before the
+        // mode change and the CRF/SRF programming, and GetResult marks
+        // readback_ after the mode exit, before the results are read.
+        // Generators without a launch or readback leave them as they are
+        RunMark launch_, readback_;
+
+        // Run on channels first ~ first+count-1 only, count a power of two
+        // and first a multiple of count. Call before Initialize()
+        void SetChannels(int first, int count);
+        int GetFirstChannel() const { return ch_first_; }
+        int GetNumChannels() const { return ch_end_ - ch_first_; }
+
+        // Keep operand in buffer, a buffer of the memory this generator
+        // runs on that outlives it, e.g. the output of an earlier kernel on
+        // the same channels. Call before Initialize(). The generator does
+        // not write the operand from the host or free the buffer, see the
+        // operand names and buffer interleaves of the generators
+        void Bind(const std::string& operand, const PimBuffer& buffer);
 
         bool is_print_;
         uint64_t start_clk_;
         int cnt_;
 
     protected:
-        MemorySystem memory_system_;
+        friend class PimScheduler;
+
+        void Tick();
+        bool TakeIssueSlot(int channel);
+        // bank mode, base row and write threshold of the channels in use
+        void SetMode(int mode);
+        void SetBaseRow(BaseRow base_row);
+        void SetWriteBufferThreshold(int threshold);
+        // write the LUT of every unit (ABG mode)
+        void LoadLut(const unit_t* lut);
+        // buffer on the channels in use, freed with the generator
+        PimBuffer Alloc(uint64_t bytes, PimInterleave interleave);
+        // buffer of operand, the bound one or a new one from Alloc
+        PimBuffer AllocOperand(const std::string& operand, uint64_t bytes,
+                               PimInterleave interleave);
+        bool IsBound(const std::string& operand) const {
+            return bound_.count(operand) != 0;
+        }
+
+        // NULL on a scheduler
+        std::unique_ptr<MemorySystem> own_memory_system_;
+        // own_memory_system_, or the memory of the scheduler
+        MemorySystem* memory_system_;
+        PimScheduler* scheduler_;
+        // launched as a shared kernel (PimScheduler::Launch)
+        bool shared_;
         const Config* config_;
         uint8_t* pmemAddr_;
         uint64_t pmemAddr_size_;
         unsigned int burstSize_;
         uint64_t clk_;
         uint8_t* data_temp_;
+        PimAllocator own_allocator_;
+        // operand placement in PIM memory: own_allocator_, or the allocator
+        // of the scheduler
+        PimAllocator* allocator_;
+        // buffers from Alloc, and the ones bound to operands
+        std::vector<PimBuffer> buffers_;
+        std::map<std::string, PimBuffer> bound_;
+        // μkernels of this generator, cached by source
+        PimAssembler assembler_;
+        // channels in use are ch_first_ ~ ch_end_-1, num_bank_ banks in all
+        int ch_first_, ch_end_;
+        uint64_t num_bank_;
+        // issue slots taken in this cycle
+        int issued_;
+        std::vector<bool> channel_issued_;
     };
 
     class AddTransactionGenerator : public TransactionGenerator {
@@ -113,8 +179,9 @@ namespace dramsim3 {
             uint64_t n,
             uint8_t* x,
             uint8_t* y,
-            uint8_t* z)
-            : TransactionGenerator(config_file, output_dir),
+            uint8_t* z,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
             n_(n), x_(x), y_(y), z_(z) {}
         void Initialize() override;
         void SetData() override;
@@ -125,7 +192,7 @@ namespace dramsim3 {
     private:
         uint8_t* x_, * y_, * z_;
         uint64_t n_;
-        uint64_t addr_x_, addr_y_, addr_z_;
+        PimBuffer buf_x_, buf_y_, buf_z_;
         uint64_t base_row_x_, base_row_y_, base_row_z_, base_row_idle_;
         uint64_t ukernel_access_size_;
         uint64_t ukernel_count_per_pim_;
@@ -141,8 +208,9 @@ namespace dramsim3 {
             uint64_t n,
             uint8_t* x,
             uint8_t* y,
-            uint8_t* z)
-            : TransactionGenerator(config_file, output_dir),
+            uint8_t* z,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
             n_(n), x_(x), y_(y), z_(z) {}
         void Initialize() override;
         void SetData() override;
@@ -153,7 +221,7 @@ namespace dramsim3 {
     private:
         uint8_t* x_, * y_, * z_;
         uint64_t n_;
-        uint64_t addr_x_, addr_y_, addr_z_;
+        PimBuffer buf_x_, buf_y_, buf_z_;
         uint64_t base_row_x_, base_row_y_, base_row_z_, base_row_idle_;
         uint64_t ukernel_access_size_;
         uint64_t ukernel_count_per_pim_;
@@ -171,8 +239,9 @@ namespace dramsim3 {
             uint8_t* x,
             uint8_t* y,
             uint8_t* z,
-            uint8_t* w)
-            : TransactionGenerator(config_file, output_dir),
+            uint8_t* w,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
             l_(l), f_(f), x_(x), y_(y), z_(z), w_(w) {}
         void Initialize() override;
         void SetData() override;
@@ -183,7 +252,7 @@ namespace dramsim3 {
     private:
         uint8_t* x_, * y_, * z_, * w_;
         uint64_t l_, f_;
-        uint64_t addr_x_, addr_y_, addr_z_, addr_w_;
+        PimBuffer buf_x_, buf_y_, buf_z_, buf_w_;
         uint64_t base_row_x_, base_row_y_, base_row_z_, base_row_w_, base_row_idle_;
         uint64_t row_count_;
         uint64_t op_count_;
@@ -199,101 +268,131 @@ namespace dramsim3 {
             uint64_t n,
             uint8_t* A,
             uint8_t* x,
-            uint8_t* y)
-            : TransactionGenerator(config_file, output_dir),
-            m_(m), n_(n), A_(A), x_(x), y_(y) {}
+            uint8_t* y,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            m_(m), n_(n), A_(A), x_(x), y_(y), weight_loaded_(false) {}
         void Initialize() override;
         void SetData() override;
         void Execute() override;
         void GetResult() override;
         void CheckResult() override;
 
-    private:
+        // Place A in PIM memory once, A stays resident for every Invoke()
+        void LoadWeight();
+        // One GEMV step y = A * x on the resident A: stream x through the
+        // SRF, run the ukernels and read y back. Returns the cycles it took.
+        uint64_t Invoke(uint8_t* x);
+
+    protected:
         uint8_t *A_, *x_, *y_;
+        // m and n padded to whole tiles, padding of A and x is zero
+        uint64_t m_pad_, n_pad_;
+        // GEMV_TILE_M on the channels in use
+        uint64_t tile_m_;
+        uint64_t num_tiles_;
+        // tile k of y is at offset 2 * k * tile_m_ units, in bank 0,1
+        PimBuffer buf_y_;
+        uint64_t base_row_y_, base_row_idle_;
+
+    private:
+        void EnterPim();
+
         uint8_t* A_T_;
         uint64_t m_, n_;
-        uint64_t addr_A_, addr_A2_, addr_y_;
-        uint64_t base_row_A_, base_row_A2_, base_row_y_, base_row_idle_;
+        uint8_t *x_pad_, *y_pad_;
+        PimBuffer buf_A_;
+        // tile k of A starts at offset k * tile_stride_ of buf_A_
+        uint64_t base_row_A_, tile_stride_;
         uint64_t ukernel_access_size_;
         uint64_t ukernel_count_per_pim_;
+        // one kernel per tile, storing to bank 0,1
         PimInstruction* ukernel_gemv_;
-        PimInstruction* ukernel_gemv_last_;
-        PimInstruction* ukernel_gemv_last__;
+        bool weight_loaded_;
     };
 
-/*
-    class BatchNormTransactionGenerator : public TransactionGenerator {
+    // Gates of one LSTM step y = Wx * x + Wh * h + b, 4 * o_f outputs (the
+    // gates of o_f cells) of i_f inputs x and o_f states h, Wx is 4*o_f x i_f
+    // and Wh 4*o_f x o_f row major. Runs as one GEMV of [Wx | Wh | b] and
+    // [x; h; 1], so the bias needs no pass of its own. The gate activations
+    // and the cell update are left to the host
+    class LstmTransactionGenerator : public GemvTransactionGenerator {
     public:
-        BatchNormTransactionGenerator(const std::string& config_file,
+        LstmTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
-            uint64_t l,
-            uint64_t f,
+            uint64_t i_f,
+            uint64_t o_f,
             uint8_t* x,
             uint8_t* y,
-            uint8_t* z,
-            uint8_t* w)
-            : TransactionGenerator(config_file, output_dir),
-            l_(l), f_(f), x_(x), y_(y), z_(z), w_(w) {}
-        void Initialize() override;
-        void SetData() override;
-        void Execute() override;
-        void GetResult() override;
+            uint8_t* h,
+            uint8_t* b,
+            uint8_t* Wx,
+            uint8_t* Wh,
+            PimScheduler* scheduler = NULL);
         void CheckResult() override;
 
+        // Next step on the resident weights with input x and state h.
+        // Returns the cycles it took
+        uint64_t Step(uint8_t* x, uint8_t* h);
+
     private:
-        uint8_t* x_, * y_, * z_, * w_;
-        uint64_t l_, f_;
-        uint64_t addr_x_, addr_y_, addr_z_, addr_w_;
-        uint64_t ukernel_access_size_;
-        uint64_t ukernel_count_per_pim_;
-        uint32_t* ukernel_bn_;
+        uint8_t *b_, *Wx_, *Wh_;
+        uint64_t i_f_, o_f_;
     };
 
-    class LstmTransactionGenerator : public TransactionGenerator {
+    // Gates of one LSTM step with the input projection done before, for
+    // every step at once: y = Wh * h + b + x, x holds the 4*o_f projected
+    // inputs. [Wh | b] stays resident and runs as a GEMV with [h; 1], then
+    // an ADD pass adds x to y in the banks. x is written next to y, every
+    // word in the bank (bank ^ 1) beside its y word
+    class LstmPreTransactionGenerator : public GemvTransactionGenerator {
     public:
-        LstmTransactionGenerator(const std::string& config_file,
+        LstmPreTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
-            uint64_t i_f,
             uint64_t o_f,
             uint8_t* x,
             uint8_t* y,
             uint8_t* h,
             uint8_t* b,
-            uint8_t* Wx,
-            uint8_t* Wh)
-            : TransactionGenerator(config_file, output_dir),
-            i_f_(i_f), o_f_(o_f), x_(x), y_(y), h_(h), b_(b), Wx_(Wx), Wh_(Wh) {}
+            uint8_t* Wh,
+            PimScheduler* scheduler = NULL);
         void Initialize() override;
         void SetData() override;
         void Execute() override;
-        void GetResult() override;
         void CheckResult() override;
 
+        // Next step on the resident weights with projected input x and
+        // state h. Returns the cycles it took
+        uint64_t Step(uint8_t* x, uint8_t* h);
+
     private:
-        void ExecuteBank(int bank, bool calc_h);
+        void WriteProjection();
 
-        uint8_t* x_, * y_, * h_, * b_, * Wx_, * Wh_;
-        uint8_t* Wx_T_, * Wh_T_;
-        uint64_t i_f_, o_f_;
-        uint64_t addr_x_, addr_y_, addr_h_, addr_b_, addr_Wx_, addr_Wh_;
-        uint64_t ukernel_access_size_;
-        uint64_t ukernel_count_per_pim_;
-        uint32_t* ukernel_lstm_, * ukernel_wr_result_;
+        uint8_t *x_pre_, *b_, *Wh_;
+        uint64_t o_f_;
+        uint8_t* x_pre_pad_;
+        PimBuffer buf_x_pre_;
+        // words of y per bank
+        uint64_t op_count_;
+        PimInstruction* ukernel_add_;
     };
 
-    class LstmPreTransactionGenerator : public TransactionGenerator {
+    // Y = A * X for a small batch of b input vectors (x and y hold the b
+    // vectors one after another). Every word of A read from a bank is used
+    // for up to PIM_MAX_BATCH vectors, bigger batches run in groups.
+    class GemmSmallBatchTransactionGenerator : public TransactionGenerator {
     public:
-        LstmPreTransactionGenerator(const std::string& config_file,
+        GemmSmallBatchTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
-            uint64_t i_f,
-            uint64_t o_f,
+            uint64_t m,
+            uint64_t n,
+            uint64_t b,
+            uint8_t* A,
             uint8_t* x,
             uint8_t* y,
-            uint8_t* h,
-            uint8_t* b,
-            uint8_t* Wh)
-            : TransactionGenerator(config_file, output_dir),
-            i_f_(i_f), o_f_(o_f), x_(x), y_(y), h_(h), b_(b), Wh_(Wh) {}
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            m_(m), n_(n), b_(b), A_(A), x_(x), y_(y) {}
         void Initialize() override;
         void SetData() override;
         void Execute() override;
@@ -301,66 +400,334 @@ namespace dramsim3 {
         void CheckResult() override;
 
     private:
-        void ExecuteBank(int bank);
+        void SetKernel(int batch);
+        void WriteSrf(uint64_t first, int batch, int step);
 
-        uint8_t* x_, * y_, * h_, * b_, * Wh_;
-        uint8_t* Wh_T_;
-        uint64_t i_f_, o_f_;
-        uint64_t addr_x_, addr_y_, addr_h_, addr_b_, addr_Wh_;
+        uint8_t *A_, *x_, *y_;
+        uint8_t *x_pad_, *y_pad_;
+        uint64_t m_, n_, b_;
+        uint64_t m_pad_, n_pad_;
+        uint64_t tile_m_;
+        uint64_t num_tiles_;
+        PimBuffer buf_A_, buf_y_;
+        uint64_t base_row_A_, tile_stride_, base_row_y_, base_row_idle_;
         uint64_t ukernel_access_size_;
         uint64_t ukernel_count_per_pim_;
-        uint32_t* ukernel_lstm_, * ukernel_wr_result_;
+        PimInstruction* ukernel_gemm_;
     };
 
+    // Elementwise expression of up to 3 input vectors and scalars in one
+    // μkernel, e.g. "z = a*x + y" (AXPY), "w = x*gamma + beta" or
+    // "h = gelu(x + b)". The right side is a sum of products, optionally in
+    // relu, clamp(sum, lo, hi) or a LUT activation (gelu, silu, sigmoid,
+    // tanh, exp) which take the sum as Q8.8. Scalars are broadcast from the
+    // SRF and numbers are scalars as well. Every input word is read once and every
+    // output word written once, a chain of instructions keeps the partial
+    // result in GRF_A0 and reads the column once per instruction.
+    //  vectors holds the n unit host arrays of the inputs and the output,
+    //  scalars the values of the named scalars
+    class FusedTransactionGenerator : public TransactionGenerator {
+    public:
+        FusedTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            const std::string& expr,
+            uint64_t n,
+            const std::map<std::string, uint8_t*>& vectors,
+            const std::map<std::string, unit_t>& scalars = std::map<std::string, unit_t>(),
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            expr_(expr), n_(n), vectors_(vectors), scalars_(scalars) {}
+        void Initialize() override;
+        void SetData() override;
+        void Execute() override;
+        void GetResult() override;
+        void CheckResult() override;
+
+    private:
+        // one term of the sum, a product of operand names
+        typedef std::vector<std::string> FusedTerm;
 
-    class CPUAddTransactionGenerator : public TransactionGenerator {
+        void Parse();
+        std::string Compile(int ba);
+        std::string OperandName(const std::string& name, int ba);
+        unit_t Evaluate(uint64_t i);
+
+        std::string expr_;
+        uint64_t n_;
+        std::map<std::string, uint8_t*> vectors_;
+        std::map<std::string, unit_t> scalars_;
+        std::string out_;
+        std::vector<FusedTerm> terms_;
+        // activation applied to the sum, empty if none, and the scalar
+        // bounds of clamp
+        std::string act_;
+        std::string lo_, hi_;
+        std::vector<unit_t> lut_;
+        // vector operands, inputs in order of appearance then the output.
+        // Operand j sits in bank ba^j of pass ba
+        std::vector<std::string> operands_;
+        // SRF unit of every scalar
+        std::map<std::string, int> srf_index_;
+        std::vector<PimBuffer> bufs_;
+        std::vector<uint8_t*> pads_;
+        uint64_t base_row_idle_;
+        uint64_t op_count_;
+        int chain_;  // instructions per word
+        PimInstruction* ukernel_fused_;
+    };
+
+    enum class PimReduce { SUM, MAX, ARGMAX };
+
+    // Sum, max or argmax of n units of x. Every unit reduces its banks into
+    // GRF_A0 (ARGMAX with the positions in GRF_B0), then its lanes and the
+    // bankgroups of the channel (RSUM, RMAX, RARGMAX), so the host reads one
+    // word per channel (two for ARGMAX) and reduces over the channels.
+    //  MAX and ARGMAX take x as signed, SUM wraps like ADD
+    class ReduceTransactionGenerator : public TransactionGenerator {
     public:
-        CPUAddTransactionGenerator(const std::string& config_file,
+        ReduceTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
-            uint64_t b,
-            uint64_t n)
-            : TransactionGenerator(config_file, output_dir),
-            b_(b), n_(n) {}
+            PimReduce op,
+            uint64_t n,
+            uint8_t* x,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            op_(op), n_(n), x_(x) {}
         void Initialize() override;
-        void SetData() override {};
+        void SetData() override;
         void Execute() override;
-        void GetResult() override {};
-        void CheckResult() override {};
+        void GetResult() override;
+        void CheckResult() override;
+
+        unit_t GetValue() const { return value_; }
+        // ARGMAX, index of the max
+        uint64_t GetIndex() const { return index_; }
+        uint64_t GetReadBytes() const { return read_bytes_; }
 
     private:
-        uint64_t b_;
+        PimReduce op_;
         uint64_t n_;
-        uint64_t addr_x_, addr_y_, addr_z_;
+        uint8_t* x_;
+        uint8_t* x_pad_;
+        uint8_t* out_;
+        PimBuffer buf_x_, buf_out_;
+        uint64_t base_row_idle_;
+        uint64_t op_count_;
+        // instructions before and after the sweep over the banks
+        int prologue_, tail_;
+        // ARGMAX: element index of every word address of x
+        std::unordered_map<uint64_t, uint64_t> index_of_;
+        unit_t value_;
+        uint64_t index_;
+        uint64_t read_bytes_;
+        PimInstruction* ukernel_reduce_;
     };
 
+    enum class PimNorm { LAYER, RMS };
+
+    // LayerNorm y = (x - mean) * rstd * gamma + beta or RMSNorm y = x * rstd
+    // * gamma + beta over the f features of each of l tokens, all in Q8.8.
+    // gamma and beta may be NULL (1 and 0).
+    //  Token t runs on channel t % channels with the tokens of the other
+    //  channels in the same group, features are zero padded to 256 (16 banks
+    //  of 16 lanes) so f is arbitrary. The stats kernel sums x (LAYER) and
+    //  x*x with QMAC into lane partials, the host reads 2 words per unit and
+    //  token, sums them in 64 bits and computes mean and rsqrt. Per group the
+    //  SRF of every channel then takes -mean and rstd of its token and the
+    //  apply kernel writes y in a second sweep.
+    //  A lane partial sums f/64 values of a token in 16 bits and saturates
+    //  at 128.0, e.g. for f = 4096 the RMS of x stays below 1.4
+    class NormTransactionGenerator : public TransactionGenerator {
+    public:
+        NormTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            PimNorm norm,
+            uint64_t l,
+            uint64_t f,
+            uint8_t* x,
+            uint8_t* y,
+            uint8_t* gamma = NULL,
+            uint8_t* beta = NULL,
+            double eps = 1e-5,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            norm_(norm), l_(l), f_(f), x_(x), y_(y), gamma_(gamma), beta_(beta),
+            eps_(eps) {}
+        void Initialize() override;
+        void SetData() override;
+        void Execute() override;
+        void GetResult() override;
+        void CheckResult() override;
+
+        // bytes of lane partials the host read for the statistics
+        uint64_t GetStatBytes() const { return stat_bytes_; }
+
+    private:
+        // word w of bank slot k (bankgroup k/4, bank k%4) of channel ch, bank
+        // flipped by j for the j-th operand of the apply kernel
+        uint64_t WordAddress(uint64_t base_row, int ch, uint64_t w, int k, int j = 0);
+        void EnterBg();
+        void ExitBg();
+        // rstd (SRF_M0) and -mean (SRF_A0) of a token from its sums
+        void Scale(int64_t sum, int64_t sum_sq, unit_t* rstd, unit_t* shift);
+        unit_t Apply(uint64_t t, uint64_t i, unit_t rstd, unit_t shift);
+
+        PimNorm norm_;
+        uint64_t l_, f_;
+        uint8_t *x_, *y_, *gamma_, *beta_;
+        double eps_;
+        // words per bank of a token, DRAM rows of a group, tokens per group
+        uint64_t fw_, group_rows_, num_ch_, num_groups_;
+        // tokens padded to whole groups and features to fw_ * 256
+        uint64_t f_pad_;
+        uint8_t *x_pad_, *y_pad_, *gamma_pad_, *beta_pad_;
+        // lane partials, 2 words per unit and token
+        uint8_t* stat_;
+        std::vector<unit_t> rstd_, shift_;
+        PimBuffer buf_x_, buf_y_, buf_gamma_, buf_beta_, buf_stat_;
+        uint64_t base_row_idle_;
+        // operand of gamma, beta and y in the apply kernel
+        int j_gamma_, j_beta_, j_y_;
+        // instructions before and after the sweep of the stats kernel and
+        // per word of both kernels
+        int prologue_, tail_, stat_chain_, chain_;
+        int saturated_;  // tokens with a saturated lane partial
+        uint64_t stat_bytes_;
+        PimInstruction* ukernel_stat_;
+        PimInstruction* ukernel_apply_;
+    };
 
-    class CPUGemvTransactionGenerator : public TransactionGenerator {
+    enum class HostPattern { STREAM, RANDOM };
+
+    // Ordinary host reads and writes in SB mode, e.g. launched on a
+    // PimScheduler on the channels no PIM kernel runs on.
+    //  STREAM : z = x + y over n units, the host reads x and y and writes z
+    //           word by word (like StreamCPU)
+    //  RANDOM : requests random word accesses to x, reads with probability
+    //           read_ratio (like RandomCPU), reads are checked against what
+    //           the host last wrote
+    // Execute times every read from issue to its callback, the stats show
+    // what the kernels on the other channels cost the host
+    class HostTransactionGenerator : public TransactionGenerator {
     public:
-        CPUGemvTransactionGenerator(const std::string& config_file,
+        HostTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
-            uint64_t b,
-            uint64_t m,
+            HostPattern pattern,
             uint64_t n,
+            uint8_t* x,
+            uint8_t* y = NULL,
+            uint8_t* z = NULL,
+            uint64_t requests = 0,
+            double read_ratio = 0.5,
+            PimScheduler* scheduler = NULL)
+            : TransactionGenerator(config_file, output_dir, scheduler),
+            pattern_(pattern), n_(n), x_(x), y_(y), z_(z),
+            requests_(requests), read_ratio_(read_ratio),
+            shadow_(NULL), word_temp_(NULL) {}
+        void Initialize() override;
+        void SetData() override;
+        void Execute() override;
+        void GetResult() override;
+        void CheckResult() override;
+        void ReadCallBack(uint64_t addr, uint8_t* DataPtr) override;
+
+        void PrintHostStats();
+        uint64_t GetExecuteClk() const { return exec_clk_; }
+        double GetAvgReadLatency() const {
+            return num_reads_done_ ? (double)read_latency_sum_ / num_reads_done_ : 0.0;
+        }
+
+    private:
+        void IssueRead(uint64_t hex_addr, uint8_t* DataPtr);
+
+        HostPattern pattern_;
+        uint64_t n_;
+        uint8_t *x_, *y_, *z_;
+        uint64_t requests_;
+        double read_ratio_;
+        PimBuffer buf_x_, buf_y_, buf_z_;
+        uint64_t num_words_;
+        uint8_t *shadow_, *word_temp_;
+        // issue cycles of the reads in flight, oldest first
+        std::unordered_map<uint64_t, std::deque<uint64_t>> read_issue_clk_;
+        uint64_t num_reads_, num_writes_, num_reads_done_;
+        uint64_t read_latency_sum_, read_latency_max_;
+        uint64_t exec_clk_;
+        int errors_;
+    };
+
+    // Host baseline of a PIM op: the host does the same op over the normal
+    // memory interface (SB mode) for a batch of b inputs. Only the traffic
+    // is simulated. Every operand is read (or written) once, and an operand
+    // the op reuses (weights over the batch, GEMV x over the rows, BN and
+    // norm parameters over the tokens) is read again for miss_ratio of its
+    // reuses, the host cache hits the rest. Compare GetClk() and
+    // GetEnergy() around Execute() with those of the PIM generator
+    class CPUTransactionGenerator : public TransactionGenerator {
+    public:
+        CPUTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
             double miss_ratio)
             : TransactionGenerator(config_file, output_dir),
-            b_(b), m_(m), n_(n), miss_ratio_(miss_ratio) {}
+            miss_ratio_(miss_ratio) {}
         void Initialize() override;
         void SetData() override {};
         void Execute() override;
         void GetResult() override {};
         void CheckResult() override {};
 
+    protected:
+        // operand of n units, every unit used reuses more times
+        void AddOperand(uint64_t n, bool is_write, uint64_t reuses = 0);
+
     private:
-        void ExecuteBank(int bank, int batch);
+        struct CPUOperand {
+            uint64_t size;
+            bool is_write;
+            uint64_t reuses;
+            PimBuffer buf;
+        };
 
-        uint64_t b_;
-        uint64_t m_, n_;
         double miss_ratio_;
-        uint64_t addr_A_, addr_y_, addr_x_;
+        std::vector<CPUOperand> operands_;
     };
 
+    // inputs vectors of n units in, one out: ADD and MUL (2 inputs), fused
+    // expressions (up to 3) and activations (1, the LUT stays in cache)
+    class CPUElementwiseTransactionGenerator : public CPUTransactionGenerator {
+    public:
+        CPUElementwiseTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            uint64_t b,
+            uint64_t n,
+            int inputs = 2)
+            : CPUTransactionGenerator(config_file, output_dir, 0.0) {
+            for (int i = 0; i < inputs; i++)
+                AddOperand(b * n, false);
+            AddOperand(b * n, true);
+        }
+    };
+
+    // Y = A * X for b vectors, A is reused for every vector and x for
+    // every row of A
+    class CPUGemvTransactionGenerator : public CPUTransactionGenerator {
+    public:
+        CPUGemvTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            uint64_t b,
+            uint64_t m,
+            uint64_t n,
+            double miss_ratio)
+            : CPUTransactionGenerator(config_file, output_dir, miss_ratio) {
+            AddOperand(m * n, false, b - 1);
+            AddOperand(b * n, false, m - 1);
+            AddOperand(b * m, true);
+        }
+    };
 
-    class CPUBatchNormTransactionGenerator : public TransactionGenerator {
+    // w = x * y + z for b inputs of l x f, y and z are reused for every
+    // row of x
+    class CPUBatchNormTransactionGenerator : public CPUTransactionGenerator {
     public:
         CPUBatchNormTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
@@ -368,21 +735,17 @@ namespace dramsim3 {
             uint64_t l,
             uint64_t f,
             double miss_ratio)
-            : TransactionGenerator(config_file, output_dir),
-            b_(b), l_(l), f_(f), miss_ratio_(miss_ratio) {}
-        void Initialize() override;
-        void SetData() override {};
-        void Execute() override;
-        void GetResult() override {};
-        void CheckResult() override {};
-
-    private:
-        uint64_t b_, l_, f_;
-        uint64_t addr_x_, addr_y_, addr_z_, addr_w_;
-        double miss_ratio_;
+            : CPUTransactionGenerator(config_file, output_dir, miss_ratio) {
+            AddOperand(b * l * f, false);
+            AddOperand(f, false, b * l - 1);
+            AddOperand(f, false, b * l - 1);
+            AddOperand(b * l * f, true);
+        }
     };
 
-    class CPULstmTransactionGenerator : public TransactionGenerator {
+    // LSTM gates y = Wx * x + Wh * h + b for b inputs, the weights and the
+    // bias are reused for every input, x and h for every row of Wx and Wh
+    class CPULstmTransactionGenerator : public CPUTransactionGenerator {
     public:
         CPULstmTransactionGenerator(const std::string& config_file,
             const std::string& output_dir,
@@ -390,20 +753,48 @@ namespace dramsim3 {
             uint64_t i_f,
             uint64_t o_f,
             double miss_ratio)
-            : TransactionGenerator(config_file, output_dir),
-            b_(b), i_f_(i_f), o_f_(o_f), miss_ratio_(miss_ratio) {}
-        void Initialize() override;
-        void SetData() override {};
-        void Execute() override;
-        void GetResult() override {};
-        void CheckResult() override {};
+            : CPUTransactionGenerator(config_file, output_dir, miss_ratio) {
+            // Wx is 4*o_f x i_f, Wh 4*o_f x o_f, h holds o_f units
+            AddOperand(4 * o_f * i_f, false, b - 1);
+            AddOperand(4 * o_f * o_f, false, b - 1);
+            AddOperand(4 * o_f, false, b - 1);
+            AddOperand(b * i_f, false, 4 * o_f - 1);
+            AddOperand(b * o_f, false, 4 * o_f - 1);
+            AddOperand(b * 4 * o_f, true);
+        }
+    };
 
-    private:
-        uint64_t b_, i_f_, o_f_;
-        uint64_t addr_x_, addr_y_, addr_h_, addr_b_, addr_Wx_, addr_Wh_;
-        double miss_ratio_;
+    // sum, max or argmax of b vectors of n units
+    class CPUReduceTransactionGenerator : public CPUTransactionGenerator {
+    public:
+        CPUReduceTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            uint64_t b,
+            uint64_t n)
+            : CPUTransactionGenerator(config_file, output_dir, 0.0) {
+            AddOperand(b * n, false);
+            AddOperand(b, true);
+        }
+    };
+
+    // LayerNorm or RMSNorm of b * l tokens of f features. A token stays in
+    // the host cache for both passes, gamma and beta are reused for every
+    // token
+    class CPUNormTransactionGenerator : public CPUTransactionGenerator {
+    public:
+        CPUNormTransactionGenerator(const std::string& config_file,
+            const std::string& output_dir,
+            uint64_t b,
+            uint64_t l,
+            uint64_t f,
+            double miss_ratio)
+            : CPUTransactionGenerator(config_file, output_dir, miss_ratio) {
+            AddOperand(b * l * f, false);
+            AddOperand(f, false, b * l - 1);
+            AddOperand(f, false, b * l - 1);
+            AddOperand(b * l * f, true);
+        }
     };
-    */
 }  // namespace dramsim3
 
 #endif // __TRANSACTION_GENERATOR_H